@@ -0,0 +1,388 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "Benchmark.h"
+#include "MQTTData.h"
+#include "MQTTBrokerStandIn.h"
+#include "ISOTime.h"
+#include "FetchEngine.h"
+#include "HTTPStandIn.h"
+#include "FileDownload.h"
+#include "TinyJson.h"
+#include "JsonDocument.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <ctime>
+#include <thread>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+
+namespace benchmark{
+
+static int64_t GetTimeNS()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t GetCPUTimeNS()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF,&usage);
+    return ((int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000) +
+           ((int64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000);
+}
+
+LatencyStats::LatencyStats()
+{
+    mSamples.reserve(100000);
+}
+
+void LatencyStats::Add(int64_t pNanoseconds)
+{
+    mSamples.push_back(pNanoseconds);
+}
+
+void LatencyStats::Report(const char* pName)const
+{
+    if( mSamples.size() == 0 )
+    {
+        std::cout << pName << ": no samples\n";
+        return;
+    }
+
+    std::vector<int64_t> sorted = mSamples;
+    std::sort(sorted.begin(),sorted.end());
+    auto percentile = [&sorted](double p)
+    {
+        return sorted[std::min(sorted.size() - 1,(size_t)(p * sorted.size()))] / 1000000.0;
+    };
+
+    std::cout << pName << ": " << sorted.size() << " samples"
+              << " p50 " << percentile(0.5) << "ms"
+              << " p99 " << percentile(0.99) << "ms"
+              << " max " << sorted.back() / 1000000.0 << "ms\n";
+}
+
+void ISOTimeParse(uint32_t pCount)
+{
+    // Half hourly events from now, the same shape as the tide data.
+    std::vector<std::string> times;
+    times.reserve(pCount);
+    const std::time_t start = std::time(nullptr);
+    char text[32];
+    for( uint32_t n = 0 ; n < pCount ; n++ )
+    {
+        const std::time_t t = start + (n * 1800);
+        tm local;
+        localtime_r(&t,&local);
+        strftime(text,sizeof(text),"%Y-%m-%dT%H:%M:%S",&local);
+        times.push_back(text);
+    }
+
+    // What DisplayTideData did per event.
+    int64_t oldFuture = 0;
+    int64_t oldStart = GetTimeNS();
+    for( const std::string& timeString : times )
+    {
+        std::time_t result = std::time(nullptr);
+        tm *currentTime = localtime(&result);
+        std::istringstream time(timeString);
+        tm eventTime;
+        time >> std::get_time(&eventTime, "%Y-%m-%dT%H:%M:%S");
+        if( time.fail() == false && difftime(std::mktime(&eventTime),std::mktime(currentTime)) >= 0 )
+            oldFuture++;
+    }
+    const int64_t oldTime = GetTimeNS() - oldStart;
+
+    int64_t newFuture = 0;
+    const int64_t newStart = GetTimeNS();
+    const int32_t offset = isotime::GetUTCOffset(start);
+    for( const std::string& timeString : times )
+    {
+        int64_t eventTime;
+        if( isotime::Parse(timeString,eventTime,offset) && eventTime >= start )
+            newFuture++;
+    }
+    const int64_t newTime = GetTimeNS() - newStart;
+
+    const double count = std::max(pCount,1u);
+    std::cout << "ISO-8601 parse benchmark, " << pCount << " timestamps\n";
+    std::cout << "  istringstream + get_time + mktime " << oldTime / count << "ns each (" << oldFuture << " in the future)\n";
+    std::cout << "  isotime::Parse " << newTime / count << "ns each (" << newFuture << " in the future)\n";
+    std::cout << "  " << (double)oldTime / std::max(newTime,(int64_t)1) << " times faster\n";
+}
+
+/**
+ * @brief Puts the peak RSS back to the current RSS, so the next GetPeakRSSKB is for one run only.
+ * Needs Linux 4.0 or later, returns false if it could not, then the peak is the process's high water mark.
+ */
+static bool ResetPeakRSS()
+{
+    FILE* file = fopen("/proc/self/clear_refs","w");
+    if( file == nullptr )
+        return false;
+    const bool written = fputs("5",file) >= 0;
+    return fclose(file) == 0 && written;
+}
+
+static int64_t GetPeakRSSKB()
+{
+    // VmHWM is the one clear_refs resets, ru_maxrss never goes down.
+    FILE* file = fopen("/proc/self/status","r");
+    if( file )
+    {
+        char line[256];
+        long long kb;
+        while( fgets(line,sizeof(line),file) )
+        {
+            if( strncmp(line,"VmHWM:",6) == 0 && sscanf(line + 6,"%lld",&kb) == 1 )
+            {
+                fclose(file);
+                return kb;
+            }
+        }
+        fclose(file);
+    }
+
+    rusage usage;
+    getrusage(RUSAGE_SELF,&usage);
+    return usage.ru_maxrss;
+}
+
+struct FetchRun
+{
+    bool ok = false;
+    int64_t totalNS = 0;
+    int64_t parseNS = -1;   //!< -1 when the parse happened during the transfer.
+    int64_t stallNS = 0;    //!< Longest the UI thread was busy in one go.
+    int64_t peakGrowthKB = 0;
+    bool peakPerRun = false;//!< False if the peak could not be reset, so it is the process's high water mark and only grows.
+    uint64_t bytes = 0;
+};
+
+static void ReportRun(const char* pMode,const FetchRun& pRun)
+{
+    std::cout << "    " << pMode << (pRun.ok ? "" : " FAILED") << " " << pRun.bytes << " bytes"
+              << " total " << pRun.totalNS / 1000000.0 << "ms";
+    if( pRun.parseNS >= 0 )
+        std::cout << " parse " << pRun.parseNS / 1000000.0 << "ms";
+    std::cout << " UI stall " << pRun.stallNS / 1000000.0 << "ms"
+              << (pRun.peakPerRun ? " peak RSS +" : " process peak RSS +") << pRun.peakGrowthKB << "KB\n";
+}
+
+enum FetchParse
+{
+    PARSE_STREAM,       //!< Through a JsonStream as it arrives.
+    PARSE_DOCUMENT,     //!< A JsonDocument once it is all in.
+    PARSE_TINYJSON      //!< A TinyJson DOM once it is all in.
+};
+
+static FetchRun FetchWithEngine(FetchEngine& pEngine,const std::string& pURL,FetchParse pParse)
+{
+    FetchRun run;
+    run.peakPerRun = ResetPeakRSS();
+    const int64_t peak = GetPeakRSSKB();
+    const int64_t start = GetTimeNS();
+
+    auto parseNS = std::make_shared<std::atomic<int64_t>>(0);
+    FetchEngine::Request request;
+    request.url = pURL;
+    request.who = "FetchSuite";
+    if( pParse == PARSE_STREAM )
+    {
+        request.stream = std::make_shared<JsonStream::Handler>();// Reads every event and keeps nothing.
+    }
+    else if( pParse == PARSE_DOCUMENT )
+    {
+        request.parse = [parseNS](const std::string& pBody)
+        {
+            const int64_t parseStart = GetTimeNS();
+            JsonDocument json;
+            const bool ok = json.Parse(pBody);
+            *parseNS = GetTimeNS() - parseStart;
+            return ok;
+        };
+    }
+    else
+    {
+        request.parse = [parseNS](const std::string& pBody)
+        {
+            const int64_t parseStart = GetTimeNS();
+            tinyjson::JsonProcessor json(pBody);
+            *parseNS = GetTimeNS() - parseStart;
+            return true;
+        };
+    }
+
+    bool done = false;
+    request.onComplete = [&run,&done](const FetchEngine::Result& pResult)
+    {
+        run.ok = pResult.ok;
+        run.bytes = pResult.bodySize;
+        done = true;
+    };
+    pEngine.Submit(request);
+
+    // A 60Hz frame loop, as the UI would be running.
+    while( done == false )
+    {
+        const int64_t frameStart = GetTimeNS();
+        pEngine.Tick();
+        const int64_t frameTime = GetTimeNS() - frameStart;
+        run.stallNS = std::max(run.stallNS,frameTime);
+        std::this_thread::sleep_for(std::chrono::nanoseconds(std::max<int64_t>(0,16666666 - frameTime)));
+    }
+
+    run.totalNS = GetTimeNS() - start;
+    run.parseNS = pParse == PARSE_STREAM ? -1 : parseNS->load();
+    run.peakGrowthKB = GetPeakRSSKB() - peak;
+    return run;
+}
+
+static FetchRun FetchBlocking(const std::string& pURL)
+{
+    FetchRun run;
+    run.peakPerRun = ResetPeakRSS();
+    const int64_t peak = GetPeakRSSKB();
+    const int64_t start = GetTimeNS();
+
+    const std::string body = DownloadJson(pURL,"FetchSuite");
+    const int64_t parseStart = GetTimeNS();
+    try
+    {
+        tinyjson::JsonProcessor json(body);
+        run.ok = body.size() > 0;
+    }
+    catch(std::exception&)
+    {
+        run.ok = false;
+    }
+
+    run.parseNS = GetTimeNS() - parseStart;
+    run.totalNS = GetTimeNS() - start;
+    run.stallNS = run.totalNS;// All of it was on the calling thread.
+    run.bytes = body.size();
+    run.peakGrowthKB = GetPeakRSSKB() - peak;
+    return run;
+}
+
+bool FetchSuite(const std::string& pFixtureFolder)
+{
+    HTTPStandIn standIn(pFixtureFolder);
+    const std::vector<HTTPStandIn::Scenario> scenarios = HTTPStandIn::GetStandardScenarios();
+    if( standIn.Start(scenarios.front()) == false )
+        return false;
+
+    FetchEngine engine("");// No cache, so every fetch goes to the stand in.
+    engine.SetHostOverride(standIn.GetBaseURL());
+
+    // Each run resets the peak RSS first. Where that is not possible it only goes up, so the leanest way runs first or its growth would be hidden.
+    std::cout << "Fetch benchmark, " << standIn.GetURLs().size() << " fixtures from " << pFixtureFolder << "\n";
+    for( const auto& scenario : scenarios )
+    {
+        standIn.SetScenario(scenario);
+        std::cout << "Scenario " << scenario.name << "\n";
+        for( const auto& url : standIn.GetURLs() )
+        {
+            std::cout << "  " << url << "\n";
+            ReportRun("FetchEngine streamed      ",FetchWithEngine(engine,url,PARSE_STREAM));
+            ReportRun("FetchEngine JsonDocument  ",FetchWithEngine(engine,url,PARSE_DOCUMENT));
+            ReportRun("FetchEngine TinyJson      ",FetchWithEngine(engine,url,PARSE_TINYJSON));
+            ReportRun("DownloadJson TinyJson     ",FetchBlocking(standIn.GetBaseURL() + HTTPStandIn::GetPath(url)));
+        }
+    }
+
+    const FetchEngine::Stats stats = engine.GetStats();
+    std::cout << "  " << stats.fetches << " fetches, " << stats.newConnections << " new connections, "
+              << standIn.GetRequestCount() << " requests served\n";
+    return true;
+}
+
+MQTTLatency::MQTTLatency(const MQTTBrokerStandIn& pBroker):
+    mBroker(pBroker),
+    mShown(pBroker.GetTopicCount(),0),
+    mStartTime(GetTimeNS()),
+    mStartCPU(GetCPUTimeNS())
+{
+    mPending.reserve(100000);
+}
+
+void MQTTLatency::OnDelivered(int64_t pReceivedNS)
+{
+    mToStore.Add(GetTimeNS() - pReceivedNS);
+}
+
+void MQTTLatency::OnShown(std::string_view pTopic,int32_t pSequence)
+{
+    const int topic = mBroker.FindTopic(pTopic);
+    if( topic < 0 || pSequence <= 0 || (uint32_t)pSequence <= mShown[topic] )
+        return;
+
+    // This one and any before it that never made it to the screen on their own.
+    const int64_t now = GetTimeNS();
+    for( uint32_t s = mShown[topic] + 1 ; s <= (uint32_t)pSequence ; s++ )
+    {
+        const int64_t published = mBroker.GetPublishTime(topic,s);
+        if( published > 0 )
+        {
+            mToText.Add(now - published);
+            mPending.push_back(published);
+            mShownCount++;
+        }
+    }
+    mShown[topic] = (uint32_t)pSequence;
+}
+
+void MQTTLatency::OnDrawn()
+{
+    const int64_t now = GetTimeNS();
+    for( int64_t published : mPending )
+    {
+        mToDrawn.Add(now - published);
+    }
+    mPending.clear();
+}
+
+bool MQTTLatency::GetAllShown()const
+{
+    return mBroker.GetFinished() && mShownCount == mBroker.GetPublishedCount() && mPending.size() == 0;
+}
+
+void MQTTLatency::Report(const MQTTData& pMQTT,uint32_t pUpdateInterval)const
+{
+    const int64_t wall = GetTimeNS() - mStartTime;
+    const int64_t cpu = GetCPUTimeNS() - mStartCPU;
+
+    std::cout << "MQTT latency benchmark, update interval " << pUpdateInterval << "ms\n";
+    mToStore.Report("  receive to store");
+    mToText.Report("  publish to text change");
+    mToDrawn.Report("  publish to drawn");
+    std::cout << "  published " << mBroker.GetPublishedCount()
+              << " shown " << mShownCount
+              << " delivered " << mToStore.GetCount()
+              << " coalesced " << pMQTT.GetCoalescedCount()
+              << " dropped " << pMQTT.GetDroppedCount() << "\n";
+    std::cout << "  CPU " << (100.0 * cpu) / std::max(wall,(int64_t)1) << "% of one core over " << wall / 1000000 << "ms\n";
+}
+
+};//namespace benchmark
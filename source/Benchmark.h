@@ -0,0 +1,116 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "Element.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+class MQTTData;
+class MQTTBrokerStandIn;
+
+namespace benchmark{
+
+/**
+ * @brief Collects latency samples and reports percentiles.
+ */
+class LatencyStats
+{
+public:
+    LatencyStats();
+
+    void Add(int64_t pNanoseconds);
+    size_t GetCount()const{return mSamples.size();}
+    void Report(const char* pName)const;
+
+private:
+    std::vector<int64_t> mSamples;
+};
+
+/**
+ * @brief Times pCount tide style timestamps through the old istringstream, std::get_time and std::mktime path
+ * and through isotime::Parse, and reports the cost of each per timestamp.
+ */
+void ISOTimeParse(uint32_t pCount);
+
+/**
+ * @brief Replays the fixtures in pFixtureFolder, an HTTPCache folder, through HTTPStandIn under each standard scenario.
+ * Each fixture is fetched four ways. Streamed through FetchEngine into a JsonStream, through FetchEngine with a
+ * JsonDocument or a TinyJson parse on its thread, and with DownloadJson then a TinyJson parse on the calling thread as the UI used to.
+ * Reports the total and parse time, the longest the UI thread was held up and how much the peak RSS grew during
+ * that run. Where the kernel cannot reset the peak it is reported as the process peak, which only ever grows.
+ */
+bool FetchSuite(const std::string& pFixtureFolder);
+
+/**
+ * @brief Measures publish to display latency for MQTT traffic sent by an MQTTBrokerStandIn, through libmosquitto.
+ * Publish is when the stand in sent the message. OnDelivered is called by MQTTData as each message is dispatched
+ * on the UI thread, when the telemetry slot is written, with the time its network thread received it.
+ * OnShown is called once a widget has changed its text, see TelemetryStore::Shown. The value is the message's
+ * sequence for its topic so every message up to it is counted, the coalesced and dropped ones too, as they only
+ * reach the screen when a later one does. OnDrawn is called by a FrameProbe once every widget has been drawn.
+ */
+class MQTTLatency
+{
+public:
+    MQTTLatency(const MQTTBrokerStandIn& pBroker);
+
+    void OnDelivered(int64_t pReceivedNS);
+    void OnShown(std::string_view pTopic,int32_t pSequence);
+    void OnDrawn();
+
+    bool GetAllShown()const;//!< The stand in has finished and every message it sent has been shown.
+    void Report(const MQTTData& pMQTT,uint32_t pUpdateInterval)const;
+
+private:
+    const MQTTBrokerStandIn& mBroker;
+    LatencyStats mToStore;
+    LatencyStats mToText;
+    LatencyStats mToDrawn;
+    std::vector<uint32_t> mShown;   //!< For each topic the stand in publishes, the last sequence shown.
+    uint64_t mShownCount = 0;
+    std::vector<int64_t> mPending;  //!< Publish times of the messages shown since the last draw.
+    int64_t mStartTime;
+    int64_t mStartCPU;
+};
+
+/**
+ * @brief Attach it last to the root, it draws nothing but as it is drawn after every widget that is when the frame is drawn.
+ * The frame is yet to be presented, that is up to the platform.
+ */
+class FrameProbe : public eui::Element
+{
+public:
+    FrameProbe(MQTTLatency& pLatency):mLatency(pLatency){}
+
+    virtual bool OnDraw(eui::Graphics* pGraphics,const eui::Rectangle& pContentRect)
+    {
+        mLatency.OnDrawn();
+        return true;
+    }
+
+private:
+    MQTTLatency& mLatency;
+};
+
+};//namespace benchmark
+
+#endif //#ifndef BENCHMARK_H
@@ -1,5 +1,8 @@
 
 #include "DisplayBitcoinPrice.h"
+#include "MQTTPayload.h"
+
+#include <cstring>
 #include "TinyJson.h"
 #include "FileDownload.h"
 #include "style.h"
@@ -29,6 +32,9 @@ DisplayBitcoinPrice::DisplayBitcoinPrice(int pBitcoinFont)
         mControls.LastPriceUK->SetPadding(CELL_PADDING);
         mControls.LastPriceUK->SetPos(0,1);
     this->Attach(mControls.LastPriceUK);
+
+    strcpy(mLastPriceUK.text,"N/A");
+    strcpy(mPriceChange.text,"N/A");
 }
 
 DisplayBitcoinPrice::~DisplayBitcoinPrice()
@@ -59,7 +65,23 @@ bool DisplayBitcoinPrice::OnUpdate(const eui::Rectangle& pContentRect)
         DownStyle.mForeground = eui::COLOUR_GREY;
     }
 
-    if( mPriceChange.find('-') == std::string::npos )
+    if( mTelemetry && mTelemetry->GetVersion(mPriceSlot) != mLastPriceUK.version )
+    {
+        TelemetryStore::Snapshot price;
+        int64_t pence;
+        if( mTelemetry->Read(mPriceSlot,price) && price.GetValid() && mqttpayload::DecodeFixed(price.text,pence) )
+        {
+            mLastPriceUK = price;
+            mPriceGBP = pence / 100.0;
+        }
+    }
+
+    if( mTelemetry && mTelemetry->GetVersion(mChangeSlot) != mPriceChange.version )
+    {
+        mTelemetry->Read(mChangeSlot,mPriceChange);
+    }
+
+    if( strchr(mPriceChange.text,'-') == nullptr )
     {
         mControls.LastPriceUK->SetStyle(UpStyle);
     }
@@ -68,21 +90,16 @@ bool DisplayBitcoinPrice::OnUpdate(const eui::Rectangle& pContentRect)
         mControls.LastPriceUK->SetStyle(DownStyle);
     }
 
-    mControls.LastPriceUK->SetTextF("£%s",mLastPriceUK.c_str());
+    mControls.LastPriceUK->SetTextF("£%s",mLastPriceUK.text);
 
 
     return true;
 }
 
-void DisplayBitcoinPrice::UpdateGBP(const std::string& pPrice)
-{
-    mLastPriceUK = pPrice;
-    mPriceGBP = std::stod(pPrice);
-}
-
-void DisplayBitcoinPrice::UpdateChange(const std::string& pPrice)
+void DisplayBitcoinPrice::BindTelemetry(TelemetryStore& pTelemetry)
 {
-    mPriceChange = pPrice;
+    mTelemetry = &pTelemetry;
+    mPriceSlot = pTelemetry.AddSlot("/btc/mine",TelemetryStore::VALUE_TEXT);
+    mChangeSlot = pTelemetry.AddSlot("/btc/change",TelemetryStore::VALUE_TEXT);
 }
 
-
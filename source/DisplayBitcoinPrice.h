@@ -5,6 +5,7 @@
 #include "Element.h"
 #include "TinyTools.h"
 #include "DataBinding.h"
+#include "TelemetryStore.h"
 
 #include <string>
 
@@ -18,14 +19,16 @@ public:
 
     const double GetPriceGBP()const{return mPriceGBP;}
 
-    void UpdateGBP(const std::string& pPrice);
-    void UpdateChange(const std::string& pPrice);
+    void BindTelemetry(TelemetryStore& pTelemetry);
 
 private:
     double mPriceGBP = 0.0;
 
-    std::string mLastPriceUK = "N/A";
-    std::string mPriceChange = "N/A";
+    const TelemetryStore* mTelemetry = nullptr;
+    int mPriceSlot = -1;
+    int mChangeSlot = -1;
+    TelemetryStore::Snapshot mLastPriceUK;
+    TelemetryStore::Snapshot mPriceChange;
 
     eui::Style UpStyle,DownStyle;
 
@@ -48,6 +48,7 @@ mYeld = nullptr;
     mBatterySOC->SetPadding(CELL_PADDING);
     mBatterySOC->SetPos(0,0);
 
+    mBatteryTrend = AttachTrend(mBatterySOC);
     this->Attach(mBatterySOC);
     
     mInverter = new eui::Element;
@@ -55,6 +56,7 @@ mYeld = nullptr;
     mInverter->SetText("Fetching");
     mInverter->SetPadding(CELL_PADDING);
     mInverter->SetPos(1,0);
+    mInverterTrend = AttachTrend(mInverter);
     this->Attach(mInverter);
 
     mFeedIn = new eui::Element;
@@ -63,6 +65,7 @@ mYeld = nullptr;
     mFeedIn->SetPadding(CELL_PADDING);
     mFeedIn->SetPos(2,0);
 
+    mGridTrend = AttachTrend(mFeedIn);
     this->Attach(mFeedIn);
 
     eui::ElementPtr pannels = new eui::Element;
@@ -74,6 +77,7 @@ mYeld = nullptr;
             mFrontPanels->SetText("...");
             mFrontPanels->SetPadding(CELL_PADDING);
             mFrontPanels->SetPos(0,0);
+            mFrontTrend = AttachTrend(mFrontPanels);
         pannels->Attach(mFrontPanels);
 
         mBackPanels = new eui::Element;
@@ -81,6 +85,7 @@ mYeld = nullptr;
             mBackPanels->SetText("...");
             mBackPanels->SetPadding(CELL_PADDING);
             mBackPanels->SetPos(1,0);
+            mRearTrend = AttachTrend(mBackPanels);
         pannels->Attach(mBackPanels);
     this->Attach(pannels);
 }
@@ -108,7 +113,17 @@ bool DisplaySolaX::OnUpdate(const eui::Rectangle& pContentRect)
     }
     else
     {
+        // Like the night SOC style, otherwise the feed in cell would keep the day background and lose its border.
+        ExportStyle = eui::Style();
+        ExportStyle.mThickness = BORDER_SIZE;
+        ExportStyle.mBorder = eui::COLOUR_DARK_GREY;
+        ExportStyle.mRadius = RECT_RADIUS;
         ExportStyle.mForeground = eui::COLOUR_DARK_GREEN;
+
+        ImportStyle = eui::Style();
+        ImportStyle.mThickness = BORDER_SIZE;
+        ImportStyle.mBorder = eui::COLOUR_DARK_GREY;
+        ImportStyle.mRadius = RECT_RADIUS;
         ImportStyle.mForeground = eui::COLOUR_DARK_RED;
     }
 
@@ -135,44 +150,87 @@ bool DisplaySolaX::OnUpdate(const eui::Rectangle& pContentRect)
     mFrontPanels->SetStyle(SOCStyle);
     mBackPanels->SetStyle(SOCStyle);
 
-    return true;
-}
+    // Only reformat the text when a new value has arrived.
+    TelemetryStore::Snapshot value;
+    if( GetNewValue(mBatteryData,value) )
+    {
+        mBatterySOC->SetTextF("%d%%",value.integer);
+        mTelemetry->Shown(mBatteryData.slot,value);
+    }
 
-void DisplaySolaX::UpdateData(const std::string& pTopic,const std::string& pData)
-{
-    if( tinytools::string::CompareNoCase(pTopic,"/solar/battery/total") )
+    if( mYeld && GetNewValue(mYeldData,value) )
     {
-        mBatterySOC->SetTextF("%d%%",std::stoi(pData));
+        mYeld->SetTextF("%2.2f",value.real);
+        mTelemetry->Shown(mYeldData.slot,value);
     }
-    else if( mYeld && tinytools::string::CompareNoCase(pTopic,"/solar/yeld") )
+
+    if( GetNewValue(mInverterData,value) )
     {
-        mYeld->SetTextF("%2.2f",std::stof(pData));
+        mInverter->SetTextF("%d",value.integer);
+        mTelemetry->Shown(mInverterData.slot,value);
     }
-    else if( tinytools::string::CompareNoCase(pTopic,"/solar/inverter/total") )
+
+    if( GetNewValue(mGridData,value) )
     {
-        mInverter->SetTextF("%d",std::stoi(pData));
+        mGridValid = true;
+        mGridImport = value.integer < 0;
+        mFeedIn->SetTextF("%d",mGridImport ? -value.integer : value.integer);
+        mTelemetry->Shown(mGridData.slot,value);
     }
-    else if( mFeedIn && tinytools::string::CompareNoCase(pTopic,"/solar/grid/total") )
+
+    if( GetNewValue(mFrontData,value) )
     {
-        const int total = std::stoi(pData);
-        if( total < 0 )
-        {
-            mFeedIn->SetStyle(ImportStyle);
-            mFeedIn->SetTextF("%d",-total);
-        }
-        else
-        {
-            mFeedIn->SetStyle(ExportStyle);
-            mFeedIn->SetTextF("%d",total);
-        }
+        mFrontPanels->SetTextF("%d",value.integer);
+        mTelemetry->Shown(mFrontData.slot,value);
     }
-    else if( tinytools::string::CompareNoCase(pTopic,"/solar/panel/front") )
+
+    if( GetNewValue(mRearData,value) )
     {
-        mFrontPanels->SetTextF("%d",std::stoi(pData));
+        mBackPanels->SetTextF("%d",value.integer);
+        mTelemetry->Shown(mRearData.slot,value);
     }
-    else if( tinytools::string::CompareNoCase(pTopic,"/solar/panel/rear") )
+
+    // Over the SOC style set above, so you can see at a glance if power is going to or coming from the grid.
+    if( mGridValid )
     {
-        mBackPanels->SetTextF("%d",std::stoi(pData));
+        mFeedIn->SetStyle(mGridImport ? ImportStyle : ExportStyle);
     }
+
+    return true;
+}
+
+void DisplaySolaX::BindTelemetry(TelemetryStore& pTelemetry,TelemetryHistory& pHistory)
+{
+    mTelemetry = &pTelemetry;
+    mBatteryData.slot = pTelemetry.AddSlot("/solar/battery/total",TelemetryStore::VALUE_INT);
+    mYeldData.slot = pTelemetry.AddSlot("/solar/yeld",TelemetryStore::VALUE_FLOAT);
+    mInverterData.slot = pTelemetry.AddSlot("/solar/inverter/total",TelemetryStore::VALUE_INT);
+    mGridData.slot = pTelemetry.AddSlot("/solar/grid/total",TelemetryStore::VALUE_INT);
+    mFrontData.slot = pTelemetry.AddSlot("/solar/panel/front",TelemetryStore::VALUE_INT);
+    mRearData.slot = pTelemetry.AddSlot("/solar/panel/rear",TelemetryStore::VALUE_INT);
+
+    mBatteryTrend->SetHistory(pHistory.AddSeries("/solar/battery/total"));
+    mInverterTrend->SetHistory(pHistory.AddSeries("/solar/inverter/total"));
+    mGridTrend->SetHistory(pHistory.AddSeries("/solar/grid/total"));
+    mFrontTrend->SetHistory(pHistory.AddSeries("/solar/panel/front"));
+    mRearTrend->SetHistory(pHistory.AddSeries("/solar/panel/rear"));
+}
+
+bool DisplaySolaX::GetNewValue(Cell& pCell,TelemetryStore::Snapshot& rValue)const
+{
+    if( mTelemetry == nullptr || mTelemetry->GetVersion(pCell.slot) == pCell.version )
+        return false;
+
+    if( mTelemetry->Read(pCell.slot,rValue) == false || rValue.GetValid() == false )
+        return false;
+
+    pCell.version = rValue.version;
+    return true;
 }
 
+Sparkline* DisplaySolaX::AttachTrend(eui::ElementPtr pCell)
+{
+    Sparkline* trend = new Sparkline;
+    pCell->Attach(trend);
+    return trend;
+}
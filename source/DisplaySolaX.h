@@ -26,6 +26,10 @@
 
 #include <vector>
 
+#include "TelemetryStore.h"
+#include "SensorHistory.h"
+#include "Sparkline.h"
+
 class DisplaySolaX : public eui::Element
 {
 public:
@@ -34,12 +38,27 @@ public:
     ~DisplaySolaX();
 
     virtual bool OnUpdate(const eui::Rectangle& pContentRect);
-    void UpdateData(const std::string& pTopic,const std::string& pData);
+    void BindTelemetry(TelemetryStore& pTelemetry,TelemetryHistory& pHistory);
 
 private:
 
+    struct Cell
+    {
+        int slot = -1;
+        uint32_t version = 0;
+    };
+
     eui::ElementPtr mBatterySOC,mYeld,mInverter,mFeedIn,mFrontPanels,mBackPanels;
     eui::Style ImportStyle,ExportStyle;
+    bool mGridValid = false;    //!< Until the first grid value arrives the feed in cell is styled like the others.
+    bool mGridImport = false;   //!< True when the last grid value was negative, power coming in from the grid.
+
+    const TelemetryStore* mTelemetry = nullptr;
+    Cell mBatteryData,mYeldData,mInverterData,mGridData,mFrontData,mRearData;
+    Sparkline *mBatteryTrend,*mInverterTrend,*mGridTrend,*mFrontTrend,*mRearTrend;
+
+    bool GetNewValue(Cell& pCell,TelemetryStore::Snapshot& rValue)const;
+    static Sparkline* AttachTrend(eui::ElementPtr pCell);
 
 
 };
@@ -1,15 +1,32 @@
 
 #include "DisplayTideData.h"
-#include "TinyJson.h"
-#include "FileDownload.h"
+#include "JsonPath.h"
+#include "JsonDocument.h"
+#include "ISOTime.h"
+#include "Sparkline.h"
 #include "style.h"
 
 #include <time.h>
+#include <iostream>
 #include <chrono>
-#include <sstream>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <algorithm>
+#include <cstdlib>
 
-DisplayTideData::DisplayTideData(int pFont)
+DisplayTideData::DisplayTideData(int pFont,FetchEngine& pFetch,const std::string& pStationFile,const std::string& pConstantsFile,const std::string& pEventsFile):
+    mFetch(pFetch),
+    mStationFile(pStationFile),
+    mEventsFile(pEventsFile)
 {
+    LoadStationID();
+    if( mPredictor.Load(pConstantsFile) )
+    {
+        mPredictor.Build(std::time(nullptr),mEventsFile);
+    }
+
     SetGrid(3,1);
 
     eui::Style timeStyle;
@@ -37,123 +54,330 @@ DisplayTideData::DisplayTideData(int pFont)
 
     mLowTide->SetText("Loading...");
 
-    mTideUpdater.Tick(60*60,[this]()
-    {// Fetch once an hour
-        try
+    // The height now with the curve for the next day under it, only when we can predict it.
+    if( mPredictor.GetOK() )
+    {
+        mHeight = new eui::Element;
+            mHeight->GetStyle().mAlignment = eui::ALIGN_CENTER_CENTER;
+            mHeight->GetStyle().mFont = (pFont);
+            mHeight->SetStyle(timeStyle);
+            mHeight->SetPadding(CELL_PADDING);
+            mHeight->SetPos(2,0);
+        this->Attach(mHeight);
+
+        mCurveLine = new Sparkline;
+            mCurveLine->SetHistory(&mCurve);
+        mHeight->Attach(mCurveLine);
+    }
+}
+
+DisplayTideData::~DisplayTideData()
+{
+    // The completions capture this, make sure none of them are called after we've gone.
+    mFetch.Stop(mStop);
+}
+    
+bool DisplayTideData::OnUpdate(const eui::Rectangle& pContentRect)
+{
+    if( mPredictor.GetOK() )
+    {
+        const int64_t now = std::time(nullptr);
+        if( mPredictor.GetCovers(now) == false )
+        {// A week or less left, or the clock has jumped.
+            mPredictor.Build(now,mEventsFile);
+            mShownUntil = 0;
+            mCurveUntil = 0;
+        }
+
+        if( now >= mShownUntil )
+        {
+            ShowPredicted(now);
+        }
+
+        if( now >= mCurveUntil )
+        {
+            ShowCurve(now);
+        }
+    }
+
+    // Fetch once an hour, or less often if it keeps failing. The station list only if we don't know our station.
+    if( mPolicy.TryBegin(std::time(nullptr)) )
+    {
+        if( mStationID.size() > 0 )
+        {
+            FetchPredictions(mStationID);
+        }
+        else
+        {
+            FetchStations();
+        }
+    }
+
+    return true;
+}
+
+void DisplayTideData::FetchStations()
+{
+    FetchEngine::Request request;
+    request.url = "https://easytide.admiralty.co.uk/Home/GetStations";
+    request.who = "DisplayTideData";
+    request.priority = FetchEngine::PRIORITY_LOW;
+    request.cacheSeconds = 7*24*60*60; // The stations hardly ever change.
+    request.parsedHash = mStationsHash;
+    request.stop = mStop;
+
+    // It's a big file, so it is streamed and only the fields we need are pulled out, on the fetch thread.
+    auto stationID = std::make_shared<std::string>();
+    request.stream = std::make_shared<JsonPath>("features[*].properties.{Name,Country,Id}",[stationID](const std::vector<std::string>& pValues)
+    {
+        if( stationID->size() == 0 && pValues[0] == "Ryde" && pValues[1] == "England" )
+        {
+            *stationID = pValues[2];
+        }
+        return true;// Read it all so the cache gets the whole list.
+    });
+
+    request.onComplete = [this,stationID](const FetchEngine::Result& pResult)
+    {
+        if( pResult.ok && (pResult.unchanged || stationID->size() > 0) )
+        {
+            if( pResult.unchanged == false )
+            {
+                mStationID = *stationID;
+                mStationsHash = pResult.bodyHash;
+                SaveStationID();
+            }
+
+            // Now download the tide data for that station
+            FetchPredictions(mStationID);
+        }
+        else
         {
-            std::string stationJson;
-            if( DownloadTideData("https://easytide.admiralty.co.uk/Home/GetStations",stationJson) )
+            mPolicy.OnFailure(std::time(nullptr));
+        }
+    };
+
+    mFetch.Submit(request);
+}
+
+void DisplayTideData::FetchPredictions(const std::string& pStationID)
+{
+    FetchEngine::Request request;
+    request.url = "https://easytide.admiralty.co.uk/Home/GetPredictionData?stationId=" + pStationID;
+    request.who = "DisplayTideData";
+    request.cacheSeconds = 6*60*60; // Covers days ahead, we pick the next events from it each time.
+    request.stop = mStop;
+
+    auto times = std::make_shared<TideTimes>();
+    request.parse = [times](const std::string& pBody)
+    {
+        JsonDocument tideData;
+        if( tideData.Parse(pBody) == false )
+        {
+            std::cerr << "Failed to parse tide predictions, " << tideData.GetError() << "\n";
+            return false;
+        }
+
+        // The times are local with no zone. The offset is looked up once, and again only for events after the clocks change.
+        const std::time_t now = std::time(nullptr);
+        int32_t utcOffset = isotime::GetUTCOffset(now);
+        std::time_t offsetUntil = isotime::GetNextOffsetChange(now,now + TIDE_OFFSET_LOOKAHEAD);
+
+        // Find the next tide events.
+        for( const JsonNode& event : tideData.GetRoot()["tidalEventList"] )
+        {
+            const std::string_view timeString = event["dateTime"].GetString();
+            int64_t eventTime;
+            bool parsed = isotime::Parse(timeString,eventTime,utcOffset);
+            if( parsed && eventTime >= offsetUntil )
+            {
+                utcOffset = isotime::GetUTCOffset(eventTime);
+                offsetUntil = isotime::GetNextOffsetChange(eventTime,eventTime + TIDE_OFFSET_LOOKAHEAD);
+                parsed = isotime::Parse(timeString,eventTime,utcOffset);
+            }
+
+            if( parsed == false )
+            {
+                std::cerr << "Failed to parse event time " << timeString << "\n";
+            }
+            else if( eventTime > now )
             {
-                // We got it, now we need to build the weather object from the json.
-                // I would have used rapid json but that is a lot of files to add to this project.
-                // My intention is for someone to beable to drop these two files into their project and continue.
-                // And so I will make my own json reader, it's easy but not the best solution.
-                tinyjson::JsonProcessor stationData(stationJson);
-                const tinyjson::JsonValue stationDataRoot = stationData.GetRoot();
-                const tinyjson::JsonValue features = stationDataRoot["features"];
-
-                // Find our station ID
-                std::string stationID;
-                for( auto f : features.mArray)
+                times->events.push_back({eventTime,0.0f,event["eventType"].GetInt() == 0});
+                if( times->gotHighTide == false && event["eventType"].GetInt() == 0 )
                 {
-                    if( f["properties"]["Name"].GetString() == "Ryde" &&
-                        f["properties"]["Country"].GetString() == "England" )
-                    {
-                        stationID = f["properties"]["Id"].GetString();
-                        break;
-                    }
+                    times->highTide = eventTime;
+                    times->highTideOffset = utcOffset;
+                    std::cout << "Event time " << timeString << " -> high tide\n";
+                    times->gotHighTide = true;
                 }
-
-                if( stationID.size() > 0 )
+                else if( times->gotLowTide == false && event["eventType"].GetInt() == 1 )
                 {
-                    // Now download the tide data for that station
-                    std::string tideJson;
-                    if( DownloadTideData("https://easytide.admiralty.co.uk/Home/GetPredictionData?stationId=" + stationID,tideJson) )
-                    {
-                        // We got it, now we need to build the weather object from the json.
-                        // I would have used rapid json but that is a lot of files to add to this project.
-                        // My intention is for someone to beable to drop these two files into their project and continue.
-                        // And so I will make my own json reader, it's easy but not the best solution.
-                        tinyjson::JsonProcessor tideData(tideJson);
-                        const tinyjson::JsonValue tideDataRoot = tideData.GetRoot();
-
-                        const tinyjson::JsonValue tidalEventList = tideDataRoot["tidalEventList"];
-
-                        std::time_t result = std::time(nullptr);
-                        tm *currentTime = localtime(&result);
-
-                        bool gotHightTide = false;
-                        bool gotLowTide = false;
-                        tm highTide;
-                        tm lowTide;
-                        // Find the next tide events.
-                        for( auto event : tidalEventList.mArray)
-                        {
-                            const std::string timeString = event["dateTime"].GetString();
-                            std::istringstream time(timeString);
-                            tm eventTime;
-                            time >> std::get_time(&eventTime, "%Y-%m-%dT%H:%M:%S");
-                            if (time.fail())
-                            {
-                                std::cerr << "Failed to parse event time\n";
-                            }
-                            else if( difftime(std::mktime(&eventTime),std::mktime(currentTime)) > 0 )
-                            {
-                                if( gotHightTide == false && event["eventType"].GetInt() == 0 )
-                                {
-                                    highTide = eventTime;
-                                    std::cout << "Event time " << timeString << " -> " << std::put_time(&eventTime, "%c") << "\n";
-                                    gotHightTide = true;
-                                    mHighTide->SetTextF("HIGH: %02d:%02d",eventTime.tm_hour,eventTime.tm_min);
-                                }
-                                else if( gotLowTide == false && event["eventType"].GetInt() == 1 )
-                                {
-                                    lowTide = eventTime;
-                                    std::cout << "Event time " << timeString << " -> " << std::put_time(&eventTime, "%c") << "\n";
-                                    gotLowTide = true;
-                                    mLowTide->SetTextF("LOW: %02d:%02d",eventTime.tm_hour,eventTime.tm_min);
-                                }
-                            }
-
-                            if( difftime(std::mktime(&lowTide),std::mktime(&highTide)) < 0 )
-                            {
-                                mLowTide->SetPos(0,0);
-                                mHighTide->SetPos(1,0);
-                            }
-                            else
-                            {
-                                mHighTide->SetPos(0,0);
-                                mLowTide->SetPos(1,0);
-                            }
-                        }
-                    }
+                    times->lowTide = eventTime;
+                    times->lowTideOffset = utcOffset;
+                    std::cout << "Event time " << timeString << " -> low tide\n";
+                    times->gotLowTide = true;
                 }
             }
         }
-        catch(std::runtime_error &e)
+        return times->gotHighTide || times->gotLowTide;
+    };
+
+    request.onComplete = [this,times](const FetchEngine::Result& pResult)
+    {
+        if( pResult.ok && mPredictor.GetOK() )
+        {// Only needed to check our predictions, once a day is plenty.
+            UpdateCorrection(*times);
+            mPolicy.OnSuccess(std::time(nullptr) + (24*60*60));
+        }
+        else if( pResult.ok )
         {
-            std::cerr << "Failed to download UK bitcoin price: " << e.what() << "\n";
+            ShowTideTimes(*times);
+            mPolicy.OnSuccess(std::time(nullptr) + (60*60));
         }
-    });
+        else
+        {
+            if( (pResult.httpCode >= 400 && pResult.httpCode <= 499) || (pResult.httpCode == 200 && pResult.error.size() > 0) )
+            {// The server does not know the station or had nothing for it, look it up again.
+                std::cerr << "DisplayTideData, station " << mStationID << " rejected, will look it up again\n";
+                mStationID.clear();
+                mStationsHash = 0;
+                SaveStationID();
+            }
+            mPolicy.OnFailure(std::time(nullptr));
+        }
+    };
+
+    mFetch.Submit(request);
 }
 
-DisplayTideData::~DisplayTideData()
+void DisplayTideData::ShowTideTimes(const TideTimes& pTimes)
 {
-    mTideUpdater.TellThreadToExitAndWait();
+    tm eventTime;
+    if( pTimes.gotHighTide )
+    {
+        isotime::ToTM(pTimes.highTide,pTimes.highTideOffset,eventTime);
+        mHighTide->SetTextF("HIGH: %02d:%02d",eventTime.tm_hour,eventTime.tm_min);
+    }
+
+    if( pTimes.gotLowTide )
+    {
+        isotime::ToTM(pTimes.lowTide,pTimes.lowTideOffset,eventTime);
+        mLowTide->SetTextF("LOW: %02d:%02d",eventTime.tm_hour,eventTime.tm_min);
+    }
+
+    if( pTimes.gotHighTide && pTimes.gotLowTide && pTimes.lowTide < pTimes.highTide )
+    {
+        mLowTide->SetPos(0,0);
+        mHighTide->SetPos(1,0);
+    }
+    else
+    {
+        mHighTide->SetPos(0,0);
+        mLowTide->SetPos(1,0);
+    }
 }
-    
-bool DisplayTideData::OnUpdate(const eui::Rectangle& pContentRect)
+
+void DisplayTideData::ShowPredicted(int64_t pNow)
+{
+    TideTimes times;
+
+    // Ask for the ones after now less the correction, so a tide is shown until its corrected time.
+    TidePredictor::Event event;
+    if( mPredictor.GetNextEvent(pNow - mCorrection,true,event) )
+    {
+        times.gotHighTide = true;
+        times.highTide = event.when + mCorrection;
+        times.highTideOffset = isotime::GetUTCOffset(times.highTide);
+    }
+
+    if( mPredictor.GetNextEvent(pNow - mCorrection,false,event) )
+    {
+        times.gotLowTide = true;
+        times.lowTide = event.when + mCorrection;
+        times.lowTideOffset = isotime::GetUTCOffset(times.lowTide);
+    }
+
+    ShowTideTimes(times);
+
+    // Nothing changes until one of them has gone.
+    mShownUntil = pNow + (60*60);
+    if( times.gotHighTide )
+        mShownUntil = std::min(mShownUntil,times.highTide + 1);
+    if( times.gotLowTide )
+        mShownUntil = std::min(mShownUntil,times.lowTide + 1);
+}
+
+void DisplayTideData::ShowCurve(int64_t pNow)
 {
-    if( mPortsmouthEngland > 0 )
+    mHeight->SetTextF("%.1fm",mPredictor.GetHeight(pNow - mCorrection));
+
+    // The whole curve each time, the history holds just the one.
+    const int64_t step = (TIDE_CURVE_HOURS * 60 * 60) / TIDE_CURVE_SAMPLES;
+    for( int64_t n = 0 ; n < TIDE_CURVE_SAMPLES ; n++ )
     {
+        mCurve.Add((float)mPredictor.GetHeight(pNow - mCorrection + (n * step)));
+    }
+    mCurveUntil = pNow + TIDE_CURVE_UPDATE;
+}
+
+void DisplayTideData::UpdateCorrection(const TideTimes& pTimes)
+{
+    // Each of the server's tides against our nearest prediction of the same kind, the mean difference is how far out we are.
+    int64_t total = 0;
+    int64_t count = 0;
+    for( const TidePredictor::Event& e : pTimes.events )
+    {
+        TidePredictor::Event predicted;
+        if( mPredictor.GetNextEvent(e.when - TIDE_MATCH_WINDOW,e.high,predicted) && std::llabs(predicted.when - e.when) < TIDE_MATCH_WINDOW )
+        {
+            total += e.when - predicted.when;
+            count++;
+        }
+    }
 
+    if( count == 0 )
+    {
+        std::cerr << "DisplayTideData, none of the server's " << pTimes.events.size() << " tides match the predictions, check the harmonic constants\n";
+        return;
     }
 
-    return true;
+    mCorrection = total / count;
+    mShownUntil = 0;
+    mCurveUntil = 0;
+    std::clog << "DisplayTideData, predictions are " << mCorrection << " seconds out over " << count << " tides\n";
 }
 
-bool DisplayTideData::DownloadTideData(const std::string& pURL,std::string& rJson)const
+void DisplayTideData::LoadStationID()
 {
-    rJson = DownloadJson(pURL,"DisplayTideData");
-    return rJson.size() > 2;
+    FILE* file = fopen(mStationFile.c_str(),"r");
+    if( file == nullptr )
+        return;
+
+    char line[64];
+    if( fgets(line,sizeof(line),file) )
+    {
+        line[strcspn(line,"\r\n")] = 0;
+        mStationID = line;
+    }
+    fclose(file);
+}
+
+void DisplayTideData::SaveStationID()
+{
+    std::error_code ec;
+    if( mStationID.size() == 0 )
+    {
+        std::filesystem::remove(mStationFile,ec);
+        return;
+    }
+
+    std::filesystem::create_directories(std::filesystem::path(mStationFile).parent_path(),ec);
+    FILE* file = fopen(mStationFile.c_str(),"w");
+    if( file == nullptr )
+    {
+        std::cerr << "DisplayTideData failed to save the station id to " << mStationFile << " " << strerror(errno) << "\n";
+        return;
+    }
+    fprintf(file,"%s\n",mStationID.c_str());
+    fclose(file);
 }
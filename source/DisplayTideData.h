@@ -3,26 +3,77 @@
 
 #include "Graphics.h"
 #include "Element.h"
-#include "TinyTools.h"
+#include "FetchEngine.h"
+#include "FetchPolicy.h"
+#include "TidePredictor.h"
+#include "SensorHistory.h"
+
+#include <ctime>
+#include <vector>
+
+#define TIDE_CURVE_HOURS        24          // How far ahead the curve shows.
+#define TIDE_CURVE_UPDATE       (10 * 60)   // Seconds between redrawing the curve and height.
+#define TIDE_CURVE_SAMPLES      4096        // The smallest SensorHistory, the whole curve is added again each time.
+#define TIDE_MATCH_WINDOW       (3 * 60 * 60) // Seconds, a server event this close to a prediction of the same kind is the same tide.
+#define TIDE_OFFSET_LOOKAHEAD   (8 * 24 * 60 * 60) // Seconds, longer than the server's list of events, how far to look for a clock change.
+
+class Sparkline;
 
 class DisplayTideData : public eui::Element
 {
 public:
-    DisplayTideData(int pFont);
+    /**
+     * @param pStationFile Where the station ID is kept, so the station list is only fetched when it is not known.
+     * @param pConstantsFile The station's harmonic constants, see TidePredictor. If it can be read the times are
+     * predicted here and the server is only asked once a day to correct them, if not they come from the server every hour.
+     * @param pEventsFile Where the predicted high and low waters are saved between restarts.
+     */
+    DisplayTideData(int pFont,FetchEngine& pFetch,const std::string& pStationFile,const std::string& pConstantsFile,const std::string& pEventsFile);
     ~DisplayTideData();
     
     virtual bool OnUpdate(const eui::Rectangle& pContentRect);
+    const FetchPolicy& GetFetchPolicy()const{return mPolicy;}
 
 private:
+    struct TideTimes
+    {
+        bool gotHighTide = false;
+        bool gotLowTide = false;
+        int64_t highTide = 0;   //!< Epoch seconds.
+        int64_t lowTide = 0;
+        int32_t highTideOffset = 0; //!< Local time at each, for showing them. They can be either side of a clock change.
+        int32_t lowTideOffset = 0;
+        std::vector<TidePredictor::Event> events;  //!< All the server's future events, to correct the predictions with.
+    };
+
     bool mLoaded = false;
-    uint32_t mPortsmouthEngland = 0;
-    tinytools::threading::SleepableThread  mTideUpdater;
+    FetchEngine& mFetch;
+    FetchPolicy mPolicy{"DisplayTideData"};
+    FetchEngine::StopToken mStop = FetchEngine::MakeStopToken();
+    const std::string mStationFile;
+    std::string mStationID;         //!< Found in the station list and saved, empty if not known or the server rejected it.
+    uint64_t mStationsHash = 0;     //!< Of the station list mStationID was found in.
     bool mLowTideFirst = false;
     eui::ElementPtr mHighTide = nullptr;
     eui::ElementPtr mLowTide = nullptr;
 
+    TidePredictor mPredictor;
+    const std::string mEventsFile;
+    int64_t mCorrection = 0;        //!< Seconds added to the predictions, the server's times less ours.
+    int64_t mShownUntil = 0;        //!< When the next predicted tide shown has gone.
+    int64_t mCurveUntil = 0;
+    SensorHistory mCurve{TIDE_CURVE_SAMPLES};
+    eui::ElementPtr mHeight = nullptr;
+    Sparkline* mCurveLine = nullptr;
 
-    bool DownloadTideData(const std::string& pURL,std::string& rJson)const;
+    void LoadStationID();
+    void SaveStationID();
+    void FetchStations();
+    void FetchPredictions(const std::string& pStationID);
+    void ShowTideTimes(const TideTimes& pTimes);
+    void ShowPredicted(int64_t pNow);
+    void ShowCurve(int64_t pNow);
+    void UpdateCorrection(const TideTimes& pTimes);
 };
 
 #endif //#ifndef DisplayTideData_h
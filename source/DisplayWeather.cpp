@@ -17,6 +17,7 @@
 #include "TinyJson.h"
 #include "TinyTools.h"
 #include "DisplayWeather.h"
+#include "ISOTime.h"
 #include "style.h"
 
 #include <ctime>
@@ -142,7 +143,8 @@ public:
 
 };
 
-DisplayWeather::DisplayWeather(eui::Graphics* graphics,const std::string& pPath,int pBigFont,int pNormalFont,int pMiniFont) :
+DisplayWeather::DisplayWeather(eui::Graphics* graphics,const std::string& pPath,const WeatherLocations& pLocations,int pBigFont,int pNormalFont,int pMiniFont) :
+    mLocations(pLocations),
     mFirstFail(true),
     mHourlyUpdates(0)
 {
@@ -171,6 +173,12 @@ bool DisplayWeather::OnUpdate(const eui::Rectangle& pContentRect)
 {
     std::time_t currentTime = std::time(nullptr);
 
+    if( mLocations.GetCount() > 1 && currentTime >= mNextLocation )
+    {
+        SetLocation((mLocation + 1) % mLocations.GetCount());
+        mNextLocation = currentTime + WEATHER_LOCATION_SECONDS;
+    }
+
     // Rebuild the Next Hourly Icons vector so its always correct an hour after the last time.
     if( mHourlyUpdates < currentTime )
     {
@@ -178,15 +186,22 @@ bool DisplayWeather::OnUpdate(const eui::Rectangle& pContentRect)
 
         try
         {
+            const ForecastStore& forcast = mLocations.GetForcast(mLocation);
             std::time_t t = currentTime;
             for( int n = 0 ; n < 4 ; n++, t += (60*60) )
             {
-                openmeteo::Hourly Hourly;
-                if( DisplayWeather::GetForcast(t,Hourly) )
+                size_t i;
+                if( forcast.GetIndex(t,i) )
                 {
-                    const std::string hour = CTimeToString(Hourly.ctime);
-                    const uint32_t icon = GetIcon(Hourly.icon_code);
-                    icons[n]->SetInfo(icon,hour,Hourly.temperature_2m,Hourly.is_day);
+                    tm hourTM;
+                    isotime::ToTM(forcast.GetTime(i),0,hourTM);
+                    std::string hour = CTimeToString(hourTM);
+                    if( n == 0 && mLocations.GetCount() > 1 )
+                    {// So you know which place it is.
+                        hour = mLocations.GetLocation(mLocation).name + " " + hour;
+                    }
+                    const uint32_t icon = GetIcon(forcast.GetIconCode(i));
+                    icons[n]->SetInfo(icon,hour,forcast.GetTemperature(i),forcast.GetIsDay(i));
                 }
                 else
                 {
@@ -213,6 +228,30 @@ bool DisplayWeather::OnUpdate(const eui::Rectangle& pContentRect)
     return true;
 }
 
+void DisplayWeather::OnForcastChanged(size_t pLocation,std::time_t pFirst,std::time_t pLast)
+{
+    if( pLocation != mLocation )
+        return;
+
+    // The icons show the four hours from the start of this one.
+    const std::time_t now = std::time(nullptr);
+    const std::time_t firstShown = now - (now % ONE_HOUR);
+    const std::time_t lastShown = firstShown + (3 * ONE_HOUR);
+    if( pFirst <= lastShown && pLast >= firstShown )
+    {
+        mHourlyUpdates = 0;
+    }
+}
+
+void DisplayWeather::SetLocation(size_t pLocation)
+{
+    if( pLocation != mLocation && pLocation < mLocations.GetCount() )
+    {
+        mLocation = pLocation;
+        mHourlyUpdates = 0;
+    }
+}
+
 void DisplayWeather::LoadWeatherIcons(eui::Graphics* graphics,const std::string& pPath)
 {
     for( std::string f : iconFiles )
@@ -229,21 +268,3 @@ uint32_t DisplayWeather::GetIcon(const std::string &pIconCode)
 
     return WeatherIcons["not-found"];
 }
-
-bool DisplayWeather::GetForcast(std::time_t theTime,openmeteo::Hourly& found)const
-{
-    tm myTM = *gmtime(&theTime);
-
-    for( openmeteo::Hourly h : mForcast )
-	{
-		if( h.ctime.tm_mday == myTM.tm_mday &&
-			h.ctime.tm_mon == myTM.tm_mon &&
-			h.ctime.tm_year == myTM.tm_year &&
-			h.ctime.tm_hour == myTM.tm_hour)
-		{
-            found = h;
-			return true;
-		}
-	}
-    return false; 
-}
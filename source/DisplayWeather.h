@@ -25,33 +25,49 @@
 #include <map>
 
 #include <vector>
-#include "../OpenMeteoFetch/open-meteo.h"
+#include "WeatherLocations.h"
 
 const std::time_t ONE_MINUTE = (60);
 const std::time_t ONE_HOUR = (ONE_MINUTE * 60);
 const std::time_t ONE_DAY = (ONE_HOUR*24);
 
+#define WEATHER_LOCATION_SECONDS 15 // How long each location is shown for when there's more than one.
+
 class WeatherIcon;
 
 class DisplayWeather : public eui::Element
 {
 public:
 
-    DisplayWeather(eui::Graphics* graphics,const std::string& pPath,int pBigFont,int pNormalFont,int pMiniFont);
+    /**
+     * @brief The forecasts are read in place every time the icons are rebuilt, pLocations must out live this.
+     * With more than one location each is shown in turn, switching never fetches anything.
+     */
+    DisplayWeather(eui::Graphics* graphics,const std::string& pPath,const WeatherLocations& pLocations,int pBigFont,int pNormalFont,int pMiniFont);
     ~DisplayWeather();
 
     virtual bool OnUpdate(const eui::Rectangle& pContentRect);    
-    void OnNewForcast(const std::vector<openmeteo::Hourly>& pForcast)
+    void OnNewForcast(size_t pLocation)
     {
-        mForcast = pForcast;
+        if( pLocation == mLocation )
+            mHourlyUpdates = 0;
     }
 
+    /**
+     * @brief Some hours, from pFirst to pLast, were refreshed. The icons are only rebuilt if they show one of them.
+     */
+    void OnForcastChanged(size_t pLocation,std::time_t pFirst,std::time_t pLast);
+
+    void SetLocation(size_t pLocation);//!< Shows that location's forecast from the next update.
+
 private:
     WeatherIcon* icons[4];
     int tick = 0;
     float anim = 0;
 
-    std::vector<openmeteo::Hourly>mForcast;
+    const WeatherLocations& mLocations;
+    size_t mLocation = 0;
+    std::time_t mNextLocation = 0;  //!< When to move on to the next location.
 
     std::map<std::string,uint32_t>WeatherIcons;
 
@@ -85,7 +101,6 @@ private:
 
     void LoadWeatherIcons(eui::Graphics* graphics,const std::string& pPath);
     uint32_t GetIcon(const std::string &pIconCode);
-    bool GetForcast(std::time_t theTime,openmeteo::Hourly& found)const;
 };
 
 #endif //#ifndef DISPLAY_WEATHER_H
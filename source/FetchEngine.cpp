@@ -0,0 +1,665 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "FetchEngine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <cstring>
+#include <strings.h>
+#include <string_view>
+#include <ctime>
+
+FetchEngine::FetchEngine(const std::string& pCacheFolder)
+{
+    if( pCacheFolder.size() > 0 )
+    {
+        mCache = new HTTPCache(pCacheFolder);
+    }
+
+    mShare = curl_share_init();
+    curl_share_setopt(mShare,CURLSHOPT_LOCKFUNC,ShareLock);
+    curl_share_setopt(mShare,CURLSHOPT_UNLOCKFUNC,ShareUnlock);
+    curl_share_setopt(mShare,CURLSHOPT_USERDATA,this);
+    curl_share_setopt(mShare,CURLSHOPT_SHARE,CURL_LOCK_DATA_DNS);
+    curl_share_setopt(mShare,CURLSHOPT_SHARE,CURL_LOCK_DATA_SSL_SESSION);
+
+    // The multi handle keeps the connections, sharing them too would be a second cache MAXCONNECTS does not limit.
+    mMulti = curl_multi_init();
+    curl_multi_setopt(mMulti,CURLMOPT_MAXCONNECTS,(long)(FETCH_MAX_TRANSFERS * 2));
+    mIdleHandles.reserve(FETCH_MAX_TRANSFERS);
+    mQueue.reserve(32);
+    mCompleted.reserve(32);
+    mDelivering.reserve(32);
+    mActive.reserve(FETCH_MAX_TRANSFERS);
+    mWorker = std::thread([this](){WorkerLoop();});
+}
+
+FetchEngine::~FetchEngine()
+{
+    const int64_t start = GetTimeMS();
+    mRunning = false;// Every transfer is now stopped, the progress callbacks abort them.
+    curl_multi_wakeup(mMulti);
+    if( mWorker.joinable() )
+    {
+        mWorker.join();
+    }
+
+    for( Transfer* t : mActive )
+    {
+        curl_multi_remove_handle(mMulti,t->curl);
+        curl_easy_cleanup(t->curl);
+        curl_slist_free_all(t->headers);
+        delete t;
+    }
+
+    for( Transfer* t : mQueue )
+        delete t;
+
+    for( Transfer* t : mCompleted )
+        delete t;
+
+    for( CURL* c : mIdleHandles )
+        curl_easy_cleanup(c);
+
+    curl_multi_cleanup(mMulti);
+    curl_share_cleanup(mShare);
+    delete mCache;
+
+    const int64_t took = GetTimeMS() - start;
+    if( took > FETCH_SHUTDOWN_BUDGET_MS )
+    {
+        std::cerr << "FetchEngine took " << took << "ms to shut down\n";
+    }
+}
+
+uint32_t FetchEngine::Submit(Request pRequest)
+{
+    Transfer* transfer = new Transfer;
+    transfer->submitted = GetTimeMS();
+    transfer->running = &mRunning;
+    transfer->result.url = pRequest.url;
+    transfer->result.who = pRequest.who;
+    transfer->request = std::move(pRequest);
+    if( transfer->request.stream )
+    {
+        transfer->stream = std::make_unique<JsonStream>(*transfer->request.stream);
+    }
+
+    uint32_t id;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        id = mNextID++;
+        transfer->result.id = id;
+        transfer->order = mNextOrder++;
+        mQueue.push_back(transfer);
+    }
+    mPendingCount++;
+
+    curl_multi_wakeup(mMulti);
+    return id;
+}
+
+void FetchEngine::Tick()
+{
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if( mCompleted.size() == 0 )
+            return;
+        std::swap(mCompleted,mDelivering);
+    }
+
+    for( Transfer* t : mDelivering )
+    {
+        mPendingCount--;
+        if( t->request.onComplete && t->GetStopped() == false )
+        {
+            t->request.onComplete(t->result);
+        }
+        delete t;
+    }
+    mDelivering.clear();
+}
+
+void FetchEngine::Stop(const StopToken& pToken)
+{
+    if( pToken )
+    {
+        *pToken = true;
+        curl_multi_wakeup(mMulti);// So the worker drops them now, not after the next socket event.
+    }
+}
+
+void FetchEngine::WorkerLoop()
+{
+    while( mRunning )
+    {
+        CancelStopped();
+        StartQueued();
+
+        int running = 0;
+        curl_multi_perform(mMulti,&running);
+
+        bool finished = false;
+        int remaining = 0;
+        for( CURLMsg* msg = curl_multi_info_read(mMulti,&remaining) ; msg != nullptr ; msg = curl_multi_info_read(mMulti,&remaining) )
+        {
+            if( msg->msg == CURLMSG_DONE )
+            {
+                FinishTransfer(msg->easy_handle,msg->data.result);
+                finished = true;
+            }
+        }
+
+        if( finished == false )
+        {// Sleeps until there is socket activity, a new request or a second has passed.
+            curl_multi_poll(mMulti,nullptr,0,1000,nullptr);
+        }
+    }
+}
+
+void FetchEngine::StartQueued()
+{
+    while( mActive.size() < FETCH_MAX_TRANSFERS )
+    {
+        Transfer* transfer = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if( mQueue.size() == 0 )
+                return;
+
+            // Highest priority, then oldest. The queue is short so a scan is fine.
+            auto next = std::min_element(mQueue.begin(),mQueue.end(),[](const Transfer* a,const Transfer* b)
+            {
+                if( a->request.priority != b->request.priority )
+                    return a->request.priority > b->request.priority;
+                return a->order < b->order;
+            });
+
+            transfer = *next;
+            mQueue.erase(next);
+        }
+
+        if( transfer->GetStopped() )
+        {
+            Complete(transfer,CURLE_ABORTED_BY_CALLBACK);
+        }
+        else if( GetFreshFromCache(transfer) )
+        {
+            Complete(transfer,CURLE_OK);
+        }
+        else if( StartTransfer(transfer) )
+        {
+            mActive.push_back(transfer);
+        }
+        else
+        {
+            Complete(transfer,CURLE_FAILED_INIT);
+        }
+    }
+}
+
+void FetchEngine::CancelStopped()
+{
+    for( size_t n = 0 ; n < mActive.size() ; )
+    {
+        if( mActive[n]->GetStopped() )
+        {
+            FinishTransfer(mActive[n]->curl,CURLE_ABORTED_BY_CALLBACK);// Removes it from mActive.
+        }
+        else
+        {
+            n++;
+        }
+    }
+}
+
+bool FetchEngine::GetFreshFromCache(Transfer* pTransfer)
+{
+    if( mCache == nullptr || pTransfer->request.cacheSeconds == 0 )
+        return false;
+
+    // A streamed body is read from the file when it is parsed, so only the header is needed here.
+    pTransfer->haveCached = mCache->Load(pTransfer->request.url,pTransfer->cached,pTransfer->stream == nullptr);
+    if( pTransfer->haveCached == false || pTransfer->cached.expires <= (int64_t)std::time(nullptr) )
+        return false;// Missing or stale, if stale we'll revalidate it.
+
+    Result& result = pTransfer->result;
+    result.body = std::move(pTransfer->cached.body);
+    result.bodyHash = pTransfer->cached.hash;
+    result.bodySize = pTransfer->cached.size;
+    result.httpCode = 200;
+    result.fromCache = true;
+    pTransfer->haveCached = false;
+    return true;
+}
+
+bool FetchEngine::StartTransfer(Transfer* pTransfer)
+{
+    pTransfer->errorBuffer[0] = 0;
+    if( mIdleHandles.size() > 0 )
+    {
+        pTransfer->curl = mIdleHandles.back();
+        mIdleHandles.pop_back();
+    }
+    else
+    {
+        pTransfer->curl = curl_easy_init();
+    }
+
+    if( pTransfer->curl == nullptr )
+    {
+        pTransfer->result.error = "curl_easy_init failed";
+        return false;
+    }
+
+    std::string url = pTransfer->request.url;
+    if( mHostOverride.size() > 0 )
+    {// Swap the scheme and host, keep the path and query.
+        const size_t scheme = url.find("://");
+        const size_t path = url.find('/',scheme == std::string::npos ? 0 : scheme + 3);
+        url = mHostOverride + (path == std::string::npos ? "/" : url.substr(path));
+    }
+
+    CURL* curl = pTransfer->curl;
+    curl_easy_setopt(curl,CURLOPT_URL,url.c_str());// curl keeps its own copy.
+    curl_easy_setopt(curl,CURLOPT_ERRORBUFFER,pTransfer->errorBuffer);
+    curl_easy_setopt(curl,CURLOPT_WRITEFUNCTION,CURLWriter);
+    curl_easy_setopt(curl,CURLOPT_WRITEDATA,pTransfer);
+    curl_easy_setopt(curl,CURLOPT_PRIVATE,pTransfer);
+    curl_easy_setopt(curl,CURLOPT_NOSIGNAL,1L);// We are not on the main thread, signals would go to the wrong place.
+    curl_easy_setopt(curl,CURLOPT_TIMEOUT_MS,(long)pTransfer->request.timeoutMS);
+    curl_easy_setopt(curl,CURLOPT_CONNECTTIMEOUT_MS,(long)std::min<uint32_t>(pTransfer->request.timeoutMS,FETCH_CONNECT_TIMEOUT_MS));
+    curl_easy_setopt(curl,CURLOPT_SHARE,mShare);
+    curl_easy_setopt(curl,CURLOPT_TCP_KEEPALIVE,1L);
+    curl_easy_setopt(curl,CURLOPT_TCP_KEEPIDLE,(long)FETCH_KEEP_ALIVE_SECONDS);
+    curl_easy_setopt(curl,CURLOPT_TCP_KEEPINTVL,(long)FETCH_KEEP_ALIVE_SECONDS);
+    curl_easy_setopt(curl,CURLOPT_ACCEPT_ENCODING,"");// Whatever curl was built with, the JSON compresses well.
+    curl_easy_setopt(curl,CURLOPT_LOW_SPEED_LIMIT,(long)FETCH_LOW_SPEED_LIMIT);
+    curl_easy_setopt(curl,CURLOPT_LOW_SPEED_TIME,(long)FETCH_LOW_SPEED_SECONDS);
+    curl_easy_setopt(curl,CURLOPT_XFERINFOFUNCTION,CURLProgress);
+    curl_easy_setopt(curl,CURLOPT_XFERINFODATA,pTransfer);
+    curl_easy_setopt(curl,CURLOPT_NOPROGRESS,0L);
+#if LIBCURL_VERSION_NUM >= 0x075700
+    curl_easy_setopt(curl,CURLOPT_QUICK_EXIT,1L);// Don't wait for a DNS lookup thread when a transfer is dropped.
+#endif
+
+    if( pTransfer->request.cacheSeconds > 0 )
+    {
+        curl_easy_setopt(curl,CURLOPT_HEADERFUNCTION,CURLHeader);
+        curl_easy_setopt(curl,CURLOPT_HEADERDATA,pTransfer);
+        if( pTransfer->stream )
+        {
+            pTransfer->cache = mCache;
+        }
+    }
+
+    if( pTransfer->haveCached && pTransfer->cached.GetCanRevalidate() )
+    {// Only send the body if it has changed.
+        if( pTransfer->cached.etag.size() > 0 )
+            pTransfer->headers = curl_slist_append(pTransfer->headers,("If-None-Match: " + pTransfer->cached.etag).c_str());
+
+        if( pTransfer->cached.lastModified.size() > 0 )
+            pTransfer->headers = curl_slist_append(pTransfer->headers,("If-Modified-Since: " + pTransfer->cached.lastModified).c_str());
+
+        curl_easy_setopt(curl,CURLOPT_HTTPHEADER,pTransfer->headers);
+    }
+
+    if( curl_multi_add_handle(mMulti,curl) != CURLM_OK )
+    {
+        pTransfer->result.error = "curl_multi_add_handle failed";
+        curl_easy_cleanup(curl);
+        pTransfer->curl = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void FetchEngine::FinishTransfer(CURL* pCurl,CURLcode pCode)
+{
+    Transfer* transfer = nullptr;
+    curl_easy_getinfo(pCurl,CURLINFO_PRIVATE,(char**)&transfer);
+    curl_easy_getinfo(pCurl,CURLINFO_RESPONSE_CODE,&transfer->result.httpCode);
+
+    ReadTiming(pCurl,transfer->result.timing);
+
+    // Keep the handle, resetting the options does not lose its caches.
+    curl_multi_remove_handle(mMulti,pCurl);
+    if( mIdleHandles.size() < FETCH_MAX_TRANSFERS )
+    {
+        curl_easy_reset(pCurl);
+        mIdleHandles.push_back(pCurl);
+    }
+    else
+    {
+        curl_easy_cleanup(pCurl);
+    }
+    transfer->curl = nullptr;
+    curl_slist_free_all(transfer->headers);
+    transfer->headers = nullptr;
+    mActive.erase(std::find(mActive.begin(),mActive.end(),transfer));
+
+    if( pCode == CURLE_OK )
+    {
+        if( transfer->stream )
+        {
+            transfer->result.bodyHash = transfer->streamHash;
+            transfer->result.bodySize = transfer->stream->GetBytesRead();
+        }
+        UpdateCache(transfer);
+    }
+    Complete(transfer,pCode);
+}
+
+void FetchEngine::UpdateCache(Transfer* pTransfer)
+{
+    if( mCache == nullptr || pTransfer->request.cacheSeconds == 0 )
+        return;
+
+    Result& result = pTransfer->result;
+    HTTPCache::Entry& entry = pTransfer->cached;
+    const int64_t expires = std::max<int64_t>(std::time(nullptr) + pTransfer->request.cacheSeconds,pTransfer->serverExpires);
+    if( result.httpCode == 304 && pTransfer->haveCached )
+    {// Not modified, what we have is good for a while longer.
+        result.body = std::move(entry.body);
+        result.bodyHash = entry.hash;
+        result.bodySize = entry.size;
+        result.httpCode = 200;
+        result.fromCache = true;
+        mCache->SetExpires(pTransfer->request.url,expires);
+    }
+    else if( pTransfer->stream )
+    {// Already written as it arrived.
+        if( pTransfer->cacheWriter && result.httpCode >= 200 && result.httpCode <= 299 )
+        {
+            pTransfer->cacheWriter->Commit();
+        }
+        pTransfer->cacheWriter.reset();
+    }
+    else if( result.httpCode >= 200 && result.httpCode <= 299 )
+    {
+        entry.etag = pTransfer->etag;
+        entry.lastModified = pTransfer->lastModified;
+        entry.expires = expires;
+        entry.body = result.body;
+        mCache->Store(pTransfer->request.url,entry);
+    }
+}
+
+bool FetchEngine::StreamFromCache(Transfer* pTransfer)
+{
+    HTTPCache::Entry entry;
+    FILE* file = mCache ? mCache->Open(pTransfer->request.url,entry) : nullptr;
+    if( file == nullptr )
+    {
+        pTransfer->result.error = "cache entry has gone";
+        return false;
+    }
+
+    char buffer[FETCH_STREAM_CHUNK_SIZE];
+    bool ok = true;
+    size_t read;
+    while( ok && pTransfer->GetStopped() == false && (read = fread(buffer,1,sizeof(buffer),file)) > 0 )
+    {
+        ok = pTransfer->stream->Feed(buffer,read);
+    }
+    fclose(file);
+
+    pTransfer->result.bodySize = pTransfer->stream->GetBytesRead();
+    return ok;
+}
+
+void FetchEngine::Complete(Transfer* pTransfer,CURLcode pCode)
+{
+    Result& result = pTransfer->result;
+    if( pTransfer->GetStopped() )
+    {// Nobody is waiting for it.
+        result.error = "cancelled";
+        std::clog << "Fetch, " << result.who << " , cancelled\n";
+        std::lock_guard<std::mutex> lock(mLock);
+        mCompleted.push_back(pTransfer);
+        return;
+    }
+
+    if( pCode != CURLE_OK )
+    {
+        if( result.error.size() == 0 )
+        {
+            result.error = pTransfer->errorBuffer[0] ? pTransfer->errorBuffer : curl_easy_strerror(pCode);
+        }
+    }
+    else if( result.httpCode < 200 || result.httpCode > 299 )
+    {
+        result.error = "HTTP " + std::to_string(result.httpCode);
+    }
+    else
+    {
+        if( pTransfer->stream == nullptr )
+        {
+            result.bodyHash = HTTPCache::Hash(result.body);
+            result.bodySize = result.body.size();
+        }
+
+        if( pTransfer->request.parsedHash != 0 && pTransfer->request.parsedHash == result.bodyHash )
+        {// The caller already has this parsed.
+            result.unchanged = true;
+            result.ok = true;
+        }
+        else if( pTransfer->stream )
+        {// A body from the network has been fed in already, one from the cache is read a chunk at a time now.
+            result.ok = (result.fromCache == false || StreamFromCache(pTransfer)) && pTransfer->stream->Finish();
+            if( result.ok == false && result.error.size() == 0 )
+            {
+                result.error = "parse failed, " + pTransfer->stream->GetError();
+            }
+        }
+        else if( pTransfer->request.parse )
+        {
+            try
+            {
+                result.ok = pTransfer->request.parse(result.body);
+                if( result.ok == false )
+                {
+                    result.error = "parse failed";
+                }
+            }
+            catch(std::exception &e)
+            {
+                result.error = std::string("parse failed, ") + e.what();
+            }
+        }
+        else
+        {
+            result.ok = true;
+        }
+    }
+
+    result.elapsedMS = GetTimeMS() - pTransfer->submitted;
+    if( result.ok == false )
+    {
+        std::cerr << "Fetch, " << result.who << " , failed, [" << result.error << "]\n";
+    }
+    else if( result.fromCache )
+    {
+        std::clog << "Fetch, " << result.who << " , " << result.bodySize << " bytes from the cache" << (result.unchanged ? ", unchanged\n" : "\n");
+    }
+    else
+    {
+        const Timing& t = result.timing;
+        std::clog << "Fetch, " << result.who << " , " << result.bodySize << " bytes"
+                  << " dns " << t.dns / 1000 << "ms connect " << t.connect / 1000 << "ms tls " << t.tls / 1000
+                  << "ms transfer " << t.transfer / 1000 << "ms" << (t.newConnection ? "\n" : " (reused connection)\n");
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mCompleted.push_back(pTransfer);
+}
+
+void FetchEngine::ReadTiming(CURL* pCurl,Timing& rTiming)
+{
+    // curl reports the time from the start to the end of each stage, turn them into the time spent in each.
+    curl_off_t dns = 0,connect = 0,tls = 0,start = 0,total = 0;
+    long connects = 0;
+    curl_easy_getinfo(pCurl,CURLINFO_NAMELOOKUP_TIME_T,&dns);
+    curl_easy_getinfo(pCurl,CURLINFO_CONNECT_TIME_T,&connect);
+    curl_easy_getinfo(pCurl,CURLINFO_APPCONNECT_TIME_T,&tls);
+    curl_easy_getinfo(pCurl,CURLINFO_PRETRANSFER_TIME_T,&start);
+    curl_easy_getinfo(pCurl,CURLINFO_TOTAL_TIME_T,&total);
+    curl_easy_getinfo(pCurl,CURLINFO_NUM_CONNECTS,&connects);
+
+    rTiming.dns = dns;
+    rTiming.connect = connect > dns ? connect - dns : 0;
+    rTiming.tls = tls > connect ? tls - connect : 0;// Zero for plain http.
+    rTiming.transfer = total > start ? total - start : 0;
+    rTiming.total = total;
+    rTiming.newConnection = connects > 0;
+
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    mStats.fetches++;
+    mStats.newConnections += (uint32_t)connects;
+    mStats.totals.dns += rTiming.dns;
+    mStats.totals.connect += rTiming.connect;
+    mStats.totals.tls += rTiming.tls;
+    mStats.totals.transfer += rTiming.transfer;
+    mStats.totals.total += rTiming.total;
+}
+
+FetchEngine::Stats FetchEngine::GetStats()const
+{
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    return mStats;
+}
+
+void FetchEngine::ShareLock(CURL* pCurl,curl_lock_data pData,curl_lock_access pAccess,void* pEngine)
+{
+    ((FetchEngine*)pEngine)->mShareLocks[pData].lock();
+}
+
+void FetchEngine::ShareUnlock(CURL* pCurl,curl_lock_data pData,void* pEngine)
+{
+    ((FetchEngine*)pEngine)->mShareLocks[pData].unlock();
+}
+
+size_t FetchEngine::CURLWriter(char* pData,size_t pSize,size_t pCount,void* pTransfer)
+{
+    Transfer* transfer = (Transfer*)pTransfer;
+    const size_t size = pSize * pCount;
+    if( transfer->GetStopped() )
+        return 0;
+
+    if( transfer->stream == nullptr )
+    {
+        transfer->result.body.append(pData,size);
+        return size;
+    }
+
+    // Only a 2xx body is parsed, anything else is an error page that Complete reports by its code.
+    long code = 0;
+    curl_easy_getinfo(transfer->curl,CURLINFO_RESPONSE_CODE,&code);
+    if( code < 200 || code > 299 )
+        return size;
+
+    if( transfer->cache && transfer->stream->GetBytesRead() == 0 )
+    {// The headers are all in by now, so the validators are known.
+        HTTPCache::Entry entry;
+        entry.etag = transfer->etag;
+        entry.lastModified = transfer->lastModified;
+        entry.expires = std::max<int64_t>(std::time(nullptr) + transfer->request.cacheSeconds,transfer->serverExpires);
+        transfer->cacheWriter = std::make_unique<HTTPCache::Writer>(*transfer->cache,transfer->request.url,entry);
+    }
+
+    if( transfer->cacheWriter && transfer->cacheWriter->Write(pData,size) == false )
+    {// Carry on without caching it, the old entry is left as it was.
+        transfer->cacheWriter.reset();
+        transfer->cache = nullptr;
+    }
+
+    transfer->streamHash = HTTPCache::Hash(pData,size,transfer->streamHash);
+    if( transfer->stream->Feed(pData,size) == false )
+    {// No point downloading the rest.
+        transfer->result.error = "parse failed, " + transfer->stream->GetError();
+        return 0;
+    }
+    return size;
+}
+
+int FetchEngine::CURLProgress(void* pTransfer,curl_off_t pDownloadTotal,curl_off_t pDownloaded,curl_off_t pUploadTotal,curl_off_t pUploaded)
+{
+    // Non zero aborts the transfer with CURLE_ABORTED_BY_CALLBACK.
+    return ((Transfer*)pTransfer)->GetStopped() ? 1 : 0;
+}
+
+size_t FetchEngine::CURLHeader(char* pData,size_t pSize,size_t pCount,void* pTransfer)
+{
+    Transfer* transfer = (Transfer*)pTransfer;
+    const size_t size = pSize * pCount;
+
+    std::string_view line(pData,size);
+    while( line.size() > 0 && (line.back() == '\r' || line.back() == '\n') )
+        line.remove_suffix(1);
+
+    const size_t colon = line.find(':');
+    if( line.substr(0,5) == "HTTP/" )
+    {// A new response, forget anything from the last one.
+        transfer->etag.clear();
+        transfer->lastModified.clear();
+        transfer->serverExpires = 0;
+    }
+    else if( colon != std::string_view::npos )
+    {
+        const std::string_view name = line.substr(0,colon);
+        std::string_view value = line.substr(colon + 1);
+        while( value.size() > 0 && value.front() == ' ' )
+            value.remove_prefix(1);
+
+        auto is = [name](const char* pName)
+        {
+            return name.size() == strlen(pName) && strncasecmp(name.data(),pName,name.size()) == 0;
+        };
+
+        if( is("ETag") )
+        {
+            transfer->etag = value;
+        }
+        else if( is("Last-Modified") )
+        {
+            transfer->lastModified = value;
+        }
+        else if( is("Cache-Control") )
+        {
+            const size_t maxAge = value.find("max-age=");
+            if( maxAge != std::string_view::npos )
+            {
+                transfer->serverExpires = std::time(nullptr) + std::strtol(std::string(value.substr(maxAge + 8)).c_str(),nullptr,10);
+            }
+        }
+        else if( is("Expires") && transfer->serverExpires == 0 )
+        {// Cache-Control wins if there's both.
+            const time_t expires = curl_getdate(std::string(value).c_str(),nullptr);
+            if( expires > 0 )
+            {
+                transfer->serverExpires = expires;
+            }
+        }
+    }
+    return size;
+}
+
+int64_t FetchEngine::GetTimeMS()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
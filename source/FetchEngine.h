@@ -0,0 +1,235 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef FETCH_ENGINE_H
+#define FETCH_ENGINE_H
+
+#include <curl/curl.h> // libcurl4-openssl-dev
+
+#include "HTTPCache.h"
+#include "JsonStream.h"
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#define FETCH_MAX_TRANSFERS         4       // At once, the rest wait in priority order.
+#define FETCH_DEFAULT_TIMEOUT_MS    30000   // Whole transfer, including DNS and connect.
+#define FETCH_CONNECT_TIMEOUT_MS    10000
+#define FETCH_KEEP_ALIVE_SECONDS    60      // TCP keep alive probes on idle connections so the pool stays usable.
+#define FETCH_LOW_SPEED_LIMIT       1       // Bytes a second, a transfer slower than this for FETCH_LOW_SPEED_SECONDS is dropped.
+#define FETCH_LOW_SPEED_SECONDS     15
+#define FETCH_SHUTDOWN_BUDGET_MS    200     // The destructor complains if it takes longer than this.
+#define FETCH_STREAM_CHUNK_SIZE     16384   // Read size when streaming a body back out of the cache.
+
+/**
+ * @brief Downloads on its own thread using curl's multi interface, so nothing here ever blocks a frame.
+ * Requests can be submitted from any thread. The body can be parsed on the fetch thread, then the
+ * completion is called on the UI thread from Tick.
+ * Easy handles are pooled and share DNS and TLS sessions through a CURLSH, and the multi handle keeps the
+ * connections, so a repeat fetch to the same host skips the lookup, the TCP connect and the full TLS handshake.
+ * Requests can ask for their response to be kept in an HTTPCache. A fresh entry is used without going to
+ * the network, a stale one is revalidated with If-None-Match / If-Modified-Since.
+ * Large JSON responses can be streamed, each chunk goes through a JsonStream and into the cache as it arrives,
+ * so the whole body is never held in memory.
+ * Every transfer can be cancelled through a StopToken, and all of them are when the engine is destroyed.
+ * curl's progress callback checks the token so even a stalled transfer stops straight away.
+ */
+class FetchEngine
+{
+public:
+    enum Priority
+    {
+        PRIORITY_LOW,       //!< Big and rarely changing, station lists and the like.
+        PRIORITY_NORMAL,
+        PRIORITY_HIGH       //!< Something on screen is waiting for it.
+    };
+
+    /**
+     * @brief Where the time went, in microseconds. Each stage is its own time, not the running total curl reports.
+     */
+    struct Timing
+    {
+        int64_t dns = 0;
+        int64_t connect = 0;
+        int64_t tls = 0;
+        int64_t transfer = 0;   //!< Request sent to last byte received.
+        int64_t total = 0;
+        bool newConnection = false;
+    };
+
+    /**
+     * @brief Give the same token to all of an owner's requests, then Stop it in the owner's destructor.
+     * Stopped requests are abandoned where ever they are and their onComplete is never called.
+     */
+    typedef std::shared_ptr<std::atomic<bool>> StopToken;
+    static StopToken MakeStopToken(){return std::make_shared<std::atomic<bool>>(false);}
+
+    struct Stats
+    {
+        uint32_t fetches = 0;
+        uint32_t newConnections = 0;
+        Timing totals;
+    };
+
+    struct Result
+    {
+        uint32_t id = 0;
+        std::string url;
+        std::string who;
+        std::string body;       //!< Empty if the request was streamed.
+        uint64_t bodySize = 0;  //!< Also set when the body was streamed.
+        long httpCode = 0;
+        bool ok = false;        //!< Transfer worked, the server said 2xx and the parse, if any, worked.
+        std::string error;
+        int64_t elapsedMS = 0;  //!< From being submitted to the body being parsed.
+        Timing timing;
+        bool fromCache = false; //!< The body came from the cache, it was fresh or the server said 304.
+        uint64_t bodyHash = 0;  //!< HTTPCache::Hash of the body, keep it and pass it back as Request::parsedHash.
+        bool unchanged = false; //!< The body matched Request::parsedHash so it was not parsed again, keep what you have.
+    };
+
+    /**
+     * @brief Called on the fetch thread once the body has arrived, so heavy parsing does not happen on the UI thread.
+     * Return false if the body is no good. Exceptions are caught and treated as a failure.
+     */
+    typedef std::function<bool(const std::string& pBody)> OnParse;
+
+    /**
+     * @brief Called on the UI thread, from Tick, when the request has finished one way or another.
+     */
+    typedef std::function<void(const Result& pResult)> OnComplete;
+
+    struct Request
+    {
+        std::string url;
+        std::string who;    //!< For error messages.
+        Priority priority = PRIORITY_NORMAL;
+        uint32_t timeoutMS = FETCH_DEFAULT_TIMEOUT_MS;
+        uint32_t cacheSeconds = 0;  //!< Zero to not cache, else how long the response is fresh for unless the server says longer.
+        uint64_t parsedHash = 0;    //!< Result::bodyHash of what the caller last parsed, zero if nothing.
+        OnParse parse;
+        std::shared_ptr<JsonStream::Handler> stream;   //!< If set the body is fed to this on the fetch thread as it arrives, and parse is not used.
+        StopToken stop;     //!< Optional, see Stop.
+        OnComplete onComplete;
+    };
+
+    /**
+     * @param pCacheFolder Where to keep cached responses, empty for no cache.
+     */
+    FetchEngine(const std::string& pCacheFolder);
+    ~FetchEngine();// Abandons transfers in flight, completions not yet delivered are dropped. Only a parse that is running can hold it up.
+
+    /**
+     * @brief Safe from any thread, returns straight away.
+     * @return An id for the request, also passed back in the Result.
+     */
+    uint32_t Submit(Request pRequest);
+
+    /**
+     * @brief Call once a frame from the UI thread, calls the completions that are ready.
+     */
+    void Tick();
+
+    /**
+     * @brief Safe from any thread. Cancels every request given pToken, their onComplete will not be called.
+     */
+    void Stop(const StopToken& pToken);
+
+    /**
+     * @brief Sends every request to pBase, http://host:port, keeping the path and query. For replaying to HTTPStandIn.
+     * Call before the first Submit.
+     */
+    void SetHostOverride(const std::string& pBase){mHostOverride = pBase;}
+
+    size_t GetPendingCount()const{return mPendingCount;}
+    Stats GetStats()const;
+
+private:
+    struct Transfer
+    {
+        Request request;
+        Result result;
+        uint64_t order = 0;         //!< Submission order, so equal priorities go first come first served.
+        int64_t submitted = 0;
+        const std::atomic<bool>* running = nullptr; //!< The engine's, false once it is being destroyed.
+        CURL* curl = nullptr;
+        char errorBuffer[CURL_ERROR_SIZE];
+
+        // Caching
+        HTTPCache::Entry cached;
+        bool haveCached = false;
+        curl_slist* headers = nullptr;  //!< The conditional request headers.
+        std::string etag;
+        std::string lastModified;
+        int64_t serverExpires = 0;      //!< From Cache-Control max-age or Expires, zero if neither.
+
+        // Streaming
+        std::unique_ptr<JsonStream> stream;
+        HTTPCache* cache = nullptr;     //!< Where the streamed body is written, null if it is not cached.
+        std::unique_ptr<HTTPCache::Writer> cacheWriter;
+        uint64_t streamHash = HTTPCache::HASH_SEED;
+
+        bool GetStopped()const{return (request.stop && *request.stop) || *running == false;}
+    };
+
+    HTTPCache* mCache = nullptr;        //!< Fetch thread only.
+    std::string mHostOverride;          //!< Empty to use the URLs as they are.
+    CURLM* mMulti = nullptr;
+    CURLSH* mShare = nullptr;
+    std::mutex mShareLocks[CURL_LOCK_DATA_LAST];
+    std::vector<CURL*> mIdleHandles;    //!< Fetch thread only, reset and ready for the next transfer.
+    std::thread mWorker;
+    std::atomic<bool> mRunning{true};
+
+    std::mutex mLock;                   //!< Guards mQueue and mCompleted.
+    std::vector<Transfer*> mQueue;      //!< Submitted, waiting for a free transfer slot.
+    std::vector<Transfer*> mCompleted;  //!< Waiting for Tick.
+    std::vector<Transfer*> mDelivering; //!< UI thread only, swapped with mCompleted so callbacks run without the lock.
+    std::vector<Transfer*> mActive;     //!< Fetch thread only.
+    uint64_t mNextOrder = 0;
+    uint32_t mNextID = 1;
+    std::atomic<size_t> mPendingCount{0};
+
+    mutable std::mutex mStatsLock;
+    Stats mStats;
+
+    void WorkerLoop();
+    void StartQueued();
+    void CancelStopped();
+    bool GetFreshFromCache(Transfer* pTransfer);
+    bool StartTransfer(Transfer* pTransfer);
+    void FinishTransfer(CURL* pCurl,CURLcode pCode);
+    void UpdateCache(Transfer* pTransfer);
+    bool StreamFromCache(Transfer* pTransfer);
+    void Complete(Transfer* pTransfer,CURLcode pCode);
+    void ReadTiming(CURL* pCurl,Timing& rTiming);
+
+    static void ShareLock(CURL* pCurl,curl_lock_data pData,curl_lock_access pAccess,void* pEngine);
+    static void ShareUnlock(CURL* pCurl,curl_lock_data pData,void* pEngine);
+
+    static size_t CURLWriter(char* pData,size_t pSize,size_t pCount,void* pTransfer);
+    static int CURLProgress(void* pTransfer,curl_off_t pDownloadTotal,curl_off_t pDownloaded,curl_off_t pUploadTotal,curl_off_t pUploaded);
+    static size_t CURLHeader(char* pData,size_t pSize,size_t pCount,void* pTransfer);
+    static int64_t GetTimeMS();
+};
+
+#endif //#ifndef FETCH_ENGINE_H
@@ -0,0 +1,81 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "FetchPolicy.h"
+
+#include <algorithm>
+#include <iostream>
+
+FetchPolicy::FetchPolicy(const std::string& pName):
+    mName(pName),
+    mRandom(std::random_device{}())
+{
+}
+
+bool FetchPolicy::TryBegin(std::time_t pNow)
+{
+    if( mInFlight || pNow < mNextAttempt )
+        return false;
+
+    if( mState == POLICY_OPEN )
+    {
+        std::clog << mName << " probing after " << mFailures << " failures\n";
+        mState = POLICY_HALF_OPEN;
+    }
+
+    mInFlight = true;
+    return true;
+}
+
+void FetchPolicy::OnSuccess(std::time_t pNextFetch)
+{
+    if( mState != POLICY_CLOSED )
+    {
+        std::clog << mName << " working again\n";
+    }
+
+    mInFlight = false;
+    mState = POLICY_CLOSED;
+    mFailures = 0;
+    mOpenFor = FETCH_POLICY_OPEN_FOR;
+    mNextAttempt = pNextFetch;
+}
+
+void FetchPolicy::OnFailure(std::time_t pNow)
+{
+    mInFlight = false;
+    mFailures++;
+
+    if( mState == POLICY_HALF_OPEN )
+    {// The probe failed, stay open for longer.
+        mOpenFor = std::min<uint32_t>(mOpenFor * 2,FETCH_POLICY_OPEN_FOR * 8);
+        mState = POLICY_OPEN;
+        mNextAttempt = pNow + mOpenFor;
+    }
+    else if( mFailures >= FETCH_POLICY_OPEN_AFTER )
+    {
+        mState = POLICY_OPEN;
+        mNextAttempt = pNow + mOpenFor;
+    }
+    else
+    {// Full jitter on the top half, so we never retry sooner than half the backoff.
+        const uint32_t backoff = std::min<uint32_t>(FETCH_POLICY_MIN_BACKOFF << (mFailures - 1),FETCH_POLICY_MAX_BACKOFF);
+        std::uniform_int_distribution<uint32_t> jitter(backoff / 2,backoff);
+        mNextAttempt = pNow + jitter(mRandom);
+    }
+
+    std::clog << mName << " failed " << mFailures << " times, " << (mState == POLICY_OPEN ? "circuit open, " : "") << "next try in " << (mNextAttempt - pNow) << "s\n";
+}
@@ -0,0 +1,75 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef FETCH_POLICY_H
+#define FETCH_POLICY_H
+
+#include <string>
+#include <random>
+#include <ctime>
+#include <cstdint>
+
+#define FETCH_POLICY_MIN_BACKOFF    30          // Seconds before the first retry.
+#define FETCH_POLICY_MAX_BACKOFF    (60 * 60)   // Retries never wait longer than an hour.
+#define FETCH_POLICY_OPEN_AFTER     5           // Failures in a row before the circuit opens.
+#define FETCH_POLICY_OPEN_FOR       (30 * 60)   // How long an open circuit waits before a single probe.
+
+/**
+ * @brief Decides when a data source may be fetched.
+ * After a failure it backs off exponentially with jitter, so a dozen displays don't all retry together.
+ * After FETCH_POLICY_OPEN_AFTER failures in a row the circuit opens and nothing is fetched for a while,
+ * then one probe is let through (half open). If that works it's back to normal, if not it stays open for longer.
+ * Only one fetch is ever in flight per policy. UI thread only.
+ */
+class FetchPolicy
+{
+public:
+    enum State
+    {
+        POLICY_CLOSED,      //!< Working, fetch on schedule and back off on failure.
+        POLICY_OPEN,        //!< Failing, wait before trying again.
+        POLICY_HALF_OPEN    //!< A probe is in flight.
+    };
+
+    FetchPolicy(const std::string& pName);
+
+    /**
+     * @brief Returns true if a fetch should start now, the caller must then call OnSuccess or OnFailure.
+     */
+    bool TryBegin(std::time_t pNow);
+
+    /**
+     * @brief The fetch worked, the next one is due at pNextFetch.
+     */
+    void OnSuccess(std::time_t pNextFetch);
+    void OnFailure(std::time_t pNow);
+
+    State GetState()const{return mState;}
+    uint32_t GetFailureCount()const{return mFailures;}
+    std::time_t GetNextAttempt()const{return mNextAttempt;}
+    bool GetInFlight()const{return mInFlight;}
+
+private:
+    const std::string mName;
+    State mState = POLICY_CLOSED;
+    uint32_t mFailures = 0;         //!< In a row, cleared on success.
+    uint32_t mOpenFor = FETCH_POLICY_OPEN_FOR;
+    std::time_t mNextAttempt = 0;   //!< Zero to fetch straight away.
+    bool mInFlight = false;
+    std::mt19937 mRandom;
+};
+
+#endif //#ifndef FETCH_POLICY_H
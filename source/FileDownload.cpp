@@ -1,6 +1,9 @@
 #include <curl/curl.h> // libcurl4-openssl-dev
 #include <iostream>
 #include <string>
+#include <atomic>
+
+#include "FileDownload.h"
 
 static int CURLWriter(char *data, size_t size, size_t nmemb,std::string *writerData)
 {
@@ -12,7 +15,13 @@ static int CURLWriter(char *data, size_t size, size_t nmemb,std::string *writerD
 	return size * nmemb;
 }
 
-std::string DownloadJson(const std::string& pURL,const std::string& pWho)
+static int CURLProgress(void *stopData, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{
+	const std::atomic<bool>* stop = (const std::atomic<bool>*)stopData;
+	return stop && *stop ? 1 : 0;
+}
+
+std::string DownloadJson(const std::string& pURL,const std::string& pWho,const std::atomic<bool>* pStop)
 {
     CURL *curl = curl_easy_init();
     std::string result;
@@ -29,6 +38,14 @@ std::string DownloadJson(const std::string& pURL,const std::string& pWho)
                     std::string json;
                     if( curl_easy_setopt(curl, CURLOPT_WRITEDATA, &json) == CURLE_OK )
                     {
+                        // Never block for ever, and give up straight away if asked to stop.
+                        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+                        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)DOWNLOAD_CONNECT_TIMEOUT_MS);
+                        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+                        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)DOWNLOAD_LOW_SPEED_SECONDS);
+                        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, CURLProgress);
+                        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, pStop);
+                        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
                         if( curl_easy_perform(curl) == CURLE_OK )
                         {
                             result = json;
@@ -2,7 +2,12 @@
 #define FileDownload_h
 
 #include <string>
+#include <atomic>
 
-extern std::string DownloadJson(const std::string& pURL,const std::string& pWho);
+#define DOWNLOAD_CONNECT_TIMEOUT_MS 10000
+#define DOWNLOAD_LOW_SPEED_SECONDS  15      // Below a byte a second for this long and it gives up.
+
+// Blocking, pStop can be set from another thread to abort it within a second or so.
+extern std::string DownloadJson(const std::string& pURL,const std::string& pWho,const std::atomic<bool>* pStop = nullptr);
 
 #endif //#ifndef FileDownload_h
\ No newline at end of file
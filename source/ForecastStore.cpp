@@ -0,0 +1,225 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "ForecastStore.h"
+
+#include <algorithm>
+#include <iostream>
+#include <filesystem>
+#include <cstdio>
+#include <cstring>
+
+static const char FORECAST_MAGIC[] = "MTFCST01";
+static const size_t MAX_SAVED_HOURS = 24 * 31;     // A lot more than Open-Meteo sends, anything bigger is not one of ours.
+
+static std::time_t GetHourStart(const openmeteo::Hourly& pHour)
+{
+    tm utc = pHour.ctime;
+    const std::time_t time = timegm(&utc);// UTC, so no time zone lookup.
+    return time - (time % ForecastStore::HOUR);
+}
+
+void ForecastStore::Set(const std::vector<openmeteo::Hourly>& pHours)
+{
+    Clear();
+    if( pHours.size() == 0 )
+        return;
+
+    // Size it once, the forecast is normally a week of hours in order.
+    std::time_t first = GetHourStart(pHours.front());
+    std::time_t last = first;
+    for( const auto& h : pHours )
+    {
+        const std::time_t t = GetHourStart(h);
+        first = std::min(first,t);
+        last = std::max(last,t);
+    }
+    MakeRoom(first);
+    MakeRoom(last);
+
+    for( const auto& h : pHours )
+    {
+        const size_t n = (size_t)((GetHourStart(h) - mFirstHour) / HOUR);
+        mValid[n] = true;
+        mTemperature[n] = (float)h.temperature_2m;
+        mIsDay[n] = h.is_day;
+        mIcon[n] = GetIconIndex(h.icon_code);
+    }
+}
+
+size_t ForecastStore::Merge(const ForecastStore& pHours,std::time_t& rFirstChanged,std::time_t& rLastChanged)
+{
+    size_t changed = 0;
+    for( size_t from = 0 ; from < pHours.GetCount() ; from++ )
+    {
+        if( pHours.mValid[from] == false )
+            continue;
+
+        const std::time_t time = pHours.GetTime(from);
+        const size_t n = MakeRoom(time);
+        const uint8_t icon = GetIconIndex(pHours.GetIconCode(from));
+        const bool differs = mValid[n] == false ||
+                             mTemperature[n] != pHours.mTemperature[from] ||
+                             mIcon[n] != icon ||
+                             mIsDay[n] != pHours.mIsDay[from];
+
+        mValid[n] = true;
+        mTemperature[n] = pHours.mTemperature[from];
+        mIsDay[n] = pHours.mIsDay[from];
+        mIcon[n] = icon;
+
+        if( differs )
+        {
+            rLastChanged = time;
+            if( changed++ == 0 )
+                rFirstChanged = time;
+        }
+    }
+    return changed;
+}
+
+bool ForecastStore::Load(const std::string& pFile,uint64_t& rHash,std::time_t& rFetched)
+{
+    Clear();
+    FILE* file = fopen(pFile.c_str(),"r");
+    if( file == nullptr )
+        return false;
+
+    char line[64];
+    unsigned long long hash = 0;
+    long long fetched,firstHour;
+    size_t hours,icons;
+    bool ok = fgets(line,sizeof(line),file) && strncmp(line,FORECAST_MAGIC,strlen(FORECAST_MAGIC)) == 0 &&
+              fscanf(file,"%16llx\n",&hash) == 1 &&
+              fscanf(file,"%lld %lld %zu %zu\n",&fetched,&firstHour,&hours,&icons) == 4 &&
+              hours > 0 && hours <= MAX_SAVED_HOURS && icons <= 256;
+
+    for( size_t n = 0 ; ok && n < icons ; n++ )
+    {
+        ok = fgets(line,sizeof(line),file) != nullptr;
+        line[strcspn(line,"\r\n")] = 0;
+        mIconCodes.push_back(line);
+    }
+
+    mFirstHour = (std::time_t)firstHour;
+    for( size_t n = 0 ; ok && n < hours ; n++ )
+    {
+        int valid,isDay;
+        unsigned icon;
+        float temperature;
+        ok = fscanf(file,"%d %f %d %u\n",&valid,&temperature,&isDay,&icon) == 4 && (valid == 0 || icon < icons);
+        mValid.push_back(valid != 0);
+        mTemperature.push_back(temperature);
+        mIsDay.push_back(isDay != 0);
+        mIcon.push_back((uint8_t)icon);
+    }
+    fclose(file);
+
+    if( ok == false )
+    {
+        std::cerr << "ForecastStore ignoring " << pFile << ", it is not a saved forecast\n";
+        Clear();
+        return false;
+    }
+
+    rHash = hash;
+    rFetched = (std::time_t)fetched;
+    return true;
+}
+
+void ForecastStore::Save(const std::string& pFile,uint64_t pHash,std::time_t pFetched)const
+{
+    // Write then rename, so a crash never leaves half a forecast behind.
+    std::error_code ec;
+    const std::string temp = pFile + ".tmp";
+    FILE* file = fopen(temp.c_str(),"w");
+    if( file == nullptr )
+    {
+        std::cerr << "ForecastStore failed to write " << temp << " " << strerror(errno) << "\n";
+        return;
+    }
+
+    bool ok = fprintf(file,"%s\n%016llx\n%lld %lld %zu %zu\n",FORECAST_MAGIC,(unsigned long long)pHash,(long long)pFetched,(long long)mFirstHour,mValid.size(),mIconCodes.size()) > 0;
+    for( const std::string& code : mIconCodes )
+    {
+        ok = ok && fprintf(file,"%s\n",code.c_str()) > 0;
+    }
+    for( size_t n = 0 ; n < mValid.size() ; n++ )
+    {// %.9g so the temperature reads back as the same float, or Merge would see every hour as changed.
+        ok = ok && fprintf(file,"%d %.9g %d %u\n",mValid[n] ? 1 : 0,mTemperature[n],mIsDay[n] ? 1 : 0,(unsigned)mIcon[n]) > 0;
+    }
+    ok = fclose(file) == 0 && ok;
+
+    if( ok )
+    {
+        std::filesystem::rename(temp,pFile,ec);
+        ok = !ec;
+    }
+
+    if( ok == false )
+    {
+        std::cerr << "ForecastStore failed to save " << pFile << "\n";
+        std::filesystem::remove(temp,ec);
+    }
+}
+
+size_t ForecastStore::MakeRoom(std::time_t pHour)
+{
+    if( mValid.size() == 0 )
+    {
+        mFirstHour = pHour;
+    }
+    else if( pHour < mFirstHour )
+    {// Rare, only if a refresh starts before the forecast does.
+        const size_t count = (size_t)((mFirstHour - pHour) / HOUR);
+        mValid.insert(mValid.begin(),count,false);
+        mTemperature.insert(mTemperature.begin(),count,0.0f);
+        mIsDay.insert(mIsDay.begin(),count,true);
+        mIcon.insert(mIcon.begin(),count,0);
+        mFirstHour = pHour;
+    }
+
+    const size_t index = (size_t)((pHour - mFirstHour) / HOUR);
+    if( index >= mValid.size() )
+    {
+        const size_t size = index + 1;
+        mValid.resize(size,false);
+        mTemperature.resize(size,0.0f);
+        mIsDay.resize(size,true);
+        mIcon.resize(size,0);
+    }
+    return index;
+}
+
+uint8_t ForecastStore::GetIconIndex(const std::string& pCode)
+{
+    const auto found = std::find(mIconCodes.begin(),mIconCodes.end(),pCode);
+    if( found != mIconCodes.end() )
+        return (uint8_t)(found - mIconCodes.begin());
+
+    mIconCodes.push_back(pCode);
+    return (uint8_t)(mIconCodes.size() - 1);
+}
+
+void ForecastStore::Clear()
+{
+    mFirstHour = 0;
+    mValid.clear();
+    mTemperature.clear();
+    mIsDay.clear();
+    mIcon.clear();
+    mIconCodes.clear();
+}
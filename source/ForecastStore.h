@@ -0,0 +1,94 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef FORECAST_STORE_H
+#define FORECAST_STORE_H
+
+#include "../OpenMeteoFetch/open-meteo.h"
+
+#include <vector>
+#include <string>
+#include <ctime>
+#include <cstdint>
+
+/**
+ * @brief The hourly forecast as one array per value, indexed by hours since the first hour held.
+ * Finding the hour for a time is a subtraction, a divide and a bounds check, nothing is copied to read it.
+ * Icon codes are held once each and referred to by index. Widgets keep a const reference to the store,
+ * never a copy. Built on the fetch thread from the parsed forecast then moved into place on the UI thread.
+ */
+class ForecastStore
+{
+public:
+    static constexpr std::time_t HOUR = 60 * 60;
+
+    /**
+     * @brief Replaces everything with pHours, which need not be in order. Gaps are held as missing hours.
+     */
+    void Set(const std::vector<openmeteo::Hourly>& pHours);
+
+    /**
+     * @brief Copies every hour of pHours over the same hour here, growing to take in new hours.
+     * An hour has changed if its temperature, icon or day flag is different, or it was not here before.
+     * @return How many hours changed, rFirstChanged and rLastChanged are set if any did.
+     */
+    size_t Merge(const ForecastStore& pHours,std::time_t& rFirstChanged,std::time_t& rLastChanged);
+
+    /**
+     * @brief Start up only, puts back what Save wrote so a restart does not have to parse the forecast again.
+     * @return False, and empty, if the file is missing or not one of ours.
+     */
+    bool Load(const std::string& pFile,uint64_t& rHash,std::time_t& rFetched);
+
+    /**
+     * @brief Writes everything to pFile with the hash of the body it came from and when it was fetched.
+     */
+    void Save(const std::string& pFile,uint64_t pHash,std::time_t pFetched)const;
+
+    /**
+     * @brief The hour that pTime falls in. False if it is outside the forecast or that hour is missing.
+     */
+    bool GetIndex(std::time_t pTime,size_t& rIndex)const
+    {
+        if( pTime < mFirstHour )
+            return false;
+        rIndex = (size_t)((pTime - mFirstHour) / HOUR);
+        return rIndex < mValid.size() && mValid[rIndex];
+    }
+
+    size_t GetCount()const{return mValid.size();}
+    bool GetEmpty()const{return mValid.size() == 0;}
+
+    std::time_t GetTime(size_t pIndex)const{return mFirstHour + ((std::time_t)pIndex * HOUR);}//!< Start of the hour, UTC.
+    bool GetValid(size_t pIndex)const{return mValid[pIndex];}
+    float GetTemperature(size_t pIndex)const{return mTemperature[pIndex];}
+    bool GetIsDay(size_t pIndex)const{return mIsDay[pIndex];}
+    const std::string& GetIconCode(size_t pIndex)const{return mIconCodes[mIcon[pIndex]];}
+
+private:
+    std::time_t mFirstHour = 0;
+    std::vector<uint8_t> mValid;
+    std::vector<float> mTemperature;
+    std::vector<uint8_t> mIsDay;
+    std::vector<uint8_t> mIcon;             //!< Into mIconCodes.
+    std::vector<std::string> mIconCodes;    //!< There's a couple of dozen at most.
+
+    size_t MakeRoom(std::time_t pHour);     //!< Grows the arrays to take in the hour, returns its index.
+    uint8_t GetIconIndex(const std::string& pCode);
+    void Clear();
+};
+
+#endif //#ifndef FORECAST_STORE_H
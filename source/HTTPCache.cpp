@@ -0,0 +1,265 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "HTTPCache.h"
+
+#include <sys/stat.h>
+
+#include <cstring>
+#include <iostream>
+#include <filesystem>
+
+static const char CACHE_MAGIC[] = "MTCACHE2";
+
+/**
+ * File layout, the header is text so the cache can be looked at with less.
+ * Expires, hash and size are fixed width so they can be written over in place.
+ *  MTCACHE2
+ *  url
+ *  etag
+ *  last modified
+ *  expires, 20 digits
+ *  hash, 16 hex digits
+ *  body size, 20 digits
+ *  body bytes
+ */
+
+static bool ReadLine(FILE* pFile,std::string& rLine)
+{
+    rLine.clear();
+    for( int c = fgetc(pFile) ; c != EOF ; c = fgetc(pFile) )
+    {
+        if( c == '\n' )
+            return true;
+        rLine.push_back((char)c);
+    }
+    return false;
+}
+
+HTTPCache::Writer::Writer(const HTTPCache& pCache,const std::string& pURL,const Entry& pEntry) :
+    mFileName(pCache.GetFileName(pURL)),
+    mTemp(mFileName + ".tmp"),
+    mHash(HASH_SEED)
+{
+    if( pCache.GetOK() == false )
+        return;
+
+    mFile = fopen(mTemp.c_str(),"wb");
+    if( mFile == nullptr )
+    {
+        std::cerr << "HTTPCache failed to write " << mTemp << " " << strerror(errno) << "\n";
+        return;
+    }
+
+    fprintf(mFile,"%s\n%s\n%s\n%s\n%020lld\n",CACHE_MAGIC,pURL.c_str(),pEntry.etag.c_str(),pEntry.lastModified.c_str(),(long long)pEntry.expires);
+    mHashOffset = ftell(mFile);
+    fprintf(mFile,"%016llx\n%020llu\n",0ull,0ull);
+}
+
+HTTPCache::Writer::~Writer()
+{
+    if( mFile )
+    {// Never committed.
+        fclose(mFile);
+        std::error_code ec;
+        std::filesystem::remove(mTemp,ec);
+    }
+}
+
+bool HTTPCache::Writer::Write(const char* pData,size_t pSize)
+{
+    if( mFile == nullptr )
+        return false;
+
+    mHash = Hash(pData,pSize,mHash);
+    mSize += pSize;
+    return fwrite(pData,1,pSize,mFile) == pSize;
+}
+
+bool HTTPCache::Writer::Commit()
+{
+    if( mFile == nullptr )
+        return false;
+
+    // Write then rename, so a crash never leaves half an entry behind.
+    bool ok = fseek(mFile,mHashOffset,SEEK_SET) == 0 &&
+              fprintf(mFile,"%016llx\n%020llu\n",(unsigned long long)mHash,(unsigned long long)mSize) > 0;
+    ok = fclose(mFile) == 0 && ok;
+    mFile = nullptr;
+
+    std::error_code ec;
+    if( ok )
+    {
+        std::filesystem::rename(mTemp,mFileName,ec);
+        ok = !ec;
+    }
+
+    if( ok == false )
+    {
+        std::filesystem::remove(mTemp,ec);
+    }
+    return ok;
+}
+
+HTTPCache::HTTPCache(const std::string& pFolder):mFolder(pFolder)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(mFolder,ec);
+    mOK = std::filesystem::is_directory(mFolder,ec);
+    if( mOK == false )
+    {
+        std::cerr << "HTTPCache can not use " << mFolder << ", responses will not be cached\n";
+    }
+}
+
+FILE* HTTPCache::Open(const std::string& pURL,Entry& rEntry)const
+{
+    if( mOK == false )
+        return nullptr;
+
+    FILE* file = fopen(GetFileName(pURL).c_str(),"rb");
+    if( file == nullptr )
+        return nullptr;
+
+    std::string magic,url,expires,hash,size;
+    const bool ok = ReadLine(file,magic) && magic == CACHE_MAGIC &&
+                    ReadLine(file,url) && url == pURL &&// Hash collisions are unlikely, but not impossible.
+                    ReadLine(file,rEntry.etag) &&
+                    ReadLine(file,rEntry.lastModified) &&
+                    ReadLine(file,expires) &&
+                    ReadLine(file,hash) &&
+                    ReadLine(file,size);
+    if( ok == false )
+    {
+        fclose(file);
+        return nullptr;
+    }
+
+    rEntry.expires = std::strtoll(expires.c_str(),nullptr,10);
+    rEntry.hash = std::strtoull(hash.c_str(),nullptr,16);
+
+    // The size is used to allocate and read the body, so it must be what is left of the file.
+    // A corrupt or cut short entry is a miss, it gets downloaded again.
+    char* sizeEnd;
+    rEntry.size = std::strtoull(size.c_str(),&sizeEnd,10);
+    struct stat fileStat;
+    const long bodyStart = ftell(file);
+    if( size.size() == 0 || *sizeEnd != 0 || bodyStart < 0 || fstat(fileno(file),&fileStat) != 0 ||
+        (uint64_t)fileStat.st_size < (uint64_t)bodyStart || rEntry.size != (uint64_t)fileStat.st_size - (uint64_t)bodyStart )
+    {
+        std::cerr << "HTTPCache entry for " << pURL << " is corrupt, ignoring it\n";
+        fclose(file);
+        return nullptr;
+    }
+
+    rEntry.body.clear();
+    return file;
+}
+
+bool HTTPCache::Load(const std::string& pURL,Entry& rEntry,bool pWithBody)const
+{
+    FILE* file = Open(pURL,rEntry);
+    if( file == nullptr )
+        return false;
+
+    bool ok = true;
+    if( pWithBody )
+    {
+        rEntry.body.resize(rEntry.size);
+        ok = fread(rEntry.body.data(),1,rEntry.body.size(),file) == rEntry.body.size();
+    }
+
+    fclose(file);
+    return ok;
+}
+
+void HTTPCache::Store(const std::string& pURL,const Entry& pEntry)
+{
+    Writer writer(*this,pURL,pEntry);
+    if( writer.Write(pEntry.body.data(),pEntry.body.size()) )
+    {
+        writer.Commit();
+    }
+}
+
+bool HTTPCache::SetExpires(const std::string& pURL,int64_t pExpires)
+{
+    if( mOK == false )
+        return false;
+
+    FILE* file = fopen(GetFileName(pURL).c_str(),"r+b");
+    if( file == nullptr )
+        return false;
+
+    // Skip to the expires line.
+    std::string line;
+    bool ok = ReadLine(file,line) && line == CACHE_MAGIC &&
+              ReadLine(file,line) && line == pURL &&
+              ReadLine(file,line) &&
+              ReadLine(file,line);
+
+    if( ok )
+    {
+        ok = fseek(file,ftell(file),SEEK_SET) == 0 &&// Must seek when going from reading to writing.
+             fprintf(file,"%020lld",(long long)pExpires) == 20;
+    }
+
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+std::vector<std::string> HTTPCache::GetURLs()const
+{
+    std::vector<std::string> urls;
+    std::error_code ec;
+    if( mOK == false )
+        return urls;
+
+    for( const auto& file : std::filesystem::directory_iterator(mFolder,ec) )
+    {
+        if( file.path().extension() != ".http" )
+            continue;
+
+        FILE* f = fopen(file.path().c_str(),"rb");
+        if( f == nullptr )
+            continue;
+
+        std::string magic,url;
+        if( ReadLine(f,magic) && magic == CACHE_MAGIC && ReadLine(f,url) )
+        {
+            urls.push_back(url);
+        }
+        fclose(f);
+    }
+    return urls;
+}
+
+uint64_t HTTPCache::Hash(const char* pData,size_t pSize,uint64_t pHash)
+{
+    for( size_t n = 0 ; n < pSize ; n++ )
+    {
+        pHash ^= (uint8_t)pData[n];
+        pHash *= 1099511628211ull;
+    }
+    return pHash;
+}
+
+std::string HTTPCache::GetFileName(const std::string& pURL)const
+{
+    char name[32];
+    snprintf(name,sizeof(name),"%016llx.http",(unsigned long long)Hash(pURL));
+    return (std::filesystem::path(mFolder) / name).string();
+}
@@ -0,0 +1,106 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef HTTP_CACHE_H
+#define HTTP_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+
+/**
+ * @brief Keeps HTTP responses on disk, one file per URL, so a restart does not have to download everything again.
+ * Each entry has the body, the ETag and Last-Modified validators, when it stops being fresh and a hash of the body.
+ * Bodies can be written and read a chunk at a time so a large response never has to be held in memory.
+ * Only used from the FetchEngine thread.
+ */
+class HTTPCache
+{
+public:
+    struct Entry
+    {
+        std::string etag;
+        std::string lastModified;
+        int64_t expires = 0;    //!< Seconds since the epoch.
+        uint64_t hash = 0;      //!< Hash() of the body.
+        uint64_t size = 0;      //!< Of the body, which is only filled in when it is loaded.
+        std::string body;
+
+        bool GetCanRevalidate()const{return etag.size() > 0 || lastModified.size() > 0;}
+    };
+
+    /**
+     * @brief Writes an entry a chunk at a time, to a temp file that is only renamed over the old entry by Commit.
+     * If it is never committed the temp file is removed and the old entry is left alone.
+     */
+    class Writer
+    {
+    public:
+        Writer(const HTTPCache& pCache,const std::string& pURL,const Entry& pEntry);//!< pEntry.body, hash and size are ignored.
+        ~Writer();
+
+        bool Write(const char* pData,size_t pSize);
+        bool Commit();
+
+    private:
+        FILE* mFile = nullptr;
+        std::string mFileName;
+        std::string mTemp;
+        long mHashOffset = 0;   //!< Where the hash and size go once they are known.
+        uint64_t mHash;
+        uint64_t mSize = 0;
+    };
+
+    HTTPCache(const std::string& pFolder);
+
+    bool GetOK()const{return mOK;}
+
+    /**
+     * @brief Reads an entry, only reads the body if pWithBody is true.
+     */
+    bool Load(const std::string& pURL,Entry& rEntry,bool pWithBody = true)const;
+
+    /**
+     * @brief Reads the entry header and returns the file positioned at the start of the body, for reading a chunk at a time.
+     * Returns nullptr if there is no entry, else the caller must fclose it.
+     */
+    FILE* Open(const std::string& pURL,Entry& rEntry)const;
+
+    void Store(const std::string& pURL,const Entry& pEntry);
+
+    /**
+     * @brief The URL of every entry, so a cache folder can be replayed by HTTPStandIn.
+     */
+    std::vector<std::string> GetURLs()const;
+
+    /**
+     * @brief After a 304, the body is still good but until a new time. Rewrites the header in place.
+     */
+    bool SetExpires(const std::string& pURL,int64_t pExpires);
+
+    static constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+    static uint64_t Hash(const char* pData,size_t pSize,uint64_t pHash = HASH_SEED);//!< FNV-1a, pass the last result back in to hash a chunk at a time.
+    static uint64_t Hash(const std::string& pData){return Hash(pData.data(),pData.size());}//!< For file names and spotting a body we've already parsed.
+
+private:
+    const std::string mFolder;
+    bool mOK = false;
+
+    std::string GetFileName(const std::string& pURL)const;
+};
+
+#endif //#ifndef HTTP_CACHE_H
@@ -0,0 +1,290 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "HTTPStandIn.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <strings.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <cstring>
+
+static const int POLL_MS = 100;                 // How often blocked threads look to see if they should stop.
+static const size_t MAX_REQUEST_SIZE = 8192;    // We only ever get a GET with a few headers.
+
+std::vector<HTTPStandIn::Scenario> HTTPStandIn::GetStandardScenarios()
+{
+    std::vector<Scenario> scenarios(5);
+    scenarios[1].name = "latency";
+    scenarios[1].latencyMS = 500;
+    scenarios[2].name = "throttled";
+    scenarios[2].bytesPerSecond = 256 * 1024;// A poor WiFi link to a Pi Zero.
+    scenarios[3].name = "truncated";
+    scenarios[3].truncate = 0.5f;
+    scenarios[4].name = "error";
+    scenarios[4].errorCode = 503;
+    return scenarios;
+}
+
+std::string HTTPStandIn::GetPath(const std::string& pURL)
+{
+    const size_t scheme = pURL.find("://");
+    const size_t path = pURL.find('/',scheme == std::string::npos ? 0 : scheme + 3);
+    return path == std::string::npos ? "/" : pURL.substr(path);
+}
+
+HTTPStandIn::HTTPStandIn(const std::string& pFixtureFolder):mFixtures(pFixtureFolder)
+{
+    mURLs = mFixtures.GetURLs();
+    std::sort(mURLs.begin(),mURLs.end());
+    for( const auto& url : mURLs )
+    {
+        mPaths[GetPath(url)] = url;
+    }
+}
+
+HTTPStandIn::~HTTPStandIn()
+{
+    Stop();
+}
+
+bool HTTPStandIn::Start(const Scenario& pScenario)
+{
+    if( mURLs.size() == 0 )
+    {
+        std::cerr << "HTTPStandIn has no fixtures, record some with --cache <folder>\n";
+        return false;
+    }
+
+    mListen = socket(AF_INET,SOCK_STREAM,0);
+    if( mListen < 0 )
+    {
+        std::cerr << "HTTPStandIn socket failed " << strerror(errno) << "\n";
+        return false;
+    }
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;// Any free port.
+    socklen_t length = sizeof(address);
+    if( bind(mListen,(sockaddr*)&address,sizeof(address)) != 0 ||
+        listen(mListen,16) != 0 ||
+        getsockname(mListen,(sockaddr*)&address,&length) != 0 )
+    {
+        std::cerr << "HTTPStandIn failed to listen " << strerror(errno) << "\n";
+        close(mListen);
+        mListen = -1;
+        return false;
+    }
+
+    mPort = ntohs(address.sin_port);
+    SetScenario(pScenario);
+    mRunning = true;
+    mAcceptThread = std::thread([this](){AcceptLoop();});
+    std::clog << "HTTPStandIn serving " << mURLs.size() << " fixtures on " << GetBaseURL() << "\n";
+    return true;
+}
+
+void HTTPStandIn::Stop()
+{
+    mRunning = false;
+    if( mAcceptThread.joinable() )
+    {
+        mAcceptThread.join();
+    }
+
+    // Nothing else adds to it now the accept thread has gone.
+    for( auto& c : mConnections )
+    {
+        c->thread.join();
+    }
+    mConnections.clear();
+
+    if( mListen >= 0 )
+    {
+        close(mListen);
+        mListen = -1;
+    }
+}
+
+void HTTPStandIn::SetScenario(const Scenario& pScenario)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    mScenario = pScenario;
+}
+
+std::string HTTPStandIn::GetBaseURL()const
+{
+    return "http://127.0.0.1:" + std::to_string(mPort);
+}
+
+void HTTPStandIn::AcceptLoop()
+{
+    while( mRunning )
+    {
+        Reap();
+        pollfd listen = {mListen,POLLIN,0};
+        if( poll(&listen,1,POLL_MS) <= 0 )
+            continue;
+
+        const int client = accept(mListen,nullptr,nullptr);
+        if( client >= 0 )
+        {
+            auto connection = std::make_unique<Connection>();
+            Connection* c = connection.get();
+            c->thread = std::thread([this,c,client](){Serve(client);c->done = true;});
+            mConnections.push_back(std::move(connection));
+        }
+    }
+}
+
+void HTTPStandIn::Reap()
+{
+    for( auto c = mConnections.begin() ; c != mConnections.end() ; )
+    {
+        if( (*c)->done )
+        {
+            (*c)->thread.join();
+            c = mConnections.erase(c);
+        }
+        else
+        {
+            c++;
+        }
+    }
+}
+
+void HTTPStandIn::Serve(int pSocket)
+{
+    // Read up to the blank line that ends the headers.
+    std::string request;
+    char buffer[HTTP_STAND_IN_CHUNK_SIZE];
+    while( mRunning && request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST_SIZE )
+    {
+        pollfd in = {pSocket,POLLIN,0};
+        if( poll(&in,1,POLL_MS) <= 0 )
+            continue;
+
+        const ssize_t got = recv(pSocket,buffer,sizeof(buffer),0);
+        if( got <= 0 )
+            break;
+        request.append(buffer,got);
+    }
+
+    const size_t pathStart = request.find(' ');
+    const size_t pathEnd = request.find(' ',pathStart + 1);
+    if( mRunning == false || pathStart == std::string::npos || pathEnd == std::string::npos )
+    {
+        close(pSocket);
+        return;
+    }
+    mRequests++;
+
+    Scenario scenario;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        scenario = mScenario;
+    }
+
+    char header[1024];
+    if( Sleep(scenario.latencyMS) == false )
+    {
+        close(pSocket);
+        return;
+    }
+
+    if( scenario.errorCode != 0 )
+    {
+        const int size = snprintf(header,sizeof(header),"HTTP/1.1 %d Stand In\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",scenario.errorCode);
+        Send(pSocket,header,size,0);
+        close(pSocket);
+        return;
+    }
+
+    const auto found = mPaths.find(request.substr(pathStart + 1,pathEnd - pathStart - 1));
+    HTTPCache::Entry entry;
+    FILE* body = found != mPaths.end() ? mFixtures.Open(found->second,entry) : nullptr;
+    if( body == nullptr )
+    {
+        static const char notFound[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        Send(pSocket,notFound,sizeof(notFound) - 1,0);
+        close(pSocket);
+        return;
+    }
+
+    // So revalidation can be tried too.
+    if( entry.etag.size() > 0 && strcasestr(request.c_str(),("If-None-Match: " + entry.etag).c_str()) != nullptr )
+    {
+        const int size = snprintf(header,sizeof(header),"HTTP/1.1 304 Not Modified\r\nETag: %s\r\nConnection: close\r\n\r\n",entry.etag.c_str());
+        Send(pSocket,header,size,0);
+        fclose(body);
+        close(pSocket);
+        return;
+    }
+
+    int size = snprintf(header,sizeof(header),"HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %llu\r\nConnection: close\r\n",(unsigned long long)entry.size);
+    if( entry.etag.size() > 0 )
+        size += snprintf(header + size,sizeof(header) - size,"ETag: %s\r\n",entry.etag.c_str());
+    if( entry.lastModified.size() > 0 )
+        size += snprintf(header + size,sizeof(header) - size,"Last-Modified: %s\r\n",entry.lastModified.c_str());
+    size += snprintf(header + size,sizeof(header) - size,"\r\n");
+
+    bool ok = Send(pSocket,header,size,0);
+    uint64_t toSend = (uint64_t)(entry.size * std::clamp(scenario.truncate,0.0f,1.0f));
+    while( ok && toSend > 0 )
+    {
+        const size_t read = fread(buffer,1,(size_t)std::min<uint64_t>(toSend,sizeof(buffer)),body);
+        ok = read > 0 && Send(pSocket,buffer,read,scenario.bytesPerSecond);
+        toSend -= read;
+    }
+
+    fclose(body);
+    close(pSocket);
+}
+
+bool HTTPStandIn::Send(int pSocket,const char* pData,size_t pSize,uint32_t pBytesPerSecond)
+{
+    while( pSize > 0 && mRunning )
+    {
+        const size_t chunk = std::min(pSize,(size_t)HTTP_STAND_IN_CHUNK_SIZE);
+        const ssize_t sent = send(pSocket,pData,chunk,MSG_NOSIGNAL);
+        if( sent <= 0 )
+            return false;
+
+        pData += sent;
+        pSize -= sent;
+        if( pBytesPerSecond > 0 && Sleep((uint32_t)(((uint64_t)sent * 1000) / pBytesPerSecond)) == false )
+            return false;
+    }
+    return pSize == 0;
+}
+
+bool HTTPStandIn::Sleep(uint32_t pMS)
+{
+    const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(pMS);
+    while( mRunning && std::chrono::steady_clock::now() < end )
+    {
+        std::this_thread::sleep_for(std::min(std::chrono::duration_cast<std::chrono::milliseconds>(end - std::chrono::steady_clock::now()),std::chrono::milliseconds(POLL_MS)));
+    }
+    return mRunning;
+}
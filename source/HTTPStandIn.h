@@ -0,0 +1,100 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef HTTP_STAND_IN_H
+#define HTTP_STAND_IN_H
+
+#include "HTTPCache.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#define HTTP_STAND_IN_CHUNK_SIZE    4096    // Bytes per send, and per throttle step.
+
+/**
+ * @brief A plain HTTP server on the loopback that replays recorded responses, so the data sources can be
+ * tried and timed without the real servers. The recordings are an HTTPCache folder, a live run with
+ * --cache <folder> records them. Responses are matched on the path and query, the host is ignored.
+ * The Scenario makes it slow, throttled, cut short or failing. Each connection gets its own thread,
+ * every response closes its connection.
+ */
+class HTTPStandIn
+{
+public:
+    struct Scenario
+    {
+        std::string name = "clean";
+        uint32_t latencyMS = 0;         //!< Before the response starts.
+        uint32_t bytesPerSecond = 0;    //!< Zero for as fast as the loopback goes.
+        float truncate = 1.0f;          //!< Fraction of the body sent before the connection is closed. Content-Length is always the whole body.
+        int errorCode = 0;              //!< Non zero to answer every request with this status and no body.
+    };
+
+    /**
+     * @brief The scenarios the fetch benchmark runs, --http-scenario picks one by name.
+     */
+    static std::vector<Scenario> GetStandardScenarios();
+
+    HTTPStandIn(const std::string& pFixtureFolder);
+    ~HTTPStandIn();
+
+    /**
+     * @brief Starts listening on a free loopback port. Returns false if there are no fixtures or the socket failed.
+     */
+    bool Start(const Scenario& pScenario);
+    void Stop();//!< Closes the listening socket and waits for connections in progress, which are cut short.
+
+    void SetScenario(const Scenario& pScenario);//!< Safe while running, used from the next request.
+    std::string GetBaseURL()const;              //!< http://127.0.0.1:<port>
+    const std::vector<std::string>& GetURLs()const{return mURLs;}  //!< The original URLs of the fixtures.
+    uint32_t GetRequestCount()const{return mRequests;}
+
+    static std::string GetPath(const std::string& pURL);//!< The path and query, what requests are matched on.
+
+private:
+    HTTPCache mFixtures;
+    std::vector<std::string> mURLs;
+    std::map<std::string,std::string> mPaths;   //!< Path and query to the original URL.
+    int mListen = -1;
+    uint16_t mPort = 0;
+    std::thread mAcceptThread;
+    std::atomic<bool> mRunning{false};
+    std::atomic<uint32_t> mRequests{0};
+
+    struct Connection
+    {
+        std::thread thread;
+        std::atomic<bool> done{false};  //!< Set as Serve returns, so the thread can be joined without waiting.
+    };
+
+    mutable std::mutex mLock;           //!< Guards mScenario.
+    Scenario mScenario;
+    std::vector<std::unique_ptr<Connection>> mConnections; //!< Only touched by the accept thread, and by Stop once it has gone.
+
+    void AcceptLoop();
+    void Reap();//!< Joins the connections that have finished, so a long run does not collect threads.
+    void Serve(int pSocket);
+    bool Send(int pSocket,const char* pData,size_t pSize,uint32_t pBytesPerSecond);
+    bool Sleep(uint32_t pMS);//!< Returns false if stopped while sleeping.
+};
+
+#endif //#ifndef HTTP_STAND_IN_H
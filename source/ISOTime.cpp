@@ -0,0 +1,189 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "ISOTime.h"
+
+#include <algorithm>
+
+namespace isotime{
+
+static bool ReadDigits(std::string_view pText,size_t pPos,int pCount,int& rValue)
+{
+    if( pPos + pCount > pText.size() )
+        return false;
+
+    rValue = 0;
+    for( int n = 0 ; n < pCount ; n++ )
+    {
+        const char c = pText[pPos + n];
+        if( c < '0' || c > '9' )
+            return false;
+        rValue = (rValue * 10) + (c - '0');
+    }
+    return true;
+}
+
+// Days since 1970-01-01 in the proleptic Gregorian calendar, Howard Hinnant's days_from_civil.
+static int64_t DaysFromCivil(int64_t pYear,int pMonth,int pDay)
+{
+    pYear -= pMonth <= 2;
+    const int64_t era = (pYear >= 0 ? pYear : pYear - 399) / 400;
+    const int64_t yearOfEra = pYear - era * 400;
+    const int64_t dayOfYear = (153 * (pMonth + (pMonth > 2 ? -3 : 9)) + 2) / 5 + pDay - 1;
+    const int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+static bool GetIsLeapYear(int64_t pYear)
+{
+    return (pYear % 4 == 0 && pYear % 100 != 0) || pYear % 400 == 0;
+}
+
+static int GetDaysInMonth(int64_t pYear,int pMonth)
+{
+    static const int days[12] = {31,28,31,30,31,30,31,31,30,31,30,31};
+    return pMonth == 2 && GetIsLeapYear(pYear) ? 29 : days[pMonth - 1];
+}
+
+bool Parse(std::string_view pText,int64_t& rSeconds,int32_t pLocalOffset)
+{
+    int year,month,day,hour,minute,second = 0;
+    if( ReadDigits(pText,0,4,year) == false || pText.size() < 16 || pText[4] != '-' ||
+        ReadDigits(pText,5,2,month) == false || pText[7] != '-' ||
+        ReadDigits(pText,8,2,day) == false || (pText[10] != 'T' && pText[10] != ' ') ||
+        ReadDigits(pText,11,2,hour) == false || pText[13] != ':' ||
+        ReadDigits(pText,14,2,minute) == false )
+    {
+        return false;
+    }
+
+    size_t pos = 16;
+    if( pos < pText.size() && pText[pos] == ':' )
+    {
+        if( ReadDigits(pText,pos + 1,2,second) == false )
+            return false;
+        pos += 3;
+
+        if( pos < pText.size() && pText[pos] == '.' )
+        {// Fractions of a second are dropped.
+            pos++;
+            while( pos < pText.size() && pText[pos] >= '0' && pText[pos] <= '9' )
+                pos++;
+        }
+    }
+
+    if( month < 1 || month > 12 || day < 1 || day > GetDaysInMonth(year,month) || hour > 23 || minute > 59 || second > 60 )
+        return false;
+
+    int32_t offset = pLocalOffset;
+    if( pos < pText.size() )
+    {
+        const char zone = pText[pos];
+        int zoneHours,zoneMinutes;
+        if( zone == 'Z' && pos + 1 == pText.size() )
+        {
+            offset = 0;
+        }
+        else if( (zone == '+' || zone == '-') && ReadDigits(pText,pos + 1,2,zoneHours) )
+        {
+            pos += 3;
+            if( pos < pText.size() && pText[pos] == ':' )
+                pos++;
+
+            if( ReadDigits(pText,pos,2,zoneMinutes) == false || pos + 2 != pText.size() || zoneHours > 23 || zoneMinutes > 59 )
+                return false;
+
+            offset = (zoneHours * 3600) + (zoneMinutes * 60);
+            if( zone == '-' )
+                offset = -offset;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // A leap second is taken as the first second of the next minute.
+    rSeconds = (DaysFromCivil(year,month,day) * 86400) + (hour * 3600) + (minute * 60) + second - offset;
+    return true;
+}
+
+void ToTM(int64_t pSeconds,int32_t pOffset,tm& rTime)
+{
+    const int64_t local = pSeconds + pOffset;
+    int64_t days = local / 86400;
+    int64_t secondOfDay = local % 86400;
+    if( secondOfDay < 0 )
+    {
+        secondOfDay += 86400;
+        days--;
+    }
+
+    // Howard Hinnant's civil_from_days.
+    const int64_t z = days + 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const int64_t dayOfEra = z - era * 146097;
+    const int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const int64_t mp = (5 * dayOfYear + 2) / 153;
+    const int day = (int)(dayOfYear - (153 * mp + 2) / 5 + 1);
+    const int month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    const int64_t year = yearOfEra + era * 400 + (month <= 2);
+
+    rTime = tm();
+    rTime.tm_year = (int)(year - 1900);
+    rTime.tm_mon = month - 1;
+    rTime.tm_mday = day;
+    rTime.tm_hour = (int)(secondOfDay / 3600);
+    rTime.tm_min = (int)((secondOfDay / 60) % 60);
+    rTime.tm_sec = (int)(secondOfDay % 60);
+    rTime.tm_wday = (int)((days % 7 + 11) % 7);// 1970-01-01 was a Thursday.
+    rTime.tm_yday = (int)(days - DaysFromCivil(year,1,1));
+    rTime.tm_isdst = -1;
+}
+
+int32_t GetUTCOffset(std::time_t pWhen)
+{
+    tm local;
+    localtime_r(&pWhen,&local);
+    return (int32_t)local.tm_gmtoff;
+}
+
+std::time_t GetNextOffsetChange(std::time_t pFrom,std::time_t pTo)
+{
+    // A day at a time finds the day it changes in, halving then finds the second. About twenty lookups for a week.
+    const int32_t offset = GetUTCOffset(pFrom);
+    for( std::time_t from = pFrom ; from < pTo ; )
+    {
+        std::time_t to = std::min(from + (24*60*60),pTo);
+        if( GetUTCOffset(to) != offset )
+        {
+            while( to - from > 1 )
+            {
+                const std::time_t middle = from + ((to - from) / 2);
+                if( GetUTCOffset(middle) == offset )
+                    from = middle;
+                else
+                    to = middle;
+            }
+            return to;
+        }
+        from = to;
+    }
+    return pTo;
+}
+
+};//namespace isotime
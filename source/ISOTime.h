@@ -0,0 +1,55 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef ISO_TIME_H
+#define ISO_TIME_H
+
+#include <string_view>
+#include <cstdint>
+#include <ctime>
+
+/**
+ * @brief Fixed format ISO-8601 timestamps, YYYY-MM-DDTHH:MM[:SS[.fff]][Z|+hh:mm|-hh:mm|+hhmm], to and from epoch seconds.
+ * Pure arithmetic on string_view, no allocation, no locale and no time zone database.
+ * A timestamp without a zone is local time, the caller passes the UTC offset in so it is looked up once, not per call.
+ */
+namespace isotime{
+
+/**
+ * @param pLocalOffset Seconds east of UTC, used when the text has no zone. See GetUTCOffset.
+ * @return False if the text is not a timestamp, rSeconds is then untouched.
+ */
+bool Parse(std::string_view pText,int64_t& rSeconds,int32_t pLocalOffset = 0);
+
+/**
+ * @brief Epoch seconds to the calendar at pOffset seconds east of UTC. tm_isdst is -1, tm_wday and tm_yday are filled in.
+ */
+void ToTM(int64_t pSeconds,int32_t pOffset,tm& rTime);
+
+/**
+ * @brief This machine's offset from UTC at pWhen, in seconds east. This is the one call that reads the time zone database.
+ */
+int32_t GetUTCOffset(std::time_t pWhen);
+
+/**
+ * @brief The first second after pFrom where GetUTCOffset differs from the one at pFrom, or pTo if it does not change before then.
+ * So an offset looked up once can be used for a list of times until the clocks change, then looked up again.
+ */
+std::time_t GetNextOffsetChange(std::time_t pFrom,std::time_t pTo);
+
+};//namespace isotime
+
+#endif //#ifndef ISO_TIME_H
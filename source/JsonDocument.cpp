@@ -0,0 +1,484 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "JsonDocument.h"
+
+#include <algorithm>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+
+static const JsonNode NULL_NODE;
+
+static bool IsDigit(char pChar)
+{
+    return pChar >= '0' && pChar <= '9';
+}
+
+static bool ReadHex(const char* pText,uint32_t& rValue)
+{
+    rValue = 0;
+    for( int n = 0 ; n < 4 ; n++ )
+    {
+        const char c = pText[n];
+        if( c >= '0' && c <= '9' )
+            rValue = (rValue << 4) | (c - '0');
+        else if( c >= 'a' && c <= 'f' )
+            rValue = (rValue << 4) | (c - 'a' + 10);
+        else if( c >= 'A' && c <= 'F' )
+            rValue = (rValue << 4) | (c - 'A' + 10);
+        else
+            return false;
+    }
+    return true;
+}
+
+static char* WriteUTF8(char* pOut,uint32_t pCode)
+{
+    if( pCode < 0x80 )
+    {
+        *pOut++ = (char)pCode;
+    }
+    else if( pCode < 0x800 )
+    {
+        *pOut++ = (char)(0xC0 | (pCode >> 6));
+        *pOut++ = (char)(0x80 | (pCode & 0x3F));
+    }
+    else if( pCode < 0x10000 )
+    {
+        *pOut++ = (char)(0xE0 | (pCode >> 12));
+        *pOut++ = (char)(0x80 | ((pCode >> 6) & 0x3F));
+        *pOut++ = (char)(0x80 | (pCode & 0x3F));
+    }
+    else
+    {
+        *pOut++ = (char)(0xF0 | (pCode >> 18));
+        *pOut++ = (char)(0x80 | ((pCode >> 12) & 0x3F));
+        *pOut++ = (char)(0x80 | ((pCode >> 6) & 0x3F));
+        *pOut++ = (char)(0x80 | (pCode & 0x3F));
+    }
+    return pOut;
+}
+
+const JsonNode& JsonNode::operator[](std::string_view pKey)const
+{
+    if( mType == JSON_OBJECT )
+    {
+        for( const JsonNode& member : *this )
+        {
+            if( member.GetKey() == pKey )
+                return member;
+        }
+    }
+    return NULL_NODE;
+}
+
+const JsonNode& JsonNode::operator[](size_t pIndex)const
+{
+    return pIndex < GetCount() ? mChildren[pIndex] : NULL_NODE;
+}
+
+bool JsonDocument::Parse(std::string_view pSource)
+{
+    // Keep the first block for the next document, most fit in one.
+    if( mBlocks.size() > 1 )
+        mBlocks.resize(1);
+    if( mBlocks.size() > 0 )
+        mBlocks[0].used = 0;
+
+    mScratch.clear();
+    mRoot = JsonNode();
+    mError.clear();
+    mStart = pSource.data();
+    mPos = mStart;
+    mEnd = mStart + pSource.size();
+
+    if( ParseValue(mRoot,0) == false )
+    {
+        mRoot = JsonNode();
+        return false;
+    }
+
+    if( SkipSpace() )
+    {
+        mRoot = JsonNode();
+        return SetError("more after the end of the document");
+    }
+    return true;
+}
+
+size_t JsonDocument::GetArenaSize()const
+{
+    size_t size = 0;
+    for( const Block& b : mBlocks )
+    {
+        size += b.used;
+    }
+    return size;
+}
+
+void* JsonDocument::Allocate(size_t pSize)
+{
+    // Everything is rounded up to keep the nodes aligned.
+    pSize = (pSize + alignof(JsonNode) - 1) & ~(alignof(JsonNode) - 1);
+    if( mBlocks.size() == 0 || mBlocks.back().used + pSize > mBlocks.back().size )
+    {
+        Block block;
+        block.size = std::max(pSize,(size_t)JSON_DOCUMENT_BLOCK_SIZE);
+        block.data.reset(new char[block.size]);
+        mBlocks.push_back(std::move(block));
+    }
+
+    Block& block = mBlocks.back();
+    void* memory = block.data.get() + block.used;
+    block.used += pSize;
+    return memory;
+}
+
+bool JsonDocument::ParseValue(JsonNode& rNode,int pDepth)
+{
+    if( SkipSpace() == false )
+        return SetError("the document ended early");
+
+    switch( *mPos )
+    {
+    case '{':
+        return ParseContainer(rNode,pDepth,true);
+
+    case '[':
+        return ParseContainer(rNode,pDepth,false);
+
+    case '"':
+        rNode.mType = JsonNode::JSON_STRING;
+        return ParseString(rNode.mText,rNode.mSize);
+
+    case 't':
+        rNode.mType = JsonNode::JSON_BOOL;
+        rNode.mBool = true;
+        return ParseLiteral("true");
+
+    case 'f':
+        rNode.mType = JsonNode::JSON_BOOL;
+        rNode.mBool = false;
+        return ParseLiteral("false");
+
+    case 'n':
+        rNode.mType = JsonNode::JSON_NULL;
+        return ParseLiteral("null");
+
+    default:
+        return ParseNumber(rNode);
+    }
+}
+
+bool JsonDocument::ParseContainer(JsonNode& rNode,int pDepth,bool pObject)
+{
+    if( pDepth >= JSON_DOCUMENT_MAX_DEPTH )
+        return SetError("nested too deep");
+
+    const char close = pObject ? '}' : ']';
+    const size_t first = mScratch.size();
+    mPos++;
+
+    if( SkipSpace() && *mPos == close )
+    {
+        mPos++;
+    }
+    else
+    {
+        for(;;)
+        {
+            // Into a local, the children's children go on the scratch too and may move it.
+            JsonNode child;
+            if( pObject )
+            {
+                if( SkipSpace() == false || *mPos != '"' )
+                    return SetError("expected a key");
+                if( ParseString(child.mKey,child.mKeySize) == false )
+                    return false;
+                if( SkipSpace() == false || *mPos != ':' )
+                    return SetError("expected a :");
+                mPos++;
+            }
+
+            if( ParseValue(child,pDepth + 1) == false )
+                return false;
+            mScratch.push_back(child);
+
+            if( SkipSpace() == false )
+                return SetError("the document ended early");
+            if( *mPos == ',' )
+            {
+                mPos++;
+            }
+            else if( *mPos == close )
+            {
+                mPos++;
+                break;
+            }
+            else
+            {
+                return SetError(pObject ? "expected a , or }" : "expected a , or ]");
+            }
+        }
+    }
+
+    // Now the count is known the children can go in the arena, next to each other.
+    const size_t count = mScratch.size() - first;
+    rNode.mType = pObject ? JsonNode::JSON_OBJECT : JsonNode::JSON_ARRAY;
+    rNode.mSize = (uint32_t)count;
+    if( count > 0 )
+    {
+        JsonNode* children = (JsonNode*)Allocate(count * sizeof(JsonNode));
+        std::uninitialized_copy(mScratch.begin() + first,mScratch.end(),children);
+        rNode.mChildren = children;
+    }
+    mScratch.resize(first);
+    return true;
+}
+
+bool JsonDocument::ParseString(const char*& rText,uint32_t& rSize)
+{
+    const char* start = ++mPos;
+    bool escaped = false;
+    while( mPos < mEnd && *mPos != '"' )
+    {
+        if( (unsigned char)*mPos < 0x20 )
+            return SetError("control character in a string");
+
+        if( *mPos == '\\' )
+        {
+            escaped = true;
+            mPos++;
+        }
+        mPos++;
+    }
+
+    if( mPos >= mEnd )
+        return SetError("unterminated string");
+
+    const char* end = mPos++;
+    if( escaped == false )
+    {// Most are like this, nothing to copy.
+        rText = start;
+        rSize = (uint32_t)(end - start);
+        return true;
+    }
+
+    // Never longer than the escaped text, so that much is enough.
+    char* const text = (char*)Allocate(end - start);
+    char* out = text;
+    uint32_t highSurrogate = 0;
+    for( const char* c = start ; c < end ; c++ )
+    {
+        if( *c != '\\' )
+        {
+            if( highSurrogate )
+            {
+                out = WriteUTF8(out,0xFFFD);
+                highSurrogate = 0;
+            }
+            *out++ = *c;
+            continue;
+        }
+
+        c++;
+        if( *c == 'u' )
+        {
+            uint32_t code;
+            if( c + 4 >= end || ReadHex(c + 1,code) == false )
+                return SetError("bad \\u escape in a string");
+            c += 4;
+
+            if( code >= 0xD800 && code <= 0xDBFF )
+            {// First half of a pair, wait for the second.
+                if( highSurrogate )
+                    out = WriteUTF8(out,0xFFFD);
+                highSurrogate = code;
+            }
+            else if( code >= 0xDC00 && code <= 0xDFFF )
+            {
+                out = WriteUTF8(out,highSurrogate ? 0x10000 + ((highSurrogate - 0xD800) << 10) + (code - 0xDC00) : 0xFFFD);
+                highSurrogate = 0;
+            }
+            else
+            {
+                if( highSurrogate )
+                    out = WriteUTF8(out,0xFFFD);
+                highSurrogate = 0;
+                out = WriteUTF8(out,code);
+            }
+            continue;
+        }
+
+        if( highSurrogate )
+        {
+            out = WriteUTF8(out,0xFFFD);
+            highSurrogate = 0;
+        }
+
+        switch( *c )
+        {
+        case '"':
+        case '\\':
+        case '/':
+            *out++ = *c;
+            break;
+        case 'b':
+            *out++ = '\b';
+            break;
+        case 'f':
+            *out++ = '\f';
+            break;
+        case 'n':
+            *out++ = '\n';
+            break;
+        case 'r':
+            *out++ = '\r';
+            break;
+        case 't':
+            *out++ = '\t';
+            break;
+        default:
+            return SetError("bad escape in a string");
+        }
+    }
+
+    if( highSurrogate )
+        out = WriteUTF8(out,0xFFFD);
+
+    rText = text;
+    rSize = (uint32_t)(out - text);
+    return true;
+}
+
+bool JsonDocument::ParseNumber(JsonNode& rNode)
+{
+    // The JSON grammar, as JsonStream takes it. No + or . to start and no leading zeros, strtod would take those.
+    const char* start = mPos;
+    if( mPos < mEnd && *mPos == '-' )
+        mPos++;
+
+    if( mPos >= mEnd || IsDigit(*mPos) == false )
+    {
+        mPos = start;
+        return SetError(*start == '-' ? "bad number" : "unexpected character");
+    }
+
+    if( *mPos == '0' )
+    {
+        mPos++;
+        if( mPos < mEnd && IsDigit(*mPos) )
+        {
+            mPos = start;
+            return SetError("bad number, leading zero");
+        }
+    }
+    else
+    {
+        SkipDigits();
+    }
+
+    if( mPos < mEnd && *mPos == '.' )
+    {
+        mPos++;
+        if( SkipDigits() == false )
+        {
+            mPos = start;
+            return SetError("bad number");
+        }
+    }
+
+    if( mPos < mEnd && (*mPos == 'e' || *mPos == 'E') )
+    {
+        mPos++;
+        if( mPos < mEnd && (*mPos == '+' || *mPos == '-') )
+            mPos++;
+        if( SkipDigits() == false )
+        {
+            mPos = start;
+            return SetError("bad number");
+        }
+    }
+
+    const size_t size = mPos - start;
+
+    // The source need not be null terminated, so strtod gets a copy.
+    char buffer[64];
+    std::string longer;
+    const char* text = buffer;
+    if( size < sizeof(buffer) )
+    {
+        memcpy(buffer,start,size);
+        buffer[size] = 0;
+    }
+    else
+    {
+        longer.assign(start,size);
+        text = longer.c_str();
+    }
+
+    char* end;
+    rNode.mNumber = std::strtod(text,&end);
+    if( end != text + size )
+    {
+        mPos = start;
+        return SetError("bad number");
+    }
+
+    rNode.mType = JsonNode::JSON_NUMBER;
+    rNode.mText = start;
+    rNode.mSize = (uint32_t)size;
+    return true;
+}
+
+bool JsonDocument::ParseLiteral(const char* pLiteral)
+{
+    const size_t size = strlen(pLiteral);
+    if( (size_t)(mEnd - mPos) < size || memcmp(mPos,pLiteral,size) != 0 )
+        return SetError("unexpected character");
+
+    mPos += size;
+    return true;
+}
+
+bool JsonDocument::SkipDigits()
+{
+    const char* start = mPos;
+    while( mPos < mEnd && IsDigit(*mPos) )
+    {
+        mPos++;
+    }
+    return mPos > start;
+}
+
+bool JsonDocument::SkipSpace()
+{
+    while( mPos < mEnd && (*mPos == ' ' || *mPos == '\t' || *mPos == '\n' || *mPos == '\r') )
+    {
+        mPos++;
+    }
+    return mPos < mEnd;
+}
+
+bool JsonDocument::SetError(const char* pWhat)
+{
+    if( mError.size() == 0 )
+    {
+        mError = std::string(pWhat) + " at byte " + std::to_string(mPos - mStart);
+    }
+    return false;
+}
@@ -0,0 +1,138 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef JSON_DOCUMENT_H
+#define JSON_DOCUMENT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#define JSON_DOCUMENT_BLOCK_SIZE    (64 * 1024) // Bytes per arena block, a big document takes a few.
+#define JSON_DOCUMENT_MAX_DEPTH     256         // Deeper than any document we fetch, stops a bad one using up the stack.
+
+/**
+ * @brief One value in a JsonDocument. Only ever handed out by reference, they live in the document's arena.
+ * Asking for a key or index that is not there, or asking the wrong type, gives a null node or the default,
+ * so a lookup several levels deep needs no checks on the way.
+ */
+class JsonNode
+{
+public:
+    enum Type : uint8_t
+    {
+        JSON_NULL,
+        JSON_BOOL,
+        JSON_NUMBER,
+        JSON_STRING,
+        JSON_ARRAY,
+        JSON_OBJECT
+    };
+
+    JsonNode():mText(nullptr){}
+
+    Type GetType()const{return mType;}
+    bool GetIsNull()const{return mType == JSON_NULL;}
+    bool GetIsArray()const{return mType == JSON_ARRAY;}
+    bool GetIsObject()const{return mType == JSON_OBJECT;}
+
+    size_t GetCount()const{return GetIsArray() || GetIsObject() ? mSize : 0;}  //!< Elements of an array, members of an object.
+    std::string_view GetKey()const{return std::string_view(mKey,mKeySize);}  //!< Empty unless it is a member of an object.
+
+    /**
+     * @brief A string's value, or a number as it was written, for ids that don't fit a double. Empty for anything else.
+     * Points into the source the document was parsed from, or the arena if it had escapes in.
+     */
+    std::string_view GetString()const{return mType == JSON_STRING || mType == JSON_NUMBER ? std::string_view(mText,mSize) : std::string_view();}
+    double GetDouble(double pDefault = 0.0)const{return mType == JSON_NUMBER ? mNumber : pDefault;}
+    int GetInt(int pDefault = 0)const{return mType == JSON_NUMBER ? (int)mNumber : pDefault;}
+    bool GetBool(bool pDefault = false)const{return mType == JSON_BOOL ? mBool : pDefault;}
+
+    const JsonNode& operator[](std::string_view pKey)const;//!< The first member with that key, looked for in order.
+    const JsonNode& operator[](size_t pIndex)const;
+
+    const JsonNode* begin()const{return GetCount() > 0 ? mChildren : nullptr;}//!< The elements or members, so a range for works on both.
+    const JsonNode* end()const{return begin() + GetCount();}
+
+private:
+    friend class JsonDocument;
+
+    Type mType = JSON_NULL;
+    bool mBool = false;
+    uint32_t mKeySize = 0;
+    uint32_t mSize = 0;             //!< Of the text, or the number of children.
+    const char* mKey = nullptr;
+    union
+    {
+        const char* mText;          //!< Strings and numbers.
+        const JsonNode* mChildren;  //!< Arrays and objects, in the arena.
+    };
+    double mNumber = 0.0;
+};
+
+/**
+ * @brief A whole JSON document parsed in one go, for when the values are wanted in any order rather than as they arrive.
+ * Every node lives in one arena of large blocks, so parsing does a handful of allocations, not one per value,
+ * and it is all freed together. Strings are views into the source, only those with escapes are copied, into the arena.
+ * So the source must outlive the document, and the nodes are only valid until the next Parse.
+ * For streaming a download as it arrives, and keeping only a few fields, use JsonStream.
+ */
+class JsonDocument
+{
+public:
+    JsonDocument() = default;
+    JsonDocument(const JsonDocument&) = delete;
+    JsonDocument& operator=(const JsonDocument&) = delete;
+
+    /**
+     * @brief Parses pSource, throwing away the last document. Returns false on bad JSON, GetError says why.
+     */
+    bool Parse(std::string_view pSource);
+
+    const JsonNode& GetRoot()const{return mRoot;}
+    const std::string& GetError()const{return mError;}
+    size_t GetArenaSize()const;//!< Bytes used by the nodes and unescaped strings.
+
+private:
+    struct Block
+    {
+        std::unique_ptr<char[]> data;
+        size_t size = 0;
+        size_t used = 0;
+    };
+
+    std::vector<Block> mBlocks;
+    std::vector<JsonNode> mScratch; //!< Children of the open containers, moved into the arena as each one closes.
+    JsonNode mRoot;
+    const char* mStart = nullptr;
+    const char* mPos = nullptr;
+    const char* mEnd = nullptr;
+    std::string mError;
+
+    void* Allocate(size_t pSize);
+    bool ParseValue(JsonNode& rNode,int pDepth);
+    bool ParseContainer(JsonNode& rNode,int pDepth,bool pObject);
+    bool ParseString(const char*& rText,uint32_t& rSize);
+    bool ParseNumber(JsonNode& rNode);
+    bool ParseLiteral(const char* pLiteral);
+    bool SkipDigits();//!< False if there were none.
+    bool SkipSpace();//!< False at the end of the source.
+    bool SetError(const char* pWhat);
+};
+
+#endif //#ifndef JSON_DOCUMENT_H
@@ -0,0 +1,217 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#include "JsonPath.h"
+
+#include <iostream>
+#include <cstdlib>
+
+JsonPath::JsonPath(const std::string& pQuery,OnRecord pOnRecord):mOnRecord(pOnRecord)
+{
+    mOK = Parse(pQuery);
+    if( mOK == false )
+    {
+        std::cerr << "JsonPath, bad query [" << pQuery << "], nothing will match\n";
+        mSteps.clear();
+        mFields.clear();
+    }
+    mValues.resize(mFields.size());
+    mStack.reserve(16);
+}
+
+bool JsonPath::OnObjectBegin()
+{
+    const int matched = StartValue();
+    mStack.push_back({matched,false});
+    if( matched == (int)mSteps.size() && mFields.size() > 0 )
+    {// A record, start with every field missing.
+        for( auto& v : mValues )
+            v.clear();
+    }
+    return true;
+}
+
+bool JsonPath::OnObjectEnd()
+{
+    const bool isRecord = mStack.back().matched == (int)mSteps.size() && mFields.size() > 0;
+    mStack.pop_back();
+    if( isRecord )
+    {
+        mRecordCount++;
+        return mOnRecord == nullptr || mOnRecord(mValues);
+    }
+    return true;
+}
+
+bool JsonPath::OnArrayBegin()
+{
+    mStack.push_back({StartValue(),true});
+    return true;
+}
+
+bool JsonPath::OnArrayEnd()
+{
+    mStack.pop_back();
+    return true;
+}
+
+bool JsonPath::OnKey(std::string_view pKey)
+{
+    mKey = pKey;
+    return true;
+}
+
+bool JsonPath::OnString(std::string_view pValue)
+{
+    return OnScalar(pValue);
+}
+
+bool JsonPath::OnNumber(double pValue,std::string_view pText)
+{
+    return OnScalar(pText);
+}
+
+bool JsonPath::OnBool(bool pValue)
+{
+    return OnScalar(pValue ? "true" : "false");
+}
+
+bool JsonPath::OnNull()
+{
+    return OnScalar("null");
+}
+
+bool JsonPath::Parse(const std::string& pQuery)
+{
+    std::string_view query(pQuery);
+
+    // The field set, if there is one, is always last.
+    const size_t brace = query.find('{');
+    if( brace != std::string_view::npos )
+    {
+        if( query.back() != '}' || (brace > 0 && query[brace-1] != '.') )
+            return false;
+
+        std::string_view fields = query.substr(brace + 1,query.size() - brace - 2);
+        while( fields.size() > 0 )
+        {
+            const size_t comma = fields.find(',');
+            std::string_view field = fields.substr(0,comma);
+            while( field.size() > 0 && field.front() == ' ' )
+                field.remove_prefix(1);
+            while( field.size() > 0 && field.back() == ' ' )
+                field.remove_suffix(1);
+
+            if( field.size() == 0 )
+                return false;
+            mFields.emplace_back(field);
+
+            if( comma == std::string_view::npos )
+                break;
+            fields.remove_prefix(comma + 1);
+        }
+
+        if( mFields.size() == 0 )
+            return false;
+        query = query.substr(0,brace > 0 ? brace - 1 : 0);
+    }
+
+    while( query.size() > 0 )
+    {
+        const size_t dot = query.find('.');
+        std::string_view part = query.substr(0,dot);
+        query = dot == std::string_view::npos ? std::string_view() : query.substr(dot + 1);
+        if( dot != std::string_view::npos && query.size() == 0 )
+            return false;// Ends in a dot.
+
+        const size_t bracket = part.find('[');
+        if( bracket > 0 )
+        {
+            Step step;
+            step.key = part.substr(0,bracket);
+            mSteps.push_back(step);
+        }
+
+        for( part = part.substr(bracket == std::string_view::npos ? part.size() : bracket) ; part.size() > 0 ; )
+        {
+            const size_t close = part.find(']');
+            if( part.front() != '[' || close == std::string_view::npos || close < 2 )
+                return false;
+
+            Step step;
+            const std::string index(part.substr(1,close - 1));
+            if( index != "*" )
+            {
+                char* end = nullptr;
+                step.index = std::strtoll(index.c_str(),&end,10);
+                if( *end != 0 || step.index < 0 )
+                    return false;
+            }
+            mSteps.push_back(step);
+            part.remove_prefix(close + 1);
+        }
+    }
+
+    // A path to a single value, the last key is the field.
+    if( mFields.size() == 0 )
+    {
+        if( mSteps.size() == 0 || mSteps.back().key.size() == 0 )
+            return false;
+
+        mFields.push_back(mSteps.back().key);
+        mSteps.pop_back();
+    }
+    return true;
+}
+
+int JsonPath::StartValue()
+{
+    if( mStack.size() == 0 )
+        return 0;// The root.
+
+    Frame& parent = mStack.back();
+    const uint32_t index = parent.index++;
+    if( parent.matched < 0 || parent.matched >= (int)mSteps.size() )
+        return -1;// Off the path, or inside a record where only direct members count.
+
+    const Step& step = mSteps[parent.matched];
+    if( parent.isArray )
+        return step.key.size() == 0 && (step.index < 0 || step.index == index) ? parent.matched + 1 : -1;
+
+    return step.key.size() > 0 && step.key == mKey ? parent.matched + 1 : -1;
+}
+
+bool JsonPath::OnScalar(std::string_view pValue)
+{
+    if( mStack.size() == 0 )
+        return true;
+
+    const Frame& parent = mStack.back();
+    StartValue();
+    if( parent.isArray == false && parent.matched == (int)mSteps.size() )
+    {
+        for( size_t n = 0 ; n < mFields.size() ; n++ )
+        {
+            if( mFields[n] == mKey )
+            {
+                mValues[n] = pValue;
+                break;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,89 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef JSON_PATH_H
+#define JSON_PATH_H
+
+#include "JsonStream.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+/**
+ * @brief Pulls fields out of a document as it streams through a JsonStream, without building a DOM.
+ * The query is a path to the objects wanted then the fields to take from each, for example
+ *  features[*].properties.{Name,Country,Id}
+ * A key follows a member of an object, [*] any element of an array and [n] just element n.
+ * The fields are direct members of the object with a string, number, bool or null value. Numbers are
+ * passed as they were written, bools as true or false. A path ending in a key, a.b.c, is the same as a.b.{c}.
+ */
+class JsonPath : public JsonStream::Handler
+{
+public:
+    /**
+     * @brief Called at the end of each object the path matched, pValues are in the order the fields were asked for.
+     * A field the object did not have is empty. Return false to stop reading.
+     */
+    typedef std::function<bool(const std::vector<std::string>& pValues)> OnRecord;
+
+    JsonPath(const std::string& pQuery,OnRecord pOnRecord);
+
+    bool GetOK()const{return mOK;}                          //!< False if the query would not parse, nothing will match.
+    uint32_t GetRecordCount()const{return mRecordCount;}    //!< Objects the path matched so far.
+
+    bool OnObjectBegin()override;
+    bool OnObjectEnd()override;
+    bool OnArrayBegin()override;
+    bool OnArrayEnd()override;
+    bool OnKey(std::string_view pKey)override;
+    bool OnString(std::string_view pValue)override;
+    bool OnNumber(double pValue,std::string_view pText)override;
+    bool OnBool(bool pValue)override;
+    bool OnNull()override;
+
+private:
+    struct Step
+    {
+        std::string key;        //!< Empty for an array step.
+        int64_t index = -1;     //!< For an array step, -1 for any.
+    };
+
+    struct Frame
+    {
+        int matched;            //!< Steps matched to reach this container, -1 if it is off the path.
+        bool isArray;
+        uint32_t index = 0;     //!< Of the next element, for arrays.
+    };
+
+    const OnRecord mOnRecord;
+    bool mOK = false;
+    std::vector<Step> mSteps;
+    std::vector<std::string> mFields;
+    std::vector<Frame> mStack;
+    std::string mKey;           //!< Of the member about to be read.
+    std::vector<std::string> mValues;
+    uint32_t mRecordCount = 0;
+
+    bool Parse(const std::string& pQuery);
+    int StartValue();
+    bool OnScalar(std::string_view pValue);
+};
+
+#endif //#ifndef JSON_PATH_H
@@ -0,0 +1,461 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#include "JsonStream.h"
+
+#include <cstdlib>
+
+static bool IsWhiteSpace(char pChar)
+{
+    return pChar == ' ' || pChar == '\n' || pChar == '\r' || pChar == '\t';
+}
+
+static bool IsNumberChar(char pChar)
+{
+    return (pChar >= '0' && pChar <= '9') || pChar == '-' || pChar == '+' || pChar == '.' || pChar == 'e' || pChar == 'E';
+}
+
+static bool IsDigit(char pChar)
+{
+    return pChar >= '0' && pChar <= '9';
+}
+
+static bool IsJsonNumber(const std::string& pToken)
+{
+    // The JSON grammar, the same one JsonDocument::ParseNumber uses. No leading zeros, and a . or e must have digits after it.
+    size_t pos = 0;
+    const size_t size = pToken.size();
+    if( pos < size && pToken[pos] == '-' )
+        pos++;
+
+    if( pos >= size || IsDigit(pToken[pos]) == false )
+        return false;
+
+    if( pToken[pos] == '0' )
+    {
+        pos++;
+        if( pos < size && IsDigit(pToken[pos]) )
+            return false;
+    }
+    else
+    {
+        while( pos < size && IsDigit(pToken[pos]) )
+            pos++;
+    }
+
+    if( pos < size && pToken[pos] == '.' )
+    {
+        pos++;
+        if( pos >= size || IsDigit(pToken[pos]) == false )
+            return false;
+        while( pos < size && IsDigit(pToken[pos]) )
+            pos++;
+    }
+
+    if( pos < size && (pToken[pos] == 'e' || pToken[pos] == 'E') )
+    {
+        pos++;
+        if( pos < size && (pToken[pos] == '+' || pToken[pos] == '-') )
+            pos++;
+        if( pos >= size || IsDigit(pToken[pos]) == false )
+            return false;
+        while( pos < size && IsDigit(pToken[pos]) )
+            pos++;
+    }
+
+    return pos == size;
+}
+
+static bool IsStringChar(char pChar)
+{
+    return pChar != '"' && pChar != '\\' && (uint8_t)pChar >= 0x20;
+}
+
+JsonStream::JsonStream(Handler& pHandler):mHandler(pHandler)
+{
+    mToken.reserve(256);
+}
+
+bool JsonStream::Feed(const char* pData,size_t pSize)
+{
+    if( mState == STATE_ERROR )
+        return false;
+
+    for( size_t n = 0 ; n < pSize ; n++, mBytesRead++ )
+    {
+        const char c = pData[n];
+
+        // These end when a character that is not part of them turns up, which then needs reading as normal.
+        if( mState == STATE_NUMBER )
+        {
+            if( IsNumberChar(c) )
+            {
+                mToken.push_back(c);
+                continue;
+            }
+
+            if( EndNumber() == false )
+                return false;
+        }
+
+        switch( mState )
+        {
+        case STATE_STRING:
+            if( IsStringChar(c) )
+            {// Take the run of plain characters in one go, most strings have no escapes.
+                size_t end = n + 1;
+                while( end < pSize && IsStringChar(pData[end]) )
+                    end++;
+
+                if( mHighSurrogate )
+                {
+                    AppendUTF8(0xFFFD);
+                    mHighSurrogate = 0;
+                }
+                mToken.append(pData + n,end - n);
+                mBytesRead += end - n - 1;
+                n = end - 1;
+            }
+            else if( c == '"' )
+            {
+                if( EndString() == false )
+                    return false;
+            }
+            else if( c == '\\' )
+            {
+                mState = STATE_ESCAPE;
+            }
+            else
+            {
+                return SetError("control character in a string");
+            }
+            break;
+
+        case STATE_ESCAPE:
+            if( c == 'u' )
+            {
+                mUnicode = 0;
+                mUnicodeDigits = 0;
+                mState = STATE_UNICODE;
+                break;
+            }
+
+            if( mHighSurrogate )
+            {
+                AppendUTF8(0xFFFD);
+                mHighSurrogate = 0;
+            }
+
+            switch( c )
+            {
+            case '"':
+            case '\\':
+            case '/':
+                mToken.push_back(c);
+                break;
+            case 'b':
+                mToken.push_back('\b');
+                break;
+            case 'f':
+                mToken.push_back('\f');
+                break;
+            case 'n':
+                mToken.push_back('\n');
+                break;
+            case 'r':
+                mToken.push_back('\r');
+                break;
+            case 't':
+                mToken.push_back('\t');
+                break;
+            default:
+                return SetError("bad escape in a string");
+            }
+            mState = STATE_STRING;
+            break;
+
+        case STATE_UNICODE:
+            if( c >= '0' && c <= '9' )
+                mUnicode = (mUnicode << 4) | (c - '0');
+            else if( c >= 'a' && c <= 'f' )
+                mUnicode = (mUnicode << 4) | (c - 'a' + 10);
+            else if( c >= 'A' && c <= 'F' )
+                mUnicode = (mUnicode << 4) | (c - 'A' + 10);
+            else
+                return SetError("bad \\u escape in a string");
+
+            if( ++mUnicodeDigits == 4 )
+            {
+                if( mUnicode >= 0xD800 && mUnicode <= 0xDBFF )
+                {// First half of a pair, wait for the second.
+                    if( mHighSurrogate )
+                        AppendUTF8(0xFFFD);
+                    mHighSurrogate = mUnicode;
+                }
+                else if( mUnicode >= 0xDC00 && mUnicode <= 0xDFFF )
+                {
+                    AppendUTF8(mHighSurrogate ? 0x10000 + ((mHighSurrogate - 0xD800) << 10) + (mUnicode - 0xDC00) : 0xFFFD);
+                    mHighSurrogate = 0;
+                }
+                else
+                {
+                    if( mHighSurrogate )
+                        AppendUTF8(0xFFFD);
+                    mHighSurrogate = 0;
+                    AppendUTF8(mUnicode);
+                }
+                mState = STATE_STRING;
+            }
+            break;
+
+        case STATE_LITERAL:
+            if( c != mLiteral[mLiteralPos] )
+                return SetError("bad literal, expected true, false or null");
+
+            if( mLiteral[++mLiteralPos] == 0 && EndLiteral() == false )
+                return false;
+            break;
+
+        case STATE_ERROR:
+            return false;
+
+        default:
+            if( IsWhiteSpace(c) )
+                break;
+
+            switch( mState )
+            {
+            case STATE_VALUE:
+                if( ReadValueStart(c) == false )
+                    return false;
+                break;
+
+            case STATE_FIRST_VALUE:
+                if( c == ']' ? EndContainer('[') == false : ReadValueStart(c) == false )
+                    return false;
+                break;
+
+            case STATE_FIRST_KEY:
+            case STATE_KEY:
+                if( c == '}' && mState == STATE_FIRST_KEY )
+                {
+                    if( EndContainer('{') == false )
+                        return false;
+                }
+                else if( c == '"' )
+                {
+                    mToken.clear();
+                    mTokenIsKey = true;
+                    mState = STATE_STRING;
+                }
+                else
+                {
+                    return SetError("expected a key");
+                }
+                break;
+
+            case STATE_COLON:
+                if( c != ':' )
+                    return SetError("expected a :");
+                mState = STATE_VALUE;
+                break;
+
+            case STATE_AFTER_VALUE:
+                if( c == ',' )
+                {
+                    mState = mStack.back() == '{' ? STATE_KEY : STATE_VALUE;
+                }
+                else if( c == '}' || c == ']' )
+                {
+                    if( EndContainer(c == '}' ? '{' : '[') == false )
+                        return false;
+                }
+                else
+                {
+                    return SetError("expected a , or the end of the object or array");
+                }
+                break;
+
+            case STATE_DONE:
+                return SetError("more after the end of the document");
+
+            default:
+                return SetError("internal state");
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+bool JsonStream::Finish()
+{
+    if( mState == STATE_NUMBER && EndNumber() == false )
+        return false;
+
+    if( mState != STATE_DONE )
+    {
+        if( mState != STATE_ERROR )
+            SetError("the document ended early");
+        return false;
+    }
+    return mHandler.OnDocumentEnd() || SetError("the handler did not find what it wanted");
+}
+
+bool JsonStream::ReadValueStart(char pChar)
+{
+    switch( pChar )
+    {
+    case '{':
+    case '[':
+        if( mStack.size() >= JSON_STREAM_MAX_DEPTH )
+            return SetError("nested too deep");
+
+        mStack.push_back(pChar);
+        if( pChar == '{' )
+        {
+            mState = STATE_FIRST_KEY;
+            return mHandler.OnObjectBegin() || SetError("stopped by the handler");
+        }
+        mState = STATE_FIRST_VALUE;
+        return mHandler.OnArrayBegin() || SetError("stopped by the handler");
+
+    case '"':
+        mToken.clear();
+        mTokenIsKey = false;
+        mState = STATE_STRING;
+        return true;
+
+    case 't':
+        mLiteral = "true";
+        break;
+
+    case 'f':
+        mLiteral = "false";
+        break;
+
+    case 'n':
+        mLiteral = "null";
+        break;
+
+    default:
+        if( pChar == '-' || (pChar >= '0' && pChar <= '9') )
+        {
+            mToken.assign(1,pChar);
+            mState = STATE_NUMBER;
+            return true;
+        }
+        return SetError("expected a value");
+    }
+
+    mLiteralPos = 1;
+    mState = STATE_LITERAL;
+    return true;
+}
+
+bool JsonStream::EndString()
+{
+    if( mHighSurrogate )
+    {
+        AppendUTF8(0xFFFD);
+        mHighSurrogate = 0;
+    }
+
+    if( mTokenIsKey )
+    {
+        mState = STATE_COLON;
+        return mHandler.OnKey(mToken) || SetError("stopped by the handler");
+    }
+
+    return (mHandler.OnString(mToken) || SetError("stopped by the handler")) && EndValue();
+}
+
+bool JsonStream::EndNumber()
+{
+    if( IsJsonNumber(mToken) == false )
+        return SetError("bad number");
+
+    char* end = nullptr;
+    const double value = std::strtod(mToken.c_str(),&end);
+    if( end != mToken.c_str() + mToken.size() )
+        return SetError("bad number");
+
+    return (mHandler.OnNumber(value,mToken) || SetError("stopped by the handler")) && EndValue();
+}
+
+bool JsonStream::EndLiteral()
+{
+    bool ok;
+    if( mLiteral[0] == 'n' )
+        ok = mHandler.OnNull();
+    else
+        ok = mHandler.OnBool(mLiteral[0] == 't');
+
+    return (ok || SetError("stopped by the handler")) && EndValue();
+}
+
+bool JsonStream::EndValue()
+{
+    mState = mStack.size() > 0 ? STATE_AFTER_VALUE : STATE_DONE;
+    return true;
+}
+
+bool JsonStream::EndContainer(char pOpen)
+{
+    if( mStack.size() == 0 || mStack.back() != pOpen )
+        return SetError("mismatched } or ]");
+
+    mStack.pop_back();
+    const bool ok = pOpen == '{' ? mHandler.OnObjectEnd() : mHandler.OnArrayEnd();
+    return (ok || SetError("stopped by the handler")) && EndValue();
+}
+
+void JsonStream::AppendUTF8(uint32_t pCode)
+{
+    if( pCode < 0x80 )
+    {
+        mToken.push_back((char)pCode);
+    }
+    else if( pCode < 0x800 )
+    {
+        mToken.push_back((char)(0xC0 | (pCode >> 6)));
+        mToken.push_back((char)(0x80 | (pCode & 0x3F)));
+    }
+    else if( pCode < 0x10000 )
+    {
+        mToken.push_back((char)(0xE0 | (pCode >> 12)));
+        mToken.push_back((char)(0x80 | ((pCode >> 6) & 0x3F)));
+        mToken.push_back((char)(0x80 | (pCode & 0x3F)));
+    }
+    else
+    {
+        mToken.push_back((char)(0xF0 | (pCode >> 18)));
+        mToken.push_back((char)(0x80 | ((pCode >> 12) & 0x3F)));
+        mToken.push_back((char)(0x80 | ((pCode >> 6) & 0x3F)));
+        mToken.push_back((char)(0x80 | (pCode & 0x3F)));
+    }
+}
+
+bool JsonStream::SetError(const char* pWhat)
+{
+    if( mState != STATE_ERROR )
+    {
+        mError = std::string(pWhat) + " at byte " + std::to_string(mBytesRead);
+        mState = STATE_ERROR;
+    }
+    return false;
+}
@@ -0,0 +1,113 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#define JSON_STREAM_MAX_DEPTH 256   //!< Deeper than any document we fetch, stops a bad one growing the stack for ever.
+
+/**
+ * @brief An incremental SAX style JSON reader. The document is fed in as it arrives, in chunks of any size,
+ * and the handler is called for each key and value. Nothing but the token being read is kept, so memory
+ * does not grow with the size of the document and the body of a large download never has to be held.
+ */
+class JsonStream
+{
+public:
+    /**
+     * @brief Override the ones you want. The string views are only valid for the call.
+     * Return false to stop reading, Feed will then return false.
+     */
+    class Handler
+    {
+    public:
+        virtual ~Handler() = default;
+
+        virtual bool OnObjectBegin(){return true;}
+        virtual bool OnObjectEnd(){return true;}
+        virtual bool OnArrayBegin(){return true;}
+        virtual bool OnArrayEnd(){return true;}
+        virtual bool OnKey(std::string_view pKey){return true;}
+        virtual bool OnString(std::string_view pValue){return true;}
+        virtual bool OnNumber(double pValue,std::string_view pText){return true;}//!< pText is as it was in the document, for ids that don't fit a double.
+        virtual bool OnBool(bool pValue){return true;}
+        virtual bool OnNull(){return true;}
+        virtual bool OnDocumentEnd(){return true;}//!< From Finish, return false if the document did not have what you were after.
+    };
+
+    JsonStream(Handler& pHandler);
+
+    /**
+     * @brief Reads the next part of the document. Returns false on bad JSON, or if the handler said stop.
+     */
+    bool Feed(const char* pData,size_t pSize);
+
+    /**
+     * @brief Call after the last Feed, returns true if there was one whole document and the handler was happy with it.
+     */
+    bool Finish();
+
+    const std::string& GetError()const{return mError;}
+    uint64_t GetBytesRead()const{return mBytesRead;}
+
+private:
+    enum State
+    {
+        STATE_VALUE,            //!< Expecting a value.
+        STATE_FIRST_VALUE,      //!< Just after [, a value or ].
+        STATE_FIRST_KEY,        //!< Just after {, a key or }.
+        STATE_KEY,              //!< After a , in an object.
+        STATE_COLON,
+        STATE_AFTER_VALUE,      //!< A , or the end of the container.
+        STATE_STRING,
+        STATE_ESCAPE,
+        STATE_UNICODE,
+        STATE_NUMBER,
+        STATE_LITERAL,
+        STATE_DONE,
+        STATE_ERROR
+    };
+
+    Handler& mHandler;
+    State mState = STATE_VALUE;
+    std::vector<char> mStack;       //!< The open containers, { or [.
+    std::string mToken;             //!< The string or number being read, kept between chunks.
+    bool mTokenIsKey = false;
+    const char* mLiteral = nullptr; //!< true, false or null.
+    size_t mLiteralPos = 0;
+    uint32_t mUnicode = 0;          //!< The \u escape being read.
+    int mUnicodeDigits = 0;
+    uint32_t mHighSurrogate = 0;    //!< First half of a UTF-16 pair, waiting for the second.
+    uint64_t mBytesRead = 0;
+    std::string mError;
+
+    bool ReadValueStart(char pChar);
+    bool EndString();
+    bool EndNumber();
+    bool EndLiteral();
+    bool EndValue();
+    bool EndContainer(char pOpen);
+    void AppendUTF8(uint32_t pCode);
+    bool SetError(const char* pWhat);
+};
+
+#endif //#ifndef JSON_STREAM_H
@@ -0,0 +1,353 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "MQTTBrokerStandIn.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+
+static const int POLL_MS = 100;                 // How often a blocked thread looks to see if it should stop.
+static const size_t MAX_PACKET_SIZE = 4096;     // We only ever get CONNECT, SUBSCRIBE, PINGREQ and DISCONNECT.
+
+// Fixed header packet types, the top four bits of the first byte.
+enum PacketType
+{
+    PACKET_CONNECT = 1,
+    PACKET_PUBLISH = 3,
+    PACKET_SUBSCRIBE = 8,
+    PACKET_PINGREQ = 12,
+    PACKET_DISCONNECT = 14
+};
+
+static int64_t GetTimeNS()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+MQTTBrokerStandIn::MQTTBrokerStandIn(const std::vector<std::string>& pTopics):mTopics(pTopics)
+{
+}
+
+MQTTBrokerStandIn::~MQTTBrokerStandIn()
+{
+    Stop();
+}
+
+bool MQTTBrokerStandIn::Start(uint32_t pRate,uint32_t pSeconds)
+{
+    const uint64_t count = (uint64_t)pRate * pSeconds;
+    if( mTopics.size() == 0 || count == 0 || count > UINT32_MAX )
+    {
+        std::cerr << "MQTTBrokerStandIn needs topics and between 1 and " << UINT32_MAX << " messages\n";
+        return false;
+    }
+
+    mListen = socket(AF_INET,SOCK_STREAM,0);
+    if( mListen < 0 )
+    {
+        std::cerr << "MQTTBrokerStandIn socket failed " << strerror(errno) << "\n";
+        return false;
+    }
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;// Any free port.
+    socklen_t length = sizeof(address);
+    if( bind(mListen,(sockaddr*)&address,sizeof(address)) != 0 ||
+        listen(mListen,1) != 0 ||
+        getsockname(mListen,(sockaddr*)&address,&length) != 0 )
+    {
+        std::cerr << "MQTTBrokerStandIn failed to listen " << strerror(errno) << "\n";
+        close(mListen);
+        mListen = -1;
+        return false;
+    }
+
+    mPort = ntohs(address.sin_port);
+    mRate = pRate;
+    mSentAt.assign((size_t)count,0);
+    mPublished = 0;
+    mFinished = false;
+    mRunning = true;
+    mThread = std::thread([this](){Serve();});
+    std::clog << "MQTTBrokerStandIn listening on 127.0.0.1:" << mPort << ", " << count << " messages at " << pRate << " a second\n";
+    return true;
+}
+
+void MQTTBrokerStandIn::Stop()
+{
+    mRunning = false;
+    if( mThread.joinable() )
+    {
+        mThread.join();
+    }
+
+    if( mListen >= 0 )
+    {
+        close(mListen);
+        mListen = -1;
+    }
+}
+
+int MQTTBrokerStandIn::FindTopic(std::string_view pTopic)const
+{
+    for( size_t n = 0 ; n < mTopics.size() ; n++ )
+    {
+        if( mTopics[n] == pTopic )
+            return (int)n;
+    }
+    return -1;
+}
+
+uint32_t MQTTBrokerStandIn::GetPublishedCount(size_t pTopic)const
+{
+    const uint32_t published = GetPublishedCount();
+    return published > pTopic ? (uint32_t)((published - pTopic - 1) / mTopics.size()) + 1 : 0;
+}
+
+int64_t MQTTBrokerStandIn::GetPublishTime(size_t pTopic,uint32_t pSequence)const
+{
+    const uint64_t n = ((uint64_t)(pSequence - 1) * mTopics.size()) + pTopic;
+    if( pSequence == 0 || n >= GetPublishedCount() )
+        return 0;
+    return mSentAt[(size_t)n];
+}
+
+void MQTTBrokerStandIn::Serve()
+{
+    int client = -1;
+    while( mRunning && client < 0 )
+    {
+        pollfd listen = {mListen,POLLIN,0};
+        if( poll(&listen,1,POLL_MS) > 0 )
+        {
+            client = accept(mListen,nullptr,nullptr);
+        }
+    }
+
+    if( client >= 0 )
+    {
+        if( Handshake(client) && Publish(client) )
+        {
+            std::clog << "MQTTBrokerStandIn sent all " << GetPublishedCount() << " messages\n";
+            mFinished = true;
+
+            // Stay connected, or the client would go into its reconnect backoff before the results are in.
+            while( mRunning && ServiceClient(client,POLL_MS) )
+            {
+            }
+        }
+        close(client);
+    }
+    mFinished = true;
+}
+
+bool MQTTBrokerStandIn::Handshake(int pSocket)
+{
+    uint8_t type;
+    std::string body;
+    if( ReadPacket(pSocket,type,body) == false || type != PACKET_CONNECT )
+    {
+        std::cerr << "MQTTBrokerStandIn expected CONNECT\n";
+        return false;
+    }
+
+    // Session not present, accepted.
+    static const char connack[] = {0x20,0x02,0x00,0x00};
+    if( Send(pSocket,connack,sizeof(connack)) == false )
+        return false;
+
+    // mosquitto subscribes once it has the CONNACK, all the topics in the one packet.
+    while( ReadPacket(pSocket,type,body) )
+    {
+        if( type == PACKET_PINGREQ )
+        {
+            static const char pingresp[] = {(char)0xD0,0x00};
+            if( Send(pSocket,pingresp,sizeof(pingresp)) == false )
+                return false;
+            continue;
+        }
+
+        if( type != PACKET_SUBSCRIBE || body.size() < 2 )
+        {
+            std::cerr << "MQTTBrokerStandIn expected SUBSCRIBE\n";
+            return false;
+        }
+
+        // Packet id then a length, topic filter and QoS for each. Granted QoS 0 for all of them.
+        size_t filters = 0;
+        for( size_t pos = 2 ; pos + 2 <= body.size() ; filters++ )
+        {
+            pos += 2 + (((uint8_t)body[pos] << 8) | (uint8_t)body[pos + 1]) + 1;
+        }
+
+        std::string suback;
+        suback.push_back((char)0x90);
+        suback.push_back((char)(2 + filters));// Never more than a handful, fits the one byte length.
+        suback.append(body,0,2);
+        suback.append(filters,(char)0);
+        return Send(pSocket,suback.data(),suback.size());
+    }
+    return false;
+}
+
+bool MQTTBrokerStandIn::Publish(int pSocket)
+{
+    const int64_t interval = 1000000000 / mRate;
+    const int64_t start = GetTimeNS();
+    char packet[8 + 256 + 16];
+    for( size_t n = 0 ; n < mSentAt.size() && mRunning ; n++ )
+    {
+        // On time rather than as fast as we can, so the latency is for the rate asked for. If we fall behind we catch up.
+        const int64_t due = start + ((int64_t)n * interval);
+        for( int64_t wait = due - GetTimeNS() ; wait > 0 && mRunning ; wait = due - GetTimeNS() )
+        {
+            if( wait >= 1000000 )
+            {
+                if( ServiceClient(pSocket,(int)std::min<int64_t>(wait / 1000000,POLL_MS)) == false )
+                    return false;
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+            }
+        }
+
+        if( ServiceClient(pSocket,0) == false )
+            return false;
+
+        const std::string& topic = mTopics[n % mTopics.size()];
+        char payload[16];
+        const int payloadSize = snprintf(payload,sizeof(payload),"%u",(uint32_t)(n / mTopics.size()) + 1);
+        const size_t topicSize = std::min<size_t>(topic.size(),256);
+
+        // Fixed header with the remaining length as a variable length int, then the topic then the payload.
+        size_t remaining = 2 + topicSize + payloadSize;
+        size_t size = 0;
+        packet[size++] = (char)(PACKET_PUBLISH << 4);
+        do
+        {
+            uint8_t byte = remaining & 0x7f;
+            remaining >>= 7;
+            if( remaining > 0 )
+                byte |= 0x80;
+            packet[size++] = (char)byte;
+        }while( remaining > 0 );
+        packet[size++] = (char)(topicSize >> 8);
+        packet[size++] = (char)(topicSize & 0xff);
+        memcpy(packet + size,topic.data(),topicSize);
+        size += topicSize;
+        memcpy(packet + size,payload,payloadSize);
+        size += payloadSize;
+
+        // Released before it is sent, so by the time it can have been shown the time can be read.
+        mSentAt[n] = GetTimeNS();
+        mPublished.store((uint32_t)n + 1,std::memory_order_release);
+        if( Send(pSocket,packet,size) == false )
+            return false;
+    }
+    return mRunning;
+}
+
+bool MQTTBrokerStandIn::ServiceClient(int pSocket,int pWaitMS)
+{
+    pollfd in = {pSocket,POLLIN,0};
+    while( mRunning && poll(&in,1,pWaitMS) > 0 )
+    {
+        uint8_t type;
+        std::string body;
+        if( ReadPacket(pSocket,type,body) == false || type == PACKET_DISCONNECT )
+            return false;
+
+        if( type == PACKET_PINGREQ )
+        {
+            static const char pingresp[] = {(char)0xD0,0x00};
+            if( Send(pSocket,pingresp,sizeof(pingresp)) == false )
+                return false;
+        }
+        pWaitMS = 0;
+    }
+    return true;
+}
+
+bool MQTTBrokerStandIn::ReadPacket(int pSocket,uint8_t& rType,std::string& rBody)
+{
+    auto read = [this,pSocket](char* pBuffer,size_t pSize)
+    {
+        while( pSize > 0 && mRunning )
+        {
+            pollfd in = {pSocket,POLLIN,0};
+            if( poll(&in,1,POLL_MS) <= 0 )
+                continue;
+
+            const ssize_t got = recv(pSocket,pBuffer,pSize,0);
+            if( got <= 0 )
+                return false;
+            pBuffer += got;
+            pSize -= got;
+        }
+        return pSize == 0;
+    };
+
+    char byte;
+    if( read(&byte,1) == false )
+        return false;
+    rType = (uint8_t)byte >> 4;
+
+    size_t remaining = 0;
+    for( int shift = 0 ; ; shift += 7 )
+    {
+        if( shift > 21 || read(&byte,1) == false )
+            return false;
+        remaining |= (size_t)(byte & 0x7f) << shift;
+        if( (byte & 0x80) == 0 )
+            break;
+    }
+
+    if( remaining > MAX_PACKET_SIZE )
+        return false;
+
+    rBody.resize(remaining);
+    return read(rBody.data(),remaining);
+}
+
+bool MQTTBrokerStandIn::Send(int pSocket,const char* pData,size_t pSize)
+{
+    while( pSize > 0 && mRunning )
+    {
+        pollfd out = {pSocket,POLLOUT,0};
+        if( poll(&out,1,POLL_MS) <= 0 )
+            continue;
+
+        const ssize_t sent = send(pSocket,pData,pSize,MSG_NOSIGNAL);
+        if( sent <= 0 )
+            return false;
+
+        pData += sent;
+        pSize -= sent;
+    }
+    return pSize == 0;
+}
@@ -0,0 +1,81 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef MQTT_BROKER_STAND_IN_H
+#define MQTT_BROKER_STAND_IN_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Just enough of an MQTT 3.1 broker on the loopback to time the live path, mosquitto_connect and all.
+ * Takes one client. Once it has subscribed the topics are published in turn, QoS 0, at the rate asked for.
+ * Each payload is a count of the messages sent to that topic, 1, 2, 3 and so on, so whoever shows a value
+ * knows which message it was and every message before it on that topic, even the ones coalesced or dropped
+ * on the way. The time each message was sent is kept for the latency benchmark, see Benchmark.h
+ * Everything is allocated in Start, the publishing thread only writes into it.
+ */
+class MQTTBrokerStandIn
+{
+public:
+    MQTTBrokerStandIn(const std::vector<std::string>& pTopics);
+    ~MQTTBrokerStandIn();
+
+    /**
+     * @brief Starts listening on a free loopback port, publishing starts when the client subscribes.
+     * @param pRate Messages a second, across all the topics.
+     */
+    bool Start(uint32_t pRate,uint32_t pSeconds);
+    void Stop();//!< Closes the sockets and waits for the thread.
+
+    uint16_t GetPort()const{return mPort;}
+    size_t GetTopicCount()const{return mTopics.size();}
+    int FindTopic(std::string_view pTopic)const;//!< -1 if we don't publish it.
+
+    bool GetFinished()const{return mFinished;}//!< Every message has been sent, or the client went away.
+    uint32_t GetPublishedCount()const{return mPublished.load(std::memory_order_acquire);}
+    uint32_t GetPublishedCount(size_t pTopic)const;//!< The highest sequence sent to that topic so far.
+
+    /**
+     * @brief Safe from any thread. The steady_clock nanoseconds the message was sent, zero if it has not been.
+     */
+    int64_t GetPublishTime(size_t pTopic,uint32_t pSequence)const;
+
+private:
+    const std::vector<std::string> mTopics;
+    int mListen = -1;
+    uint16_t mPort = 0;
+    uint32_t mRate = 0;
+    std::thread mThread;
+    std::atomic<bool> mRunning{false};
+    std::atomic<bool> mFinished{false};
+
+    std::vector<int64_t> mSentAt;           //!< Message n went to topic n % topics with sequence n / topics + 1.
+    std::atomic<uint32_t> mPublished{0};    //!< Entries of mSentAt written, released after each one.
+
+    void Serve();
+    bool Handshake(int pSocket);
+    bool Publish(int pSocket);
+    bool ServiceClient(int pSocket,int pWaitMS);//!< Answers pings until there is nothing to read. False if the client has gone.
+    bool ReadPacket(int pSocket,uint8_t& rType,std::string& rBody);
+    bool Send(int pSocket,const char* pData,size_t pSize);
+};
+
+#endif //#ifndef MQTT_BROKER_STAND_IN_H
@@ -21,6 +21,16 @@
 #include <unistd.h>
 
 #include <iostream>
+#include <cstring>
+#include <random>
+#include <algorithm>
+#include <chrono>
+
+// Reconnect backoff, doubles on each failure up to the max. Reset once the broker accepts us.
+static const uint32_t RECONNECT_MIN_MS = 500;
+static const uint32_t RECONNECT_MAX_MS = 60 * 1000;
+static const int KEEP_ALIVE_SECONDS = 60;
+static const int LOOP_TIMEOUT_MS = 100; // Upper bound on how long shutdown waits for the network thread.
 
 
 void MQTTData::CallbackConnected(struct mosquitto *mosq, void *userdata, int result)
@@ -33,7 +43,8 @@ void MQTTData::CallbackConnected(struct mosquitto *mosq, void *userdata, int res
 	}
     else
     {
-		std::cout << "MQTT Error: Failed to connect\n";
+		std::cout << "MQTT Error: Failed to connect, " << mosquitto_connack_string(result) << "\n";
+        // The broker will drop us, mosquitto_loop then fails and the network thread backs off.
 	}
 }
 
@@ -44,12 +55,7 @@ void MQTTData::CallbackMessage(struct mosquitto *mosq, void *userdata, const str
 	if(message && message->payloadlen)
     {
         assert(userdata);
-
-        const std::string topic = message->topic;
-        const std::string data = ((const char*)message->payload);
-
-        ((MQTTData*)userdata)->mOnData(topic,data);
-
+        ((MQTTData*)userdata)->OnMessage(message);
 	}
 }
 
@@ -79,7 +85,7 @@ static void my_log_callback(struct mosquitto *mosq, void *userdata, int level, c
 
 MQTTData::MQTTData(const std::string& pHost,int pPort,
     const std::vector<std::string> pTopics,
-    std::function<void(const std::string &pTopic,const std::string &pData)> pOnData):
+    std::function<void(std::string_view pTopic,std::string_view pData)> pOnData):
     mHost(pHost),
     mPort(pPort),
     mTopics(pTopics),
@@ -87,64 +93,213 @@ MQTTData::MQTTData(const std::string& pHost,int pPort,
 {
     assert(pHost.size() > 0 && pPort);
 
+    // Worst case every queued message is a different topic, reserve that now so the frame loop never allocates.
+    mLatest.reserve(MQTT_INGEST_QUEUE_SIZE);
+    mFirstValues.reserve(MQTT_INGEST_QUEUE_SIZE);
+
+    // mosquitto wants an array of char pointers, mTopics is const so these stay valid.
+    for( const auto& t : mTopics )
+    {
+        mSubscriptions.push_back((char*)t.c_str());
+        mTopicList += (mTopicList.size() ? "," : "") + t;
+    }
+
     bool clean_session = true;
     mosquitto_lib_init();
     mMQTT = mosquitto_new(NULL, clean_session, this);
     if( !mMQTT )
     {
         std::cerr << "MQTT Init Error: Out of memory\n";
+        mosquitto_lib_cleanup();// The destructor only cleans up when there is a mMQTT.
     }
     else
     {
+        mosquitto_log_callback_set(mMQTT, my_log_callback);
+        mosquitto_connect_callback_set(mMQTT, CallbackConnected);
+        mosquitto_message_callback_set(mMQTT, CallbackMessage);
+#ifdef VERBOSE_BUILD
+        mosquitto_subscribe_callback_set(mMQTT, my_subscribe_callback);
+#endif
+        mosquitto_threaded_set(mMQTT, true);// We run our own network thread, see NetworkLoop.
+        mRunning = true;
+        mNetworkThread = std::thread([this](){NetworkLoop();});
+        mOk = true;
         std::cout << "MQTT started\n";
     }
 }
 
+MQTTData::MQTTData(const std::string& pReplayFile,float pSpeed,
+    std::function<void(std::string_view pTopic,std::string_view pData)> pOnData):
+    mPort(0),
+    mOnData(pOnData)
+{
+    mLatest.reserve(MQTT_INGEST_QUEUE_SIZE);
+    mFirstValues.reserve(MQTT_INGEST_QUEUE_SIZE);
+
+    mRunning = true;
+    mNetworkThread = std::thread([this,pReplayFile,pSpeed](){ReplayLoop(pReplayFile,pSpeed);});
+    mOk = true;
+    std::cout << "MQTT replaying " << pReplayFile << "\n";
+}
+
 void MQTTData::Tick()
 {
+    DrainIngest();
+}
 
-    if( mMQTT && mConnected == false )
+
+MQTTData::~MQTTData()
+{
+    {// Under the lock, or the network thread could check mRunning, miss the notify and sleep the whole backoff.
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mRunning = false;
+    }
+    mSleeper.notify_all();
+    if( mMQTT )
     {
-        int keepalive = 60;
-        mosquitto_log_callback_set(mMQTT, my_log_callback);
-        mosquitto_connect_callback_set(mMQTT, CallbackConnected);
-        mosquitto_message_callback_set(mMQTT, CallbackMessage);
-#ifdef VERBOSE_BUILD
-        mosquitto_subscribe_callback_set(mMQTT, my_subscribe_callback);
-#endif
+        mosquitto_disconnect(mMQTT);
+    }
 
-        if( mosquitto_connect(mMQTT, mHost.c_str(), mPort, keepalive) == MOSQ_ERR_SUCCESS )
+    if( mNetworkThread.joinable() )
+    {
+        mNetworkThread.join();
+    }
+
+    if( mMQTT )
+    {
+        mosquitto_destroy(mMQTT);
+        mosquitto_lib_cleanup();
+    }
+
+    MQTTSessionWriter* recorder = mRecorder;
+    if( recorder )
+    {
+        std::cout << "MQTT recorded " << recorder->GetCount() << " messages\n";
+        delete recorder;
+    }
+}
+
+bool MQTTData::StartRecording(const std::string& pFileName)
+{
+    assert( mRecorder == nullptr );
+
+    MQTTSessionWriter* recorder = new MQTTSessionWriter;
+    if( recorder->Open(pFileName) == false )
+    {
+        delete recorder;
+        return false;
+    }
+
+    mRecorder = recorder;
+    std::cout << "MQTT recording to " << pFileName << "\n";
+    return true;
+}
+
+void MQTTData::NetworkLoop()
+{
+    std::mt19937 random(std::random_device{}());
+    uint32_t backoff = RECONNECT_MIN_MS;
+    bool firstConnect = true;
+
+    while( mRunning )
+    {
+        mState = MQTT_CONNECTING;
+
+        // connect_async still resolves the host name in the calling thread, that's why this is not on the UI thread.
+        const int connect = firstConnect ? mosquitto_connect_async(mMQTT, mHost.c_str(), mPort, KEEP_ALIVE_SECONDS) : mosquitto_reconnect_async(mMQTT);
+        if( connect == MOSQ_ERR_SUCCESS )
         {
-            mConnected = true;
-            // Now start the loop.
-            if( mosquitto_loop_start(mMQTT) == MOSQ_ERR_SUCCESS )
+            firstConnect = false;
+
+            // Runs until the connection drops or we're asked to stop. Keep alive pings detect a dead broker.
+            int loop;
+            do
             {
-                mOk = true;
-            }
-            else
+                loop = mosquitto_loop(mMQTT, LOOP_TIMEOUT_MS, 1);
+                if( mState == MQTT_CONNECTED )
+                {
+                    backoff = RECONNECT_MIN_MS;
+                }
+            }while( mRunning && loop == MOSQ_ERR_SUCCESS );
+
+            if( mRunning )
             {
-                std::cout << "MQTT Init Error: Failed to start networking loop\n";
+                std::cout << "MQTT connection lost, " << mosquitto_strerror(loop) << "\n";
             }
         }
         else
         {
-            std::cout << "No connection\n";
+            std::cout << "MQTT no connection to " << mHost << ", " << mosquitto_strerror(connect) << "\n";
+        }
+
+        if( mRunning )
+        {
+            mState = MQTT_WAITING;
+            mReconnects++;
+
+            // Jitter so a room full of displays don't all hit the broker at the same moment after it restarts.
+            std::uniform_int_distribution<uint32_t> jitter(backoff / 2,backoff);
+            if( WaitBeforeRetry(jitter(random)) == false )
+            {
+                break;
+            }
+            backoff = std::min(backoff * 2,RECONNECT_MAX_MS);
         }
     }
+    mState = MQTT_DISCONNECTED;
 }
 
-
-MQTTData::~MQTTData()
+void MQTTData::ReplayLoop(const std::string& pReplayFile,float pSpeed)
 {
-    if( mMQTT )
+    MQTTSessionReader log;
+    if( log.Open(pReplayFile) == false )
     {
-        mosquitto_destroy(mMQTT);
-        if( mosquitto_loop_stop(mMQTT,false) != MOSQ_ERR_SUCCESS )
+        return;
+    }
+
+    mState = MQTT_CONNECTED;
+    mConnectedAt = GetTimeNS();
+    mConnectGeneration++;
+
+    const int64_t start = GetTimeNS();
+    int64_t time;
+    std::string_view topic,payload;
+    uint32_t count = 0;
+    while( mRunning && log.Next(time,topic,payload) )
+    {
+        if( pSpeed > 0.0f )
         {
-            mosquitto_loop_stop(mMQTT,true);// Force the close.
+            const int64_t due = start + (int64_t)(time / pSpeed);
+            const int64_t wait = due - GetTimeNS();
+            if( wait > 0 && WaitBeforeRetry((uint32_t)(wait / 1000000)) == false )
+            {
+                break;
+            }
+
+            if( Ingest(topic,payload,false) == false )
+            {
+                mDropped++;
+            }
+        }
+        else
+        {// As fast as possible, but don't drop. We can only go as fast as the UI drains the queue.
+            while( mRunning && Ingest(topic,payload,false) == false )
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
         }
+        count++;
     }
-    mosquitto_lib_cleanup();
+
+    std::cout << "MQTT replay finished, " << count << " messages in " << (GetTimeNS() - start) / 1000000 << "ms\n";
+    mState = MQTT_DISCONNECTED;
+}
+
+bool MQTTData::WaitBeforeRetry(uint32_t pMilliseconds)
+{
+    std::unique_lock<std::mutex> lock(mSleepMutex);
+    mSleeper.wait_for(lock,std::chrono::milliseconds(pMilliseconds),[this](){return mRunning == false;});
+    return mRunning;
 }
 
 void MQTTData::OnConnected()
@@ -153,49 +308,165 @@ void MQTTData::OnConnected()
     std::cout << "MQTT OnConnected\n";
 #endif
 
-    // Subscribe to broker information topics on successful connect.
-    for( auto topic : mTopics )
+    mState = MQTT_CONNECTED;
+
+    mConnectedAt = GetTimeNS();
+    mConnectGeneration++;
+
+    // Subscribe to broker information topics on successful connect, all in one packet so one round trip.
+    // The broker replies with the retained value of every topic, that is our initial state.
+    // We use a clean session, so this happens again on every reconnect.
+    Subscribe();
+}
+
+void MQTTData::OnMessage(const struct mosquitto_message *message)
+{
+    // Called on the mosquitto thread, so no allocation and no touching anything the UI thread owns.
+    // The payload is not null terminated, payloadlen is the only thing we can trust.
+    const std::string_view topic(message->topic ? message->topic : "");
+    const std::string_view payload((const char*)message->payload,(size_t)message->payloadlen);
+
+    MQTTSessionWriter* recorder = mRecorder;
+    if( recorder )
+    {
+        recorder->Record(GetTimeNS(),topic,payload);
+    }
+
+    if( topic.size() == 0 || topic.size() > MQTT_MAX_TOPIC_SIZE || payload.size() > MQTT_MAX_PAYLOAD_SIZE )
+    {
+        mDropped++;
+    }
+    else if( Ingest(topic,payload,message->retain) == false )
+    {// UI thread has stalled, drop it. The next value will be along soon enough.
+        mDropped++;
+    }
+}
+
+bool MQTTData::Ingest(std::string_view pTopic,std::string_view pPayload,bool pRetained)
+{
+    // Producer side of the queue, only ever called from mNetworkThread.
+    if( pTopic.size() == 0 || pTopic.size() > MQTT_MAX_TOPIC_SIZE || pPayload.size() > MQTT_MAX_PAYLOAD_SIZE )
+        return true;// Can never fit, treat as consumed.
+
+    Message* m = mIngest.BeginWrite();
+    if( m == nullptr )
+        return false;
+
+    m->received = GetTimeNS();
+    m->retained = pRetained;
+    m->topicSize = (uint8_t)pTopic.size();
+    m->payloadSize = (uint8_t)pPayload.size();
+    memcpy(m->topic,pTopic.data(),pTopic.size());
+    memcpy(m->payload,pPayload.data(),pPayload.size());
+    mIngest.CommitWrite();
+    return true;
+}
+
+void MQTTData::DrainIngest()
+{
+    // Collect the latest value for each topic, so a burst of updates results in one call per topic per frame.
+    for( const Message* m = mIngest.BeginRead() ; m != nullptr ; m = mIngest.BeginRead() )
+    {
+        bool found = false;
+        for( auto& l : mLatest )
+        {
+            if( l.topicSize == m->topicSize && memcmp(l.topic,m->topic,m->topicSize) == 0 )
+            {
+                l = *m;
+                mCoalesced++;
+                found = true;
+                break;
+            }
+        }
+
+        if( !found )
+        {
+            mLatest.push_back(*m);
+        }
+        mIngest.EndRead();
+    }
+
+    // Forget what we have seen when we reconnect, so the time to first value is measured again.
+    const uint32_t generation = mConnectGeneration;
+    if( generation != mFirstValueGeneration )
     {
-        Subscribe(topic);
+        mFirstValueGeneration = generation;
+        mFirstValues.clear();
     }
+
+    for( const auto& l : mLatest )
+    {
+        ReportFirstValue(l);
+        mOnData(std::string_view(l.topic,l.topicSize),std::string_view(l.payload,l.payloadSize));
+        if( mOnDelivered )
+        {
+            mOnDelivered(l.received);
+        }
+    }
+    mLatest.clear();
+}
+
+void MQTTData::ReportFirstValue(const Message& pMessage)
+{
+    for( const auto& f : mFirstValues )
+    {
+        if( f.topicSize == pMessage.topicSize && memcmp(f.topic,pMessage.topic,pMessage.topicSize) == 0 )
+            return;
+    }
+
+    if( mFirstValues.size() == mFirstValues.capacity() )
+        return;// Don't allocate in the frame loop, we've reported plenty by now.
+
+    mFirstValues.push_back(pMessage);
+
+    const int64_t received = (pMessage.received - mConnectedAt) / 1000000;
+    const int64_t displayed = (GetTimeNS() - mConnectedAt) / 1000000;
+    std::cout << "MQTT first value " << std::string_view(pMessage.topic,pMessage.topicSize)
+              << " received after " << received << "ms displayed after " << displayed << "ms"
+              << (pMessage.retained ? " (retained)\n" : "\n");
+}
+
+int64_t MQTTData::GetTimeNS()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-void MQTTData::Subscribe(const std::string& pTopic)
+void MQTTData::Subscribe()
 {
-    assert( pTopic.size() > 0 );
+    assert( mSubscriptions.size() > 0 );
     assert( mMQTT );
 
-    const int ret = mosquitto_subscribe(mMQTT, NULL, pTopic.c_str(), MQTT_QOS_AT_MOST_ONCE);
+    const int ret = mosquitto_subscribe_multiple(mMQTT, NULL, (int)mSubscriptions.size(), mSubscriptions.data(), MQTT_QOS_AT_MOST_ONCE, 0, NULL);
     switch( ret )
     {
     default:
-        std::cerr << "Subscribing too " << pTopic << " failed with unknown error:" << ret << "\n";
+        std::cerr << "Subscribing too " << mTopicList << " failed with unknown error:" << ret << "\n";
         break;
 
     case MOSQ_ERR_SUCCESS:
 #ifdef DEBUG_BUILD
-         std::cout << "Subscribing too " << pTopic << "\n";
+         std::cout << "Subscribing too " << mTopicList << "\n";
 #endif
         break;
 
     case MOSQ_ERR_INVAL:
-        std::cerr << "MQTT Subscribe Error: [" << pTopic << "] The input parameters were invalid";
+        std::cerr << "MQTT Subscribe Error: [" << mTopicList << "] The input parameters were invalid";
         break;
 
     case MOSQ_ERR_NOMEM:
-        std::cerr << "MQTT Subscribe Error: [" << pTopic << "]an out of memory condition occurred\n";
+        std::cerr << "MQTT Subscribe Error: [" << mTopicList << "]an out of memory condition occurred\n";
         break;
 
     case MOSQ_ERR_NO_CONN:
-        std::cerr << "MQTT Subscribe Error: [" << pTopic << "]the client isn't connected to a broker.\n";
+        std::cerr << "MQTT Subscribe Error: [" << mTopicList << "]the client isn't connected to a broker.\n";
         break;
 
     case MOSQ_ERR_MALFORMED_UTF8:
-        std::cerr << "MQTT Subscribe Error: [" << pTopic << "]the topic is not valid UTF-8\n";
+        std::cerr << "MQTT Subscribe Error: [" << mTopicList << "]the topic is not valid UTF-8\n";
         break;
 #if LIBMOSQUITTO_REVISION > 7
     case MOSQ_ERR_OVERSIZE_PACKET:
-        std::cerr << "MQTT Subscribe Error: [" << pTopic << "] Over sized packet\n";
+        std::cerr << "MQTT Subscribe Error: [" << mTopicList << "] Over sized packet\n";
         break;
 #endif
     }
@@ -23,43 +23,135 @@
 #define MQTT_QOS_AT_LEAST_ONCE  1 // QoS level 1 guarantees that a message is delivered at least one time to the receiver. 
 #define MQTT_QOS_EXACTLY_ONCE   2 // QoS 2 is the highest level of service in MQTT. This level guarantees that each message is received only once by the intended recipients.
 
+#define MQTT_MAX_TOPIC_SIZE     64  // Longer topics are dropped, all of ours are well under this.
+#define MQTT_MAX_PAYLOAD_SIZE   64  // Longer payloads are dropped, we only send short values.
+#define MQTT_INGEST_QUEUE_SIZE  256 // Must be a power of two. At 1Hz per sensor this is minutes of slack.
 
+#include "SPSCQueue.h"
+#include "MQTTSessionLog.h"
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <functional>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
 
 class MQTTData
 {
 public:
+    enum ConnectionState
+    {
+        MQTT_DISCONNECTED,  //!< Not started or shutting down.
+        MQTT_CONNECTING,    //!< Waiting for the broker to accept us.
+        MQTT_CONNECTED,     //!< Subscribed and receiving.
+        MQTT_WAITING        //!< Lost or failed to connect, waiting for the backoff to expire.
+    };
+
     MQTTData(const std::string& pHost,int pPort,
         const std::vector<std::string> pTopics,
-        std::function<void(const std::string &pTopic,const std::string &pData)> pOnData);
+        std::function<void(std::string_view pTopic,std::string_view pData)> pOnData);
+
+    /**
+     * @brief Replays a session recorded with StartRecording instead of connecting to a broker.
+     * Messages go through the same queue and OnData callback as live ones.
+     * @param pSpeed 1 for real time, 10 for ten times faster and so on. Zero or less for as fast as the UI can take them.
+     */
+    MQTTData(const std::string& pReplayFile,float pSpeed,
+        std::function<void(std::string_view pTopic,std::string_view pData)> pOnData);
 
     ~MQTTData();
 
+    /**
+     * @brief Appends every message received from now on to a binary log, see MQTTSessionLog.h
+     */
+    bool StartRecording(const std::string& pFileName);
+
     bool GetOK()const{return mOk;}
-    bool GetConnected()const{return mConnected;}
+    bool GetConnected()const{return mState == MQTT_CONNECTED;}
+    ConnectionState GetConnectionState()const{return mState;}
+    uint32_t GetReconnectCount()const{return mReconnects;}
+
+    /**
+     * @brief Must be called from the UI thread once per frame, never blocks.
+     * Drains the ingest queue, only the latest value for each topic is passed to the OnData callback.
+     * This means the OnData callback is always called from the UI thread.
+     * The views passed to OnData are only valid for the duration of the call.
+     */
     void Tick();
 
+    uint32_t GetDroppedCount()const{return mDropped;}
+    uint32_t GetCoalescedCount()const{return mCoalesced;}
+
+    /**
+     * @brief Called from Tick after each OnData call with the steady_clock time, in nanoseconds, the message arrived.
+     * Used by the latency benchmark, see Benchmark.h
+     */
+    void SetOnDelivered(std::function<void(int64_t pReceivedNS)> pOnDelivered){mOnDelivered = pOnDelivered;}
 
 private:
+    struct Message
+    {
+        int64_t received;   //!< steady_clock nanoseconds, when the network thread got it.
+        bool retained;      //!< Sent by the broker when we subscribed, the last value it saw.
+        uint8_t topicSize;
+        uint8_t payloadSize;
+        char topic[MQTT_MAX_TOPIC_SIZE];
+        char payload[MQTT_MAX_PAYLOAD_SIZE];
+    };
+
+
     const std::string mHost;
     const int mPort;
     const std::vector<std::string> mTopics;
-    std::function<void(const std::string &pTopic,const std::string &pData)> mOnData;
+    std::function<void(std::string_view pTopic,std::string_view pData)> mOnData;
+    std::function<void(int64_t pReceivedNS)> mOnDelivered;
     bool mOk = false;
-    bool mConnected = false;
     struct mosquitto *mMQTT = NULL;
 
+    // Connection management, all on mNetworkThread so the UI never waits on DNS or TCP.
+    std::thread mNetworkThread;
+    std::atomic<bool> mRunning{false};
+    std::atomic<ConnectionState> mState{MQTT_DISCONNECTED};
+    std::atomic<uint32_t> mReconnects{0};
+    std::mutex mSleepMutex;
+    std::condition_variable mSleeper; //!< Lets the destructor cut a backoff wait short.
+
+    std::atomic<MQTTSessionWriter*> mRecorder{nullptr}; //!< Only used by the network thread once set.
+
+    SPSCQueue<Message,MQTT_INGEST_QUEUE_SIZE> mIngest; //!< Written by the mosquitto thread, read by the UI thread in Tick.
+    std::vector<Message> mLatest; //!< UI thread only, one entry per topic seen this frame. Capacity reserved up front.
+    std::atomic<uint32_t> mDropped{0}; //!< Messages that did not fit in the queue or were too big.
+    uint32_t mCoalesced = 0; //!< Messages replaced by a newer one for the same topic before they were passed on.
+
+    std::vector<char*> mSubscriptions; //!< mTopics in the form mosquitto_subscribe_multiple wants.
+    std::string mTopicList; //!< For error messages.
+
+    // Time to first value, so we can see how long the display takes to fill after connecting.
+    std::atomic<int64_t> mConnectedAt{0};
+    std::atomic<uint32_t> mConnectGeneration{0};
+    uint32_t mFirstValueGeneration = 0;
+    std::vector<Message> mFirstValues; //!< UI thread only, the topics seen since we connected.
+
 
     static void CallbackConnected(struct mosquitto *mosq, void *userdata, int result);
     static void CallbackMessage(struct mosquitto *mosq, void *userdata, const struct mosquitto_message *message);
 
+    void NetworkLoop();
+    void ReplayLoop(const std::string& pReplayFile,float pSpeed);
+    bool WaitBeforeRetry(uint32_t pMilliseconds);
+    bool Ingest(std::string_view pTopic,std::string_view pPayload,bool pRetained);
+
     void OnConnected();
+    void OnMessage(const struct mosquitto_message *message);
+    void DrainIngest();
+    void ReportFirstValue(const Message& pMessage);
+    static int64_t GetTimeNS();
 
-    void Subscribe(const std::string& pTopic);
+    void Subscribe();
 };
 
 #endif //#ifndef MQTTDATA_H
\ No newline at end of file
@@ -0,0 +1,173 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "MQTTPayload.h"
+
+#include <charconv>
+#include <atomic>
+
+namespace mqttpayload{
+
+static std::atomic<uint32_t> MalformedCount{0};
+
+static bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static std::string_view Trim(std::string_view pData)
+{
+    while( pData.size() > 0 && IsSpace(pData.front()) )
+        pData.remove_prefix(1);
+
+    while( pData.size() > 0 && IsSpace(pData.back()) )
+        pData.remove_suffix(1);
+
+    return pData;
+}
+
+static bool Malformed()
+{
+    MalformedCount++;
+    return false;
+}
+
+static bool IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+bool DecodeInt(std::string_view pData,int32_t& rValue)
+{
+    pData = Trim(pData);
+    const char* first = pData.data();
+    const char* last = first + pData.size();
+    if( first != last && *first == '+' )
+        first++;
+
+    int32_t value;
+    const std::from_chars_result r = std::from_chars(first,last,value);
+    if( r.ec != std::errc() )
+        return Malformed();
+
+    const char* p = r.ptr;
+    if( p != last && *p == '.' )
+    {
+        for( p++ ; p != last && IsDigit(*p) ; p++ ){}
+    }
+
+    if( p != last )
+        return Malformed();
+
+    rValue = value;
+    return true;
+}
+
+bool DecodeFloat(std::string_view pData,float& rValue)
+{
+    pData = Trim(pData);
+    const char* first = pData.data();
+    const char* last = first + pData.size();
+    if( first != last && *first == '+' )
+        first++;
+
+    float value;
+    const std::from_chars_result r = std::from_chars(first,last,value);
+    if( r.ec != std::errc() || r.ptr != last )
+        return Malformed();
+
+    rValue = value;
+    return true;
+}
+
+bool DecodeLeadingFloat(std::string_view pData,float& rValue)
+{
+    pData = Trim(pData);
+    const char* first = pData.data();
+    const char* last = first + pData.size();
+    if( first != last && *first == '+' )
+        first++;
+
+    float value;
+    const std::from_chars_result r = std::from_chars(first,last,value);
+    if( r.ec != std::errc() )
+        return Malformed();
+
+    rValue = value;
+    return true;
+}
+
+bool DecodeFixed(std::string_view pData,int64_t& rHundredths)
+{
+    pData = Trim(pData);
+    const char* first = pData.data();
+    const char* last = first + pData.size();
+
+    bool negative = false;
+    if( first != last && (*first == '-' || *first == '+') )
+    {
+        negative = *first == '-';
+        first++;
+    }
+
+    if( first == last || *first == '-' )
+        return Malformed();
+
+    int64_t whole = 0;
+    const char* p = first;
+    if( IsDigit(*p) )
+    {
+        const std::from_chars_result r = std::from_chars(p,last,whole);
+        if( r.ec != std::errc() )
+            return Malformed();
+        p = r.ptr;
+    }
+
+    int64_t fraction = 0;
+    if( p != last && *p == '.' )
+    {
+        p++;
+        int places = 0;
+        for( ; p != last && IsDigit(*p) ; p++, places++ )
+        {
+            if( places < 2 )
+                fraction = (fraction * 10) + (*p - '0');
+        }
+
+        if( places == 1 )
+            fraction *= 10;
+        else if( places == 0 && p - 1 == first )
+            return Malformed();// Just a '.'
+    }
+    else if( p == first )
+    {
+        return Malformed();
+    }
+
+    if( p != last )
+        return Malformed();
+
+    const int64_t value = (whole * 100) + fraction;
+    rHundredths = negative ? -value : value;
+    return true;
+}
+
+uint32_t GetMalformedCount()
+{
+    return MalformedCount;
+}
+
+};//namespace mqttpayload
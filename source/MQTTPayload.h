@@ -0,0 +1,40 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef MQTT_PAYLOAD_H
+#define MQTT_PAYLOAD_H
+
+#include <string_view>
+#include <cstdint>
+
+/**
+ * @brief Decodes MQTT payloads in place, they are not null terminated so everything works on string_view.
+ * Built on std::from_chars, so no allocation, no locale and no exceptions.
+ * A payload is malformed if it is not a number optionally surrounded by white space.
+ * Malformed payloads are counted and the decode returns false, the caller keeps its old value.
+ */
+namespace mqttpayload{
+
+bool DecodeInt(std::string_view pData,int32_t& rValue);//!< Accepts a fractional part and truncates it, as std::stoi did.
+bool DecodeFloat(std::string_view pData,float& rValue);
+bool DecodeLeadingFloat(std::string_view pData,float& rValue);//!< Ignores anything after the number, such as the C in 12.5C.
+bool DecodeFixed(std::string_view pData,int64_t& rHundredths);//!< Decimal with two places, so prices and temperatures keep their exact value.
+
+uint32_t GetMalformedCount();
+
+};//namespace mqttpayload
+
+#endif //#ifndef MQTT_PAYLOAD_H
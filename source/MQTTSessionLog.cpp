@@ -0,0 +1,185 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "MQTTSessionLog.h"
+
+#include <iostream>
+#include <cstring>
+
+static const char LOG_MAGIC[8] = {'M','Q','T','T','L','O','G','1'};
+static const int RECORD_TOPIC = 1;
+static const int RECORD_MESSAGE = 2;
+static const uint64_t MAX_RECORD_SIZE = 64 * 1024; // Anything bigger means the file is corrupt.
+
+MQTTSessionWriter::~MQTTSessionWriter()
+{
+    if( mFile )
+    {
+        fclose(mFile);
+    }
+}
+
+bool MQTTSessionWriter::Open(const std::string& pFileName)
+{
+    mFile = fopen(pFileName.c_str(),"wb");
+    if( mFile == nullptr )
+    {
+        std::cerr << "Failed to open MQTT session log " << pFileName << " for writing\n";
+        return false;
+    }
+
+    fwrite(LOG_MAGIC,sizeof(LOG_MAGIC),1,mFile);
+    return true;
+}
+
+void MQTTSessionWriter::Record(int64_t pTimeNS,std::string_view pTopic,std::string_view pPayload)
+{
+    if( mFile == nullptr )
+        return;
+
+    size_t id = 0;
+    while( id < mTopics.size() && mTopics[id] != pTopic )
+    {
+        id++;
+    }
+
+    if( id == mTopics.size() )
+    {
+        mTopics.emplace_back(pTopic);
+        fputc(RECORD_TOPIC,mFile);
+        WriteVarInt(id);
+        WriteVarInt(pTopic.size());
+        fwrite(pTopic.data(),pTopic.size(),1,mFile);
+    }
+
+    if( mCount == 0 )
+    {
+        mLastTime = pTimeNS;
+    }
+
+    fputc(RECORD_MESSAGE,mFile);
+    WriteVarInt((uint64_t)(pTimeNS - mLastTime) / 1000);
+    WriteVarInt(id);
+    WriteVarInt(pPayload.size());
+    fwrite(pPayload.data(),pPayload.size(),1,mFile);
+
+    // Round down to the microsecond we wrote, so rounding errors don't add up over a long session.
+    mLastTime += ((pTimeNS - mLastTime) / 1000) * 1000;
+    mCount++;
+}
+
+void MQTTSessionWriter::WriteVarInt(uint64_t pValue)
+{
+    do
+    {
+        uint8_t byte = pValue & 0x7f;
+        pValue >>= 7;
+        if( pValue )
+        {
+            byte |= 0x80;
+        }
+        fputc(byte,mFile);
+    }while( pValue );
+}
+
+MQTTSessionReader::~MQTTSessionReader()
+{
+    if( mFile )
+    {
+        fclose(mFile);
+    }
+}
+
+bool MQTTSessionReader::Open(const std::string& pFileName)
+{
+    mFile = fopen(pFileName.c_str(),"rb");
+    if( mFile == nullptr )
+    {
+        std::cerr << "Failed to open MQTT session log " << pFileName << "\n";
+        return false;
+    }
+
+    char magic[sizeof(LOG_MAGIC)];
+    if( fread(magic,sizeof(magic),1,mFile) != 1 || memcmp(magic,LOG_MAGIC,sizeof(magic)) != 0 )
+    {
+        std::cerr << pFileName << " is not an MQTT session log\n";
+        fclose(mFile);
+        mFile = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool MQTTSessionReader::Next(int64_t& rTimeNS,std::string_view& rTopic,std::string_view& rPayload)
+{
+    if( mFile == nullptr )
+        return false;
+
+    for(;;)
+    {
+        const int type = fgetc(mFile);
+        if( type == RECORD_TOPIC )
+        {
+            uint64_t id,size;
+            std::string topic;
+            if( !ReadVarInt(id) || id != mTopics.size() || !ReadVarInt(size) || !ReadBytes(topic,size) )
+                return false;
+
+            mTopics.push_back(topic);
+        }
+        else if( type == RECORD_MESSAGE )
+        {
+            uint64_t delta,id,size;
+            if( !ReadVarInt(delta) || !ReadVarInt(id) || id >= mTopics.size() || !ReadVarInt(size) || !ReadBytes(mPayload,size) )
+                return false;
+
+            mTime += delta * 1000;
+            rTimeNS = mTime;
+            rTopic = mTopics[id];
+            rPayload = mPayload;
+            return true;
+        }
+        else
+        {// EOF or corrupt.
+            return false;
+        }
+    }
+}
+
+bool MQTTSessionReader::ReadVarInt(uint64_t& rValue)
+{
+    rValue = 0;
+    for( int shift = 0 ; shift < 64 ; shift += 7 )
+    {
+        const int byte = fgetc(mFile);
+        if( byte == EOF )
+            return false;
+
+        rValue |= (uint64_t)(byte & 0x7f) << shift;
+        if( (byte & 0x80) == 0 )
+            return true;
+    }
+    return false;
+}
+
+bool MQTTSessionReader::ReadBytes(std::string& rBytes,uint64_t pSize)
+{
+    if( pSize > MAX_RECORD_SIZE )
+        return false;
+
+    rBytes.resize(pSize);
+    return pSize == 0 || fread(&rBytes[0],pSize,1,mFile) == 1;
+}
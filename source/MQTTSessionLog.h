@@ -0,0 +1,82 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef MQTT_SESSION_LOG_H
+#define MQTT_SESSION_LOG_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+/**
+ * File layout, all numbers are unsigned LEB128 varints so a typical message costs a handful of bytes plus its payload.
+ *  "MQTTLOG1"
+ *  Then records, each starting with a type byte.
+ *   RECORD_TOPIC   : id, length, topic bytes. Written the first time a topic is seen.
+ *   RECORD_MESSAGE : microseconds since the previous message, topic id, length, payload bytes.
+ */
+
+/**
+ * @brief Appends MQTT messages to a compact binary log. Only call Record from one thread.
+ */
+class MQTTSessionWriter
+{
+public:
+    ~MQTTSessionWriter();
+
+    bool Open(const std::string& pFileName);
+    void Record(int64_t pTimeNS,std::string_view pTopic,std::string_view pPayload);
+    uint32_t GetCount()const{return mCount;}
+
+private:
+    FILE* mFile = nullptr;
+    std::vector<std::string> mTopics; //!< Index is the topic id.
+    int64_t mLastTime = 0;
+    uint32_t mCount = 0;
+
+    void WriteVarInt(uint64_t pValue);
+};
+
+/**
+ * @brief Reads back a log written by MQTTSessionWriter.
+ */
+class MQTTSessionReader
+{
+public:
+    ~MQTTSessionReader();
+
+    bool Open(const std::string& pFileName);
+
+    /**
+     * @brief Reads the next message, the views are valid until the next call.
+     * @param rTimeNS Nanoseconds since the first message in the log.
+     * @return false at the end of the log or if it's corrupt.
+     */
+    bool Next(int64_t& rTimeNS,std::string_view& rTopic,std::string_view& rPayload);
+
+private:
+    FILE* mFile = nullptr;
+    std::vector<std::string> mTopics;
+    std::string mPayload;
+    int64_t mTime = 0;
+
+    bool ReadVarInt(uint64_t& rValue);
+    bool ReadBytes(std::string& rBytes,uint64_t pSize);
+};
+
+#endif //#ifndef MQTT_SESSION_LOG_H
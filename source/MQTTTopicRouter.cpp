@@ -0,0 +1,212 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "MQTTTopicRouter.h"
+#include "MQTTPayload.h"
+
+#include <assert.h>
+#include <iostream>
+
+MQTTTopicRouter::MQTTTopicRouter()
+{
+    mNodes.emplace_back();// The root
+}
+
+void MQTTTopicRouter::OnText(const std::string& pFilter,TextHandler pHandler)
+{
+    Handler h;
+    h.type = HANDLER_TEXT;
+    h.text = pHandler;
+    AddHandler(pFilter,h);
+}
+
+void MQTTTopicRouter::OnInt(const std::string& pFilter,IntHandler pHandler)
+{
+    Handler h;
+    h.type = HANDLER_INT;
+    h.integer = pHandler;
+    AddHandler(pFilter,h);
+}
+
+void MQTTTopicRouter::OnFloat(const std::string& pFilter,FloatHandler pHandler)
+{
+    Handler h;
+    h.type = HANDLER_FLOAT;
+    h.real = pHandler;
+    AddHandler(pFilter,h);
+}
+
+size_t MQTTTopicRouter::Dispatch(std::string_view pTopic,std::string_view pData)const
+{
+    if( pTopic.size() == 0 )
+        return 0;
+
+    Payload payload(pData);
+    return Match(0,pTopic,0,true,pTopic,payload);
+}
+
+void MQTTTopicRouter::AddHandler(const std::string& pFilter,Handler pHandler)
+{
+    assert( pFilter.size() > 0 );
+
+    const std::string_view filter(pFilter);
+    uint32_t node = 0;
+    size_t start = 0;
+    for(;;)
+    {
+        const size_t end = filter.find('/',start);
+        const std::string_view level = filter.substr(start,end == std::string_view::npos ? std::string_view::npos : end - start);
+
+        if( level == "#" && end != std::string_view::npos )
+        {
+            std::cerr << "MQTTTopicRouter: '#' must be the last level in " << pFilter << "\n";
+            return;
+        }
+
+        node = GetChild(node,level);
+
+        if( end == std::string_view::npos )
+            break;
+        start = end + 1;
+    }
+
+    mNodes[node].handlers.push_back((uint32_t)mHandlers.size());
+    mHandlers.push_back(pHandler);
+}
+
+uint32_t MQTTTopicRouter::GetChild(uint32_t pNode,std::string_view pLevel)
+{
+    // Note, mNodes may grow so never hold a reference over an emplace_back.
+    if( pLevel == "+" || pLevel == "#" )
+    {
+        const bool single = pLevel == "+";
+        const int32_t wildCard = single ? mNodes[pNode].singleLevel : mNodes[pNode].multiLevel;
+        if( wildCard >= 0 )
+            return (uint32_t)wildCard;
+
+        const int32_t newNode = (int32_t)mNodes.size();
+        if( single )
+            mNodes[pNode].singleLevel = newNode;
+        else
+            mNodes[pNode].multiLevel = newNode;
+
+        mNodes.emplace_back();
+        mNodes.back().level = std::string(pLevel);
+        return (uint32_t)newNode;
+    }
+
+    for( uint32_t c : mNodes[pNode].children )
+    {
+        if( mNodes[c].level == pLevel )
+            return c;
+    }
+
+    const uint32_t newNode = (uint32_t)mNodes.size();
+    mNodes[pNode].children.push_back(newNode);
+    mNodes.emplace_back();
+    mNodes.back().level = std::string(pLevel);
+    return newNode;
+}
+
+size_t MQTTTopicRouter::Match(uint32_t pNode,std::string_view pTopic,size_t pLevelStart,bool pFirstLevel,std::string_view pFullTopic,Payload& pData)const
+{
+    const Node& node = mNodes[pNode];
+
+    // Wild cards do not match topics starting with $, they are reserved for the broker.
+    const bool systemTopic = pFirstLevel && pTopic.size() > 0 && pTopic[0] == '$';
+
+    size_t called = 0;
+    if( node.multiLevel >= 0 && !systemTopic )
+    {// '#' also matches the parent level, so 'sport/#' matches 'sport'.
+        called += CallHandlers(mNodes[node.multiLevel],pFullTopic,pData);
+    }
+
+    if( pLevelStart == std::string_view::npos )
+    {
+        return called + CallHandlers(node,pFullTopic,pData);
+    }
+
+    const size_t end = pTopic.find('/',pLevelStart);
+    const std::string_view level = pTopic.substr(pLevelStart,end == std::string_view::npos ? std::string_view::npos : end - pLevelStart);
+    const size_t next = end == std::string_view::npos ? std::string_view::npos : end + 1;
+
+    for( uint32_t c : node.children )
+    {
+        if( mNodes[c].level == level )
+        {
+            called += Match(c,pTopic,next,false,pFullTopic,pData);
+            break;
+        }
+    }
+
+    if( node.singleLevel >= 0 && !systemTopic )
+    {
+        called += Match((uint32_t)node.singleLevel,pTopic,next,false,pFullTopic,pData);
+    }
+
+    return called;
+}
+
+size_t MQTTTopicRouter::CallHandlers(const Node& pNode,std::string_view pTopic,Payload& pData)const
+{
+    size_t called = 0;
+    for( uint32_t h : pNode.handlers )
+    {
+        const Handler& handler = mHandlers[h];
+        switch( handler.type )
+        {
+        case HANDLER_TEXT:
+            handler.text(pTopic,pData.text);
+            called++;
+            break;
+
+        case HANDLER_INT:
+            if( pData.GetInt() )
+            {
+                handler.integer(pData.integer);
+                called++;
+            }
+            break;
+
+        case HANDLER_FLOAT:
+            if( pData.GetFloat() )
+            {
+                handler.real(pData.real);
+                called++;
+            }
+            break;
+        }
+    }
+    return called;
+}
+
+bool MQTTTopicRouter::Payload::GetInt()
+{
+    if( intState == DECODE_PENDING )
+    {
+        intState = mqttpayload::DecodeInt(text,integer) ? DECODE_OK : DECODE_FAILED;
+    }
+    return intState == DECODE_OK;
+}
+
+bool MQTTTopicRouter::Payload::GetFloat()
+{
+    if( floatState == DECODE_PENDING )
+    {
+        floatState = mqttpayload::DecodeFloat(text,real) ? DECODE_OK : DECODE_FAILED;
+    }
+    return floatState == DECODE_OK;
+}
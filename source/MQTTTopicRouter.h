@@ -0,0 +1,109 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef MQTT_TOPIC_ROUTER_H
+#define MQTT_TOPIC_ROUTER_H
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <cstdint>
+
+/**
+ * @brief Maps MQTT topics to handlers using a trie of topic levels.
+ * Filters follow the MQTT rules, '+' matches exactly one level and '#' matches the rest, including none.
+ * Build it at start up then only call Dispatch, that makes it safe to share between threads.
+ * Dispatch costs O(topic levels) and does not allocate.
+ */
+class MQTTTopicRouter
+{
+public:
+    typedef std::function<void(std::string_view pTopic,std::string_view pData)> TextHandler;
+    typedef std::function<void(int32_t pValue)> IntHandler;
+    typedef std::function<void(float pValue)> FloatHandler;
+
+    MQTTTopicRouter();
+
+    void OnText(const std::string& pFilter,TextHandler pHandler);
+    void OnInt(const std::string& pFilter,IntHandler pHandler);
+    void OnFloat(const std::string& pFilter,FloatHandler pHandler);
+
+    /**
+     * @brief Calls every handler whose filter matches the topic.
+     * The payload is decoded at most once per type no matter how many handlers match.
+     * Int and float handlers are skipped if the payload is not a number, see mqttpayload::GetMalformedCount.
+     * @return The number of handlers called.
+     */
+    size_t Dispatch(std::string_view pTopic,std::string_view pData)const;
+
+private:
+    enum HandlerType
+    {
+        HANDLER_TEXT,
+        HANDLER_INT,
+        HANDLER_FLOAT
+    };
+
+    struct Handler
+    {
+        HandlerType type;
+        TextHandler text;
+        IntHandler integer;
+        FloatHandler real;
+    };
+
+    struct Node
+    {
+        std::string level;
+        std::vector<uint32_t> children; //!< Literal levels.
+        int32_t singleLevel = -1;       //!< The '+' child, if any.
+        int32_t multiLevel = -1;        //!< The '#' child, if any.
+        std::vector<uint32_t> handlers;
+    };
+
+    enum DecodeState
+    {
+        DECODE_PENDING,
+        DECODE_OK,
+        DECODE_FAILED
+    };
+
+    // Lazily decoded payload, lives on the stack for the duration of one Dispatch.
+    struct Payload
+    {
+        Payload(std::string_view pText):text(pText){}
+
+        const std::string_view text;
+        int32_t integer = 0;
+        float real = 0.0f;
+        DecodeState intState = DECODE_PENDING;
+        DecodeState floatState = DECODE_PENDING;
+
+        bool GetInt();
+        bool GetFloat();
+    };
+
+    std::vector<Node> mNodes; //!< mNodes[0] is the root.
+    std::vector<Handler> mHandlers;
+
+    void AddHandler(const std::string& pFilter,Handler pHandler);
+    uint32_t GetChild(uint32_t pNode,std::string_view pLevel);
+    size_t Match(uint32_t pNode,std::string_view pTopic,size_t pLevelStart,bool pFirstLevel,std::string_view pFullTopic,Payload& pData)const;
+    size_t CallHandlers(const Node& pNode,std::string_view pTopic,Payload& pData)const;
+};
+
+#endif //#ifndef MQTT_TOPIC_ROUTER_H
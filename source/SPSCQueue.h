@@ -0,0 +1,89 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <array>
+#include <cstddef>
+
+/**
+ * @brief Bounded lock free queue for exactly one producer thread and one consumer thread.
+ * Used to move data from a network thread to the UI thread without a mutex.
+ * SIZE must be a power of two, one slot is never used so the queue holds SIZE-1 items.
+ */
+template<typename T,size_t SIZE> class SPSCQueue
+{
+    static_assert(SIZE >= 2 && (SIZE & (SIZE-1)) == 0,"SPSCQueue SIZE must be a power of two");
+public:
+
+    /**
+     * @brief Producer thread only. Returns a slot to write into or nullptr if the queue is full.
+     * Nothing is visible to the consumer until CommitWrite is called.
+     */
+    T* BeginWrite()
+    {
+        const size_t tail = mTail.load(std::memory_order_relaxed);
+        if( ((tail + 1) & MASK) == mHead.load(std::memory_order_acquire) )
+        {
+            return nullptr;
+        }
+        return &mItems[tail];
+    }
+
+    /**
+     * @brief Producer thread only. Publishes the slot returned by BeginWrite.
+     */
+    void CommitWrite()
+    {
+        const size_t tail = mTail.load(std::memory_order_relaxed);
+        mTail.store((tail + 1) & MASK,std::memory_order_release);
+    }
+
+    /**
+     * @brief Consumer thread only. Returns the oldest item or nullptr if empty.
+     * The item stays valid until EndRead is called.
+     */
+    const T* BeginRead()const
+    {
+        const size_t head = mHead.load(std::memory_order_relaxed);
+        if( head == mTail.load(std::memory_order_acquire) )
+        {
+            return nullptr;
+        }
+        return &mItems[head];
+    }
+
+    /**
+     * @brief Consumer thread only. Hands the slot returned by BeginRead back to the producer.
+     */
+    void EndRead()
+    {
+        const size_t head = mHead.load(std::memory_order_relaxed);
+        mHead.store((head + 1) & MASK,std::memory_order_release);
+    }
+
+private:
+    static constexpr size_t MASK = SIZE - 1;
+
+    // Kept on their own cache lines so the two threads don't fight over them.
+    alignas(64) std::atomic<size_t> mHead{0}; //!< Next item to read, written by the consumer.
+    alignas(64) std::atomic<size_t> mTail{0}; //!< Next item to write, written by the producer.
+    alignas(64) std::array<T,SIZE> mItems;
+};
+
+#endif //#ifndef SPSC_QUEUE_H
@@ -0,0 +1,221 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "SensorHistory.h"
+#include "MQTTTopicRouter.h"
+#include "MQTTPayload.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <ctime>
+
+static uint32_t RoundUpToPowerOfTwo(uint32_t pValue)
+{
+    uint32_t v = 1;
+    while( v < pValue )
+        v <<= 1;
+    return v;
+}
+
+SensorHistory::SensorHistory(uint32_t pCapacity)
+{
+    // Every bucket must fit a whole number of times into the ring, so when a sample is overwritten so is the bucket it was in.
+    const uint32_t largestBucket = 1u << (FIRST_LEVEL_SHIFT + LEVEL_SHIFT_STEP * (SENSOR_HISTORY_LEVELS - 1));
+    const uint32_t capacity = RoundUpToPowerOfTwo(std::max(pCapacity,largestBucket));
+
+    mSamples.resize(capacity);
+    mMask = capacity - 1;
+
+    for( uint32_t l = 0 ; l < SENSOR_HISTORY_LEVELS ; l++ )
+    {
+        Level& level = mLevels[l];
+        level.shift = FIRST_LEVEL_SHIFT + LEVEL_SHIFT_STEP * l;
+        level.buckets.resize(capacity >> level.shift);
+        level.mask = (uint32_t)level.buckets.size() - 1;
+    }
+}
+
+void SensorHistory::Add(float pValue)
+{
+    mSamples[mTotal & mMask] = pValue;
+
+    for( Level& level : mLevels )
+    {
+        Bucket& b = level.buckets[(mTotal >> level.shift) & level.mask];
+        if( (mTotal & ((1u << level.shift) - 1)) == 0 )
+        {// First sample of the bucket, this is where it wraps over the oldest data.
+            b.min = b.max = pValue;
+            b.sum = pValue;
+            b.count = 1;
+        }
+        else
+        {
+            b.min = std::min(b.min,pValue);
+            b.max = std::max(b.max,pValue);
+            b.sum += pValue;
+            b.count++;
+        }
+    }
+
+    mTotal++;
+}
+
+void SensorHistory::AddAt(int64_t pTime,float pValue)
+{
+    if( mTotal > 0 && pTime >= mLastTime )
+    {
+        if( pTime == mLastTime )
+            return;
+
+        // Hold the last value over the seconds nothing arrived, no more than a full ring as that replaces everything.
+        const float last = mSamples[(mTotal - 1) & mMask];
+        const int64_t gap = std::min<int64_t>(pTime - mLastTime - 1,(int64_t)mMask + 1);
+        for( int64_t n = 0 ; n < gap ; n++ )
+        {
+            Add(last);
+        }
+    }
+    // Else the first sample, or the clock went back. Carry on from here.
+
+    Add(pValue);
+    mLastTime = pTime;
+}
+
+uint32_t SensorHistory::GetCount()const
+{
+    return (uint32_t)std::min<uint64_t>(mTotal,(uint64_t)mMask + 1);
+}
+
+size_t SensorHistory::Downsample(Column* rColumns,size_t pColumns)const
+{
+    const uint64_t count = GetCount();
+    if( count == 0 || pColumns == 0 )
+        return 0;
+
+    const size_t columns = (size_t)std::min<uint64_t>(count,pColumns);
+    const uint64_t first = mTotal - count;
+    const uint64_t perColumn = count / columns;
+
+    // Largest bucket that is no bigger than a column, so each column reads a handful of buckets.
+    const Level* level = nullptr;
+    for( const Level& l : mLevels )
+    {
+        if( (1ull << l.shift) <= perColumn )
+            level = &l;
+    }
+
+    for( size_t c = 0 ; c < columns ; c++ )
+    {
+        const uint64_t start = first + (count * c) / columns;
+        const uint64_t end = first + (count * (c + 1)) / columns;
+
+        Bucket total = {0.0f,0.0f,0.0,0};
+        if( level )
+        {
+            // Columns don't line up with buckets, round outwards but never into a bucket that has been partly overwritten.
+            uint64_t b = start >> level->shift;
+            if( (b << level->shift) < first )
+                b++;
+
+            const uint64_t last = (end - 1) >> level->shift;
+            for( ; b <= last ; b++ )
+            {
+                const Bucket& bucket = level->buckets[b & level->mask];
+                if( total.count == 0 )
+                {
+                    total = bucket;
+                }
+                else
+                {
+                    total.min = std::min(total.min,bucket.min);
+                    total.max = std::max(total.max,bucket.max);
+                    total.sum += bucket.sum;
+                    total.count += bucket.count;
+                }
+            }
+        }
+
+        if( total.count == 0 )
+        {// Less than a bucket, or the oldest column while the ring is wrapping. Read the samples.
+            AddSamples(total,start,end);
+        }
+
+        rColumns[c].min = total.min;
+        rColumns[c].max = total.max;
+        rColumns[c].mean = (float)(total.sum / total.count);
+    }
+
+    return columns;
+}
+
+void SensorHistory::AddSamples(Bucket& rTotal,uint64_t pFirst,uint64_t pLast)const
+{
+    for( uint64_t n = pFirst ; n < pLast ; n++ )
+    {
+        const float v = mSamples[n & mMask];
+        if( rTotal.count == 0 )
+        {
+            rTotal.min = rTotal.max = v;
+        }
+        else
+        {
+            rTotal.min = std::min(rTotal.min,v);
+            rTotal.max = std::max(rTotal.max,v);
+        }
+        rTotal.sum += v;
+        rTotal.count++;
+    }
+}
+
+TelemetryHistory::TelemetryHistory(MQTTTopicRouter& pRouter):mRouter(pRouter)
+{
+}
+
+const SensorHistory* TelemetryHistory::AddSeries(const std::string& pTopic)
+{
+    assert( pTopic.find_first_of("+#") == std::string::npos );
+
+    for( size_t n = 0 ; n < mTopics.size() ; n++ )
+    {
+        if( mTopics[n] == pTopic )
+            return mSeries[n].get();
+    }
+
+    SensorHistory* history = new SensorHistory(SENSOR_HISTORY_SAMPLES);
+    mSeries.emplace_back(history);
+    mTopics.push_back(pTopic);
+
+    mRouter.OnText(pTopic,[history](std::string_view pTopic,std::string_view pData)
+    {
+        float value;
+        if( mqttpayload::DecodeLeadingFloat(pData,value) )
+        {
+            history->AddAt((int64_t)std::time(nullptr),value);
+        }
+    });
+
+    return history;
+}
+
+SensorHistory* TelemetryHistory::FindSeries(std::string_view pTopic)
+{
+    for( size_t n = 0 ; n < mTopics.size() ; n++ )
+    {
+        if( mTopics[n] == pTopic )
+            return mSeries[n].get();
+    }
+    return nullptr;
+}
@@ -0,0 +1,124 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef SENSOR_HISTORY_H
+#define SENSOR_HISTORY_H
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+#define SENSOR_HISTORY_SAMPLES  (24 * 60 * 60) // A day at one sample a second, see AddAt, rounded up to a power of two.
+#define SENSOR_HISTORY_LEVELS   5              // Bucket sizes of 16, 64, 256, 1024 and 4096 samples.
+
+class MQTTTopicRouter;
+
+/**
+ * @brief Fixed size ring buffer of the samples for one sensor with min/max/mean buckets kept up to date as they arrive.
+ * The buckets are a small pyramid so a sparkline of any width reads O(columns) buckets, not every sample.
+ * All memory is allocated in the constructor, Add never allocates.
+ * Written and read on the UI thread only.
+ */
+class SensorHistory
+{
+public:
+    struct Column
+    {
+        float min = 0.0f;
+        float max = 0.0f;
+        float mean = 0.0f;
+    };
+
+    SensorHistory(uint32_t pCapacity);
+
+    void Add(float pValue);
+
+    /**
+     * @brief Adds one sample a second whatever rate pValue arrives at, so the samples held cover a known time.
+     * Only the first value in a second is kept. A gap since the last call is filled with the last value, at most a full ring.
+     * @param pTime Seconds since the epoch.
+     */
+    void AddAt(int64_t pTime,float pValue);
+
+    uint32_t GetCount()const;//!< Number of samples held, at most the capacity.
+    uint64_t GetTotal()const{return mTotal;}//!< Number of samples ever added, changes every Add.
+
+    /**
+     * @brief Splits the samples held, oldest first, into pColumns columns.
+     * If there are fewer samples than columns you get one column per sample.
+     * @return The number of columns written.
+     */
+    size_t Downsample(Column* rColumns,size_t pColumns)const;
+
+private:
+    static constexpr uint32_t FIRST_LEVEL_SHIFT = 4;
+    static constexpr uint32_t LEVEL_SHIFT_STEP = 2;
+
+    struct Bucket
+    {
+        float min;
+        float max;
+        double sum;
+        uint32_t count;
+    };
+
+    struct Level
+    {
+        uint32_t shift;
+        uint32_t mask;  //!< Number of buckets - 1.
+        std::vector<Bucket> buckets;
+    };
+
+    std::vector<float> mSamples;
+    uint32_t mMask; //!< Capacity - 1.
+    uint64_t mTotal = 0;
+    int64_t mLastTime = 0;  //!< Of the last AddAt.
+    std::array<Level,SENSOR_HISTORY_LEVELS> mLevels;
+
+    void AddSamples(Bucket& rTotal,uint64_t pFirst,uint64_t pLast)const;
+};
+
+/**
+ * @brief A SensorHistory for each numeric topic we want trends for.
+ * Series are added at start up and registered with the router, so they fill in as MQTTData::Tick dispatches.
+ * Values are added with AddAt so each history is the last SENSOR_HISTORY_SAMPLES seconds, however often the topic is published.
+ */
+class TelemetryHistory
+{
+public:
+    TelemetryHistory(MQTTTopicRouter& pRouter);
+
+    /**
+     * @brief Start up only, returns the history for the topic creating it if needed.
+     * The payload only needs to start with a number, so "12.5C" is fine.
+     */
+    const SensorHistory* AddSeries(const std::string& pTopic);
+
+    /**
+     * @brief Used to put back the history saved by TelemetryArchive, returns nullptr if the topic has no series.
+     */
+    SensorHistory* FindSeries(std::string_view pTopic);
+
+private:
+    MQTTTopicRouter& mRouter;
+    std::vector<std::unique_ptr<SensorHistory>> mSeries;
+    std::vector<std::string> mTopics;
+};
+
+#endif //#ifndef SENSOR_HISTORY_H
@@ -0,0 +1,106 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "SolarEphemeris.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const double DEGREES = M_PI / 180.0;
+static const double JULIAN_UNIX_EPOCH = 2440587.5;     // Julian date of 1970-01-01 00:00 UTC.
+static const double JULIAN_2000 = 2451545.0;           // Julian date of 2000-01-01 12:00, the J2000 epoch.
+static const double SECONDS_PER_DAY = 86400.0;
+
+SolarEphemeris::SolarEphemeris(double pLatitude,double pLongitude,double pSunAltitude):
+    mLatitude(pLatitude),
+    mLongitude(pLongitude),
+    mSunAltitude(pSunAltitude)
+{
+}
+
+void SolarEphemeris::Build(std::time_t pFrom)
+{
+    const int64_t firstDay = (int64_t)std::floor(pFrom / SECONDS_PER_DAY);
+    mStart = (std::time_t)(firstDay * (int64_t)SECONDS_PER_DAY);
+    mEnd = mStart + (std::time_t)(SOLAR_TABLE_DAYS * (int64_t)SECONDS_PER_DAY);
+
+    // A day either side, the sunrise or sunset for a day can fall in the next or previous UTC day.
+    std::vector<Change> changes;
+    changes.reserve((SOLAR_TABLE_DAYS + 2) * 2);
+    for( int64_t day = firstDay - 1 ; day <= firstDay + SOLAR_TABLE_DAYS ; day++ )
+    {
+        std::time_t rise,set;
+        switch( GetSunTimes(day,rise,set) )
+        {
+        case SUN_RISES_AND_SETS:
+            changes.push_back({rise,true});
+            changes.push_back({set,false});
+            break;
+
+        // Says what the whole day is, dropped below if it was already that.
+        case SUN_NEVER_RISES:
+            changes.push_back({(std::time_t)(day * (int64_t)SECONDS_PER_DAY),false});
+            break;
+
+        case SUN_NEVER_SETS:
+            changes.push_back({(std::time_t)(day * (int64_t)SECONDS_PER_DAY),true});
+            break;
+        }
+    }
+    std::sort(changes.begin(),changes.end(),[](const Change& a,const Change& b){return a.when < b.when;});
+
+    // Only keep real changes so GetIsDay can say when the next one is without looking further.
+    mChanges.clear();
+    for( const Change& c : changes )
+    {
+        if( mChanges.size() == 0 || mChanges.back().day != c.day )
+        {
+            mChanges.push_back(c);
+        }
+    }
+    mDayAtStart = mChanges.size() > 0 ? !mChanges.front().day : true;
+}
+
+bool SolarEphemeris::GetIsDay(std::time_t pTime,std::time_t& rUntil)const
+{
+    const auto next = std::upper_bound(mChanges.begin(),mChanges.end(),pTime,[](std::time_t t,const Change& c){return t < c.when;});
+    rUntil = next != mChanges.end() ? std::min(next->when,mEnd) : mEnd;
+    return next == mChanges.begin() ? mDayAtStart : (next - 1)->day;
+}
+
+SolarEphemeris::SunDay SolarEphemeris::GetSunTimes(int64_t pDay,std::time_t& rRise,std::time_t& rSet)const
+{
+    // https://en.wikipedia.org/wiki/Sunrise_equation
+    const double noon = (double)pDay + (JULIAN_UNIX_EPOCH + 0.5) - JULIAN_2000 - (mLongitude / 360.0);// Mean solar noon, days since J2000.
+    const double anomaly = std::fmod(357.5291 + (0.98560028 * noon),360.0) * DEGREES;
+    const double centre = (1.9148 * std::sin(anomaly)) + (0.0200 * std::sin(2.0 * anomaly)) + (0.0003 * std::sin(3.0 * anomaly));
+    const double eclipticLongitude = std::fmod((anomaly / DEGREES) + centre + 180.0 + 102.9372,360.0) * DEGREES;
+    const double transit = JULIAN_2000 + noon + (0.0053 * std::sin(anomaly)) - (0.0069 * std::sin(2.0 * eclipticLongitude));
+    const double declination = std::asin(std::sin(eclipticLongitude) * std::sin(23.4397 * DEGREES));
+
+    const double latitude = mLatitude * DEGREES;
+    const double hourAngle = (std::sin(mSunAltitude * DEGREES) - (std::sin(latitude) * std::sin(declination))) /
+                             (std::cos(latitude) * std::cos(declination));
+    if( hourAngle > 1.0 )
+        return SUN_NEVER_RISES;
+    if( hourAngle < -1.0 )
+        return SUN_NEVER_SETS;
+
+    const double halfDay = std::acos(hourAngle) / (2.0 * M_PI);// Fraction of a day from sunrise to noon.
+    rRise = (std::time_t)std::llround((transit - halfDay - JULIAN_UNIX_EPOCH) * SECONDS_PER_DAY);
+    rSet = (std::time_t)std::llround((transit + halfDay - JULIAN_UNIX_EPOCH) * SECONDS_PER_DAY);
+    return SUN_RISES_AND_SETS;
+}
@@ -0,0 +1,86 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef SOLAR_EPHEMERIS_H
+#define SOLAR_EPHEMERIS_H
+
+#include <vector>
+#include <ctime>
+#include <cstdint>
+
+#define SOLAR_ALTITUDE_SUNRISE  -0.833  // Degrees, top of the sun on the horizon allowing for refraction. What is_day from Open-Meteo uses.
+#define SOLAR_ALTITUDE_CIVIL    -6.0    // Degrees, end of civil twilight.
+#define SOLAR_TABLE_DAYS        366     // How far ahead Build works out.
+
+/**
+ * @brief Works out when it gets light and dark at a place with no network, so day and night mode
+ * do not depend on the forecast having been fetched. Build fills a table of every change for the next
+ * year, after that GetIsDay is a binary search and also says when the next change is, so the caller
+ * can wait for it rather than asking every frame. Uses the NOAA sunrise equation, good to a minute or
+ * so away from the poles. Where the sun does not rise or set that day the table just has no change.
+ */
+class SolarEphemeris
+{
+public:
+    enum SunDay
+    {
+        SUN_RISES_AND_SETS,
+        SUN_NEVER_RISES,    //!< Never gets up to the altitude, night all day.
+        SUN_NEVER_SETS      //!< Never gets down to the altitude, day all day.
+    };
+
+    /**
+     * @brief pLatitude and pLongitude in degrees, north and east positive. pSunAltitude is the angle of
+     * the sun's centre at which it counts as day, SOLAR_ALTITUDE_SUNRISE or SOLAR_ALTITUDE_CIVIL.
+     */
+    SolarEphemeris(double pLatitude,double pLongitude,double pSunAltitude = SOLAR_ALTITUDE_SUNRISE);
+
+    /**
+     * @brief Works out every change from the start of pFrom's day for SOLAR_TABLE_DAYS.
+     */
+    void Build(std::time_t pFrom);
+
+    bool GetCovers(std::time_t pTime)const{return pTime >= mStart && pTime < mEnd;}
+
+    /**
+     * @brief If it is day at pTime. rUntil is set to when that changes, or the end of the table if it does not.
+     * Only valid when GetCovers(pTime) is true.
+     */
+    bool GetIsDay(std::time_t pTime,std::time_t& rUntil)const;
+
+    /**
+     * @brief Sunrise and sunset, at the altitude given, around the solar noon of pDay, in days since 1970-01-01 UTC.
+     * rRise and rSet are only set for SUN_RISES_AND_SETS.
+     */
+    SunDay GetSunTimes(int64_t pDay,std::time_t& rRise,std::time_t& rSet)const;
+
+private:
+    struct Change
+    {
+        std::time_t when;
+        bool day;   //!< What it is from then on.
+    };
+
+    const double mLatitude;
+    const double mLongitude;
+    const double mSunAltitude;
+    std::time_t mStart = 0;
+    std::time_t mEnd = 0;
+    bool mDayAtStart = true;        //!< For before the first change, or when there are none at all.
+    std::vector<Change> mChanges;   //!< In time order, each one is the opposite of the one before.
+};
+
+#endif //#ifndef SOLAR_EPHEMERIS_H
@@ -0,0 +1,74 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "Sparkline.h"
+#include "style.h"
+
+#include <algorithm>
+
+Sparkline::Sparkline()
+{
+    SET_DEFAULT_ID();
+}
+
+bool Sparkline::OnDraw(eui::Graphics* pGraphics,const eui::Rectangle& pContentRect)
+{
+    if( mHistory == nullptr )
+        return true;
+
+    // Bottom fifth of the cell, under the text.
+    eui::Rectangle area = pContentRect;
+    area.top = area.bottom - (pContentRect.GetHeight() * 0.2f);
+
+    const size_t columnsWanted = std::min((size_t)(area.GetWidth() / SPARKLINE_COLUMN_WIDTH),(size_t)SPARKLINE_MAX_COLUMNS);
+    if( mHistory->GetTotal() != mSampleTotal || columnsWanted != mColumnsWanted )
+    {
+        mSampleTotal = mHistory->GetTotal();
+        mColumnsWanted = columnsWanted;
+        mColumnCount = mHistory->Downsample(mColumns.data(),columnsWanted);
+
+        if( mColumnCount > 0 )
+        {
+            mMin = mColumns[0].min;
+            mMax = mColumns[0].max;
+            for( size_t c = 1 ; c < mColumnCount ; c++ )
+            {
+                mMin = std::min(mMin,mColumns[c].min);
+                mMax = std::max(mMax,mColumns[c].max);
+            }
+        }
+    }
+
+    if( mColumnCount == 0 )
+        return true;
+
+    eui::Style bar;
+    bar.mBackground = dayDisplay ? eui::COLOUR_DARK_GREEN : eui::COLOUR_DARK_GREY;
+
+    const float range = std::max(mMax - mMin,0.001f);
+    const float scale = area.GetHeight() / range;
+    for( size_t c = 0 ; c < mColumnCount ; c++ )
+    {
+        eui::Rectangle r;
+        r.left = area.left + (float)(c * SPARKLINE_COLUMN_WIDTH);
+        r.right = r.left + (SPARKLINE_COLUMN_WIDTH - 1);
+        r.top = area.bottom - ((mColumns[c].max - mMin) * scale);
+        r.bottom = std::max(area.bottom - ((mColumns[c].min - mMin) * scale),r.top + 1.0f);
+        DrawRectangle(pGraphics,r,bar);
+    }
+
+    return true;
+}
@@ -0,0 +1,53 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef SPARKLINE_H
+#define SPARKLINE_H
+
+#include "Graphics.h"
+#include "Element.h"
+#include "SensorHistory.h"
+
+#include <array>
+
+#define SPARKLINE_MAX_COLUMNS   128
+#define SPARKLINE_COLUMN_WIDTH  3   // Pixels, including a one pixel gap.
+
+/**
+ * @brief Draws the min to max range of a SensorHistory as thin bars along the bottom of its rectangle.
+ * Attach it to the element it sits under, it has no text of its own.
+ * The columns are only recalculated when a new sample arrives or the width changes.
+ */
+class Sparkline : public eui::Element
+{
+public:
+    Sparkline();
+
+    void SetHistory(const SensorHistory* pHistory){mHistory = pHistory;}
+
+    virtual bool OnDraw(eui::Graphics* pGraphics,const eui::Rectangle& pContentRect);
+
+private:
+    const SensorHistory* mHistory = nullptr;
+    std::array<SensorHistory::Column,SPARKLINE_MAX_COLUMNS> mColumns;
+    size_t mColumnCount = 0;
+    size_t mColumnsWanted = 0;
+    uint64_t mSampleTotal = 0;  //!< SensorHistory::GetTotal when mColumns was filled.
+    float mMin = 0.0f;
+    float mMax = 0.0f;
+};
+
+#endif //#ifndef SPARKLINE_H
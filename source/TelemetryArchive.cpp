@@ -0,0 +1,656 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "TelemetryArchive.h"
+#include "TelemetryStore.h"
+#include "SensorHistory.h"
+#include "MQTTTopicRouter.h"
+#include "MQTTPayload.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <assert.h>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <filesystem>
+
+static const char ARCHIVE_MAGIC[8] = {'T','L','O','G','0','0','0','1'};
+static constexpr int64_t SECONDS_PER_DAY = 24 * 60 * 60;
+static constexpr size_t MAX_PAYLOAD_SIZE = 64;
+
+enum RecordType
+{
+    RECORD_TOPIC = 1,
+    RECORD_SAMPLES = 2
+};
+
+// Most significant bit first, the last byte is padded with zeros.
+class BitWriter
+{
+public:
+    BitWriter(std::string& rBytes):mBytes(rBytes){}
+
+    void Write(uint64_t pBits,uint32_t pCount)
+    {
+        while( pCount-- > 0 )
+        {
+            if( mUsed == 0 )
+            {
+                mBytes.push_back(0);
+            }
+
+            if( (pBits >> pCount) & 1 )
+            {
+                mBytes.back() |= (char)(0x80 >> mUsed);
+            }
+            mUsed = (mUsed + 1) & 7;
+        }
+    }
+
+private:
+    std::string& mBytes;
+    uint32_t mUsed = 0;
+};
+
+class BitReader
+{
+public:
+    BitReader(const uint8_t* pBytes,size_t pSize):mBytes(pBytes),mSize(pSize){}
+
+    bool Read(uint32_t pCount,uint64_t& rBits)
+    {
+        if( mPos + pCount > mSize * 8 )
+            return false;
+
+        rBits = 0;
+        while( pCount-- > 0 )
+        {
+            rBits = (rBits << 1) | ((mBytes[mPos >> 3] >> (7 - (mPos & 7))) & 1);
+            mPos++;
+        }
+        return true;
+    }
+
+private:
+    const uint8_t* mBytes;
+    const size_t mSize;
+    size_t mPos = 0;
+};
+
+static uint32_t FloatBits(float pValue)
+{
+    uint32_t bits;
+    memcpy(&bits,&pValue,sizeof(bits));
+    return bits;
+}
+
+static void AppendVarInt(std::string& rBytes,uint64_t pValue)
+{
+    while( pValue >= 0x80 )
+    {
+        rBytes.push_back((char)((pValue & 0x7f) | 0x80));
+        pValue >>= 7;
+    }
+    rBytes.push_back((char)pValue);
+}
+
+static bool ReadVarInt(const uint8_t* pBytes,size_t pSize,size_t& rPos,uint64_t& rValue)
+{
+    rValue = 0;
+    for( uint32_t shift = 0 ; shift < 64 && rPos < pSize ; shift += 7 )
+    {
+        const uint8_t b = pBytes[rPos++];
+        rValue |= (uint64_t)(b & 0x7f) << shift;
+        if( (b & 0x80) == 0 )
+            return true;
+    }
+    return false;
+}
+
+static void EncodeSamples(const std::vector<TelemetryArchive::Sample>& pSamples,std::string& rBits)
+{
+    BitWriter bits(rBits);
+
+    uint32_t previous = FloatBits(pSamples[0].value);
+    bits.Write(previous,32);
+
+    int64_t previousTime = pSamples[0].time;
+    int64_t previousDelta = 0;
+    uint32_t leading = 32;// No window yet.
+    uint32_t trailing = 0;
+    for( size_t n = 1 ; n < pSamples.size() ; n++ )
+    {
+        const int64_t delta = pSamples[n].time - previousTime;
+        const int64_t deltaOfDelta = delta - previousDelta;
+        previousTime = pSamples[n].time;
+        previousDelta = delta;
+
+        if( deltaOfDelta == 0 )
+        {
+            bits.Write(0,1);
+        }
+        else if( deltaOfDelta >= -63 && deltaOfDelta <= 64 )
+        {
+            bits.Write(0b10,2);
+            bits.Write((uint64_t)(deltaOfDelta + 63),7);
+        }
+        else if( deltaOfDelta >= -255 && deltaOfDelta <= 256 )
+        {
+            bits.Write(0b110,3);
+            bits.Write((uint64_t)(deltaOfDelta + 255),9);
+        }
+        else if( deltaOfDelta >= -2047 && deltaOfDelta <= 2048 )
+        {
+            bits.Write(0b1110,4);
+            bits.Write((uint64_t)(deltaOfDelta + 2047),12);
+        }
+        else
+        {
+            bits.Write(0b1111,4);
+            bits.Write((uint64_t)deltaOfDelta,64);
+        }
+
+        const uint32_t value = FloatBits(pSamples[n].value);
+        const uint32_t changed = value ^ previous;
+        previous = value;
+        if( changed == 0 )
+        {
+            bits.Write(0,1);
+            continue;
+        }
+
+        bits.Write(1,1);
+        const uint32_t lead = (uint32_t)__builtin_clz(changed);
+        const uint32_t trail = (uint32_t)__builtin_ctz(changed);
+        if( leading < 32 && lead >= leading && trail >= trailing )
+        {// Fits in the last window, just the bits inside it.
+            bits.Write(0,1);
+            bits.Write(changed >> trailing,32 - leading - trailing);
+        }
+        else
+        {
+            leading = lead;
+            trailing = trail;
+            const uint32_t length = 32 - leading - trailing;
+            bits.Write(1,1);
+            bits.Write(leading,5);
+            bits.Write(length - 1,5);
+            bits.Write(changed >> trailing,length);
+        }
+    }
+}
+
+static bool DecodeSamples(const uint8_t* pBytes,size_t pSize,uint64_t pCount,int64_t pFirstTime,std::vector<TelemetryArchive::Sample>& rSamples)
+{
+    BitReader bits(pBytes,pSize);
+    rSamples.clear();
+
+    uint64_t v;
+    if( bits.Read(32,v) == false )
+        return false;
+
+    uint32_t previous = (uint32_t)v;
+    int64_t time = pFirstTime;
+    int64_t delta = 0;
+    uint32_t leading = 0;
+    uint32_t trailing = 0;
+    for( uint64_t n = 0 ; n < pCount ; n++ )
+    {
+        if( n > 0 )
+        {
+            uint32_t prefix = 0;// Number of leading one bits, at most four.
+            while( prefix < 4 && bits.Read(1,v) && v == 1 )
+                prefix++;
+
+            const uint32_t widths[] = {0,7,9,12,64};
+            const int64_t offsets[] = {0,63,255,2047,0};
+            if( prefix > 0 )
+            {
+                if( bits.Read(widths[prefix],v) == false )
+                    return false;
+                delta += (int64_t)v - offsets[prefix];
+            }
+            time += delta;
+
+            if( bits.Read(1,v) == false )
+                return false;
+
+            if( v == 1 )
+            {
+                if( bits.Read(1,v) == false )
+                    return false;
+
+                if( v == 1 )
+                {
+                    uint64_t lead,length;
+                    if( bits.Read(5,lead) == false || bits.Read(5,length) == false )
+                        return false;
+                    leading = (uint32_t)lead;
+                    trailing = 32 - leading - ((uint32_t)length + 1);
+                }
+
+                if( bits.Read(32 - leading - trailing,v) == false )
+                    return false;
+                previous ^= (uint32_t)v << trailing;
+            }
+        }
+
+        TelemetryArchive::Sample s;
+        s.time = time;
+        memcpy(&s.value,&previous,sizeof(float));
+        rSamples.push_back(s);
+    }
+    return true;
+}
+
+TelemetryArchive::TelemetryArchive(MQTTTopicRouter& pRouter,const std::string& pFolder):
+    mRouter(pRouter),
+    mFolder(pFolder)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(mFolder,ec);
+    mOK = std::filesystem::is_directory(mFolder,ec);
+    if( mOK == false )
+    {
+        std::cerr << "TelemetryArchive can not use " << mFolder << ", history will not be saved\n";
+    }
+
+    const int64_t now = GetWallTime();
+    mDay = now / SECONDS_PER_DAY;
+    mNextFlush = now + TELEMETRY_ARCHIVE_FLUSH_SECONDS;
+    mBuffer.reserve(64 * 1024);
+    mBits.reserve(16 * 1024);
+}
+
+TelemetryArchive::~TelemetryArchive()
+{
+    Flush();
+}
+
+void TelemetryArchive::AddSeries(const std::string& pTopic)
+{
+    assert( pTopic.find_first_of("+#") == std::string::npos );
+
+    for( const auto& s : mSeries )
+    {
+        if( s->topic == pTopic )
+            return;
+    }
+
+    Series* series = new Series;
+    series->topic = pTopic;
+    series->pending.reserve(TELEMETRY_ARCHIVE_PENDING_SAMPLES);
+    series->lastPayload.reserve(MAX_PAYLOAD_SIZE);
+    mSeries.emplace_back(series);
+
+    mRouter.OnText(pTopic,[this,series](std::string_view pTopic,std::string_view pData){Record(*series,pData);});
+}
+
+void TelemetryArchive::Restore(TelemetryStore& rStore,TelemetryHistory& rHistory)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const int64_t now = GetWallTime();
+    const int64_t today = now / SECONDS_PER_DAY;
+
+    size_t samples = 0;
+    for( int64_t day = today - TELEMETRY_ARCHIVE_RESTORE_DAYS + 1 ; day <= today ; day++ )
+    {
+        ReadSegment(GetSegmentFileName(day),nullptr,
+            [this,&rHistory,&samples](std::string_view pTopic,int64_t pLastTime,std::string_view pLastPayload,const std::vector<Sample>& pSamples)
+            {
+                SensorHistory* history = rHistory.FindSeries(pTopic);
+                if( history )
+                {
+                    for( const auto& s : pSamples )
+                    {
+                        history->AddAt(s.time,s.value);
+                    }
+                    samples += pSamples.size();
+                }
+
+                for( auto& s : mSeries )
+                {
+                    if( s->topic == pTopic )
+                    {// Not dirty, it's already saved.
+                        s->lastPayload.assign(pLastPayload.substr(0,MAX_PAYLOAD_SIZE));
+                        s->lastTime = pLastTime;
+                    }
+                }
+            });
+    }
+
+    size_t values = 0;
+    for( const auto& s : mSeries )
+    {
+        if( s->lastPayload.size() > 0 && rStore.Restore(s->topic,s->lastPayload,std::max<int64_t>(now - s->lastTime,0) * 1000000000) )
+        {
+            values++;
+        }
+    }
+
+    const auto took = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "TelemetryArchive restored " << values << " values and " << samples << " samples in " << took << "ms\n";
+}
+
+void TelemetryArchive::Tick()
+{
+    const int64_t now = GetWallTime();
+    if( now >= mNextFlush || now / SECONDS_PER_DAY != mDay )
+    {
+        Flush();
+        mDay = now / SECONDS_PER_DAY;
+        mNextFlush = now + TELEMETRY_ARCHIVE_FLUSH_SECONDS;
+    }
+}
+
+void TelemetryArchive::Record(Series& pSeries,std::string_view pPayload)
+{
+    const int64_t now = GetWallTime();
+    pSeries.lastPayload.assign(pPayload.substr(0,MAX_PAYLOAD_SIZE));
+    pSeries.lastTime = now;
+    pSeries.dirty = true;
+
+    float value;
+    if( mqttpayload::DecodeLeadingFloat(pPayload,value) == false )
+        return;
+
+    if( pSeries.pending.size() == pSeries.pending.capacity() )
+    {// Write early rather than grow.
+        Flush();
+        if( pSeries.pending.size() == pSeries.pending.capacity() )
+        {// The write failed, keep the newest samples rather than grow until the write works again.
+            pSeries.pending.erase(pSeries.pending.begin());
+        }
+    }
+    pSeries.pending.push_back({now,value});
+}
+
+void TelemetryArchive::Flush()
+{
+    if( mOK == false )
+        return;
+
+    bool dirty = false;
+    for( const auto& s : mSeries )
+    {
+        dirty |= s->dirty;
+    }
+
+    if( dirty == false )
+        return;
+
+    if( mSegmentDay != mDay )
+    {
+        OpenSegment(mDay);
+    }
+
+    // One append per batch, no fsync. Losing the last few minutes on a power cut is fine, wearing out the card is not.
+    const std::string fileName = GetSegmentFileName(mSegmentDay);
+    const int file = open(fileName.c_str(),O_WRONLY|O_CREAT|O_APPEND,0644);
+    struct stat fileStat;
+    if( file < 0 || fstat(file,&fileStat) != 0 )
+    {// Nothing has been changed, the samples stay pending and are tried again next time.
+        std::cerr << "TelemetryArchive failed to open " << fileName << " " << strerror(errno) << "\n";
+        if( file >= 0 )
+            close(file);
+        return;
+    }
+
+    // The series are only changed once the batch is on disk, ids for topics new to the file are handed out from nextFileID until then.
+    mBuffer.clear();
+    if( fileStat.st_size == 0 )
+    {
+        mBuffer.append(ARCHIVE_MAGIC,sizeof(ARCHIVE_MAGIC));
+    }
+
+    uint32_t nextFileID = mNextFileID;
+    for( const auto& s : mSeries )
+    {
+        if( s->dirty == false )
+            continue;
+
+        uint32_t fileID;
+        if( s->fileID < 0 )
+        {
+            fileID = nextFileID++;
+            mBuffer.push_back(RECORD_TOPIC);
+            AppendVarInt(mBuffer,fileID);
+            AppendVarInt(mBuffer,s->topic.size());
+            mBuffer.append(s->topic);
+        }
+        else
+        {
+            fileID = (uint32_t)s->fileID;
+        }
+
+        mBuffer.push_back(RECORD_SAMPLES);
+        AppendVarInt(mBuffer,fileID);
+        AppendVarInt(mBuffer,(uint64_t)s->lastTime);
+        AppendVarInt(mBuffer,s->lastPayload.size());
+        mBuffer.append(s->lastPayload);
+        AppendVarInt(mBuffer,s->pending.size());
+        if( s->pending.size() > 0 )
+        {
+            mBits.clear();
+            EncodeSamples(s->pending,mBits);
+            AppendVarInt(mBuffer,(uint64_t)s->pending.front().time);
+            AppendVarInt(mBuffer,mBits.size());
+            mBuffer.append(mBits);
+        }
+    }
+
+    if( write(file,mBuffer.data(),mBuffer.size()) != (ssize_t)mBuffer.size() )
+    {
+        std::cerr << "TelemetryArchive failed to write " << fileName << " " << strerror(errno) << "\n";
+        if( ftruncate(file,fileStat.st_size) != 0 )
+        {// Could not take the partial batch back off, have OpenSegment read the file again next time and drop it then.
+            std::cerr << "TelemetryArchive failed to truncate " << fileName << " " << strerror(errno) << "\n";
+            mSegmentDay = -1;
+        }
+        close(file);
+        return;
+    }
+    close(file);
+
+    // Same order as the ids were handed out above.
+    for( auto& s : mSeries )
+    {
+        if( s->dirty == false )
+            continue;
+
+        if( s->fileID < 0 )
+        {
+            s->fileID = (int)mNextFileID++;
+        }
+        s->pending.clear();
+        s->dirty = false;
+    }
+    assert(mNextFileID == nextFileID);
+}
+
+void TelemetryArchive::OpenSegment(int64_t pDay)
+{
+    mSegmentDay = pDay;
+    mNextFileID = 0;
+    for( auto& s : mSeries )
+    {
+        s->fileID = -1;
+    }
+
+    // If we restarted today the file already has topic ids we must carry on from.
+    const std::string fileName = GetSegmentFileName(pDay);
+    const size_t good = ReadSegment(fileName,
+        [this](uint32_t pID,std::string_view pTopic)
+        {
+            mNextFileID = std::max(mNextFileID,pID + 1);
+            for( auto& s : mSeries )
+            {
+                if( s->topic == pTopic )
+                    s->fileID = (int)pID;
+            }
+        },nullptr);
+
+    std::error_code ec;
+    const uintmax_t size = std::filesystem::file_size(fileName,ec);
+    if( !ec && size != good )
+    {// A write was cut short, drop the partial record so what we append can be read.
+        std::cerr << "TelemetryArchive truncating " << fileName << " from " << size << " to " << good << " bytes\n";
+        std::filesystem::resize_file(fileName,good,ec);
+    }
+
+    RemoveOldSegments(pDay);
+}
+
+void TelemetryArchive::RemoveOldSegments(int64_t pToday)
+{
+    // Once a day, when the new day's file is opened, so only a directory listing a day.
+    std::error_code ec;
+    for( const auto& entry : std::filesystem::directory_iterator(mFolder,ec) )
+    {
+        const std::string name = entry.path().filename().string();
+        tm date = {};
+        int used = 0;
+        if( sscanf(name.c_str(),"%4d-%2d-%2d.tlog%n",&date.tm_year,&date.tm_mon,&date.tm_mday,&used) != 3 || used != (int)name.size() )
+            continue;// Not one of ours.
+
+        date.tm_year -= 1900;
+        date.tm_mon -= 1;
+        const int64_t day = (int64_t)timegm(&date) / SECONDS_PER_DAY;
+        if( day <= pToday - TELEMETRY_ARCHIVE_KEEP_DAYS )
+        {
+            std::error_code removeError;
+            if( std::filesystem::remove(entry.path(),removeError) )
+            {
+                std::clog << "TelemetryArchive removed " << name << "\n";
+            }
+            else
+            {
+                std::cerr << "TelemetryArchive failed to remove " << name << " " << removeError.message() << "\n";
+            }
+        }
+    }
+}
+
+std::string TelemetryArchive::GetSegmentFileName(int64_t pDay)const
+{
+    const std::time_t t = (std::time_t)(pDay * SECONDS_PER_DAY);
+    tm date;
+    gmtime_r(&t,&date);
+
+    char name[32];
+    strftime(name,sizeof(name),"%Y-%m-%d.tlog",&date);
+    return (std::filesystem::path(mFolder) / name).string();
+}
+
+size_t TelemetryArchive::ReadSegment(const std::string& pFileName,OnSegmentTopic pOnTopic,OnSegmentSamples pOnSamples)
+{
+    const int file = open(pFileName.c_str(),O_RDONLY);
+    if( file < 0 )
+        return 0;
+
+    struct stat info;
+    if( fstat(file,&info) != 0 || (size_t)info.st_size < sizeof(ARCHIVE_MAGIC) )
+    {
+        close(file);
+        return 0;
+    }
+
+    const size_t size = (size_t)info.st_size;
+    void* map = mmap(nullptr,size,PROT_READ,MAP_PRIVATE,file,0);
+    close(file);
+    if( map == MAP_FAILED )
+        return 0;
+
+    const uint8_t* bytes = (const uint8_t*)map;
+    if( memcmp(bytes,ARCHIVE_MAGIC,sizeof(ARCHIVE_MAGIC)) != 0 )
+    {
+        munmap(map,size);
+        return 0;
+    }
+
+    std::vector<std::string_view> topics;
+    std::vector<Sample> samples;
+    size_t pos = sizeof(ARCHIVE_MAGIC);
+    size_t good = pos;
+    while( pos < size )
+    {
+        const uint8_t type = bytes[pos++];
+        uint64_t id,length;
+        if( ReadVarInt(bytes,size,pos,id) == false )
+            break;
+
+        if( type == RECORD_TOPIC )
+        {
+            if( ReadVarInt(bytes,size,pos,length) == false || length > size - pos || id > 0xffff )
+                break;
+
+            const std::string_view topic((const char*)bytes + pos,length);
+            pos += length;
+            if( topics.size() <= id )
+                topics.resize(id + 1);
+            topics[id] = topic;
+
+            if( pOnTopic )
+                pOnTopic((uint32_t)id,topic);
+        }
+        else if( type == RECORD_SAMPLES )
+        {
+            uint64_t lastTime,count,firstTime = 0;
+            if( id >= topics.size() ||
+                ReadVarInt(bytes,size,pos,lastTime) == false ||
+                ReadVarInt(bytes,size,pos,length) == false || length > size - pos )
+                break;
+
+            const std::string_view payload((const char*)bytes + pos,length);
+            pos += length;
+
+            if( ReadVarInt(bytes,size,pos,count) == false )
+                break;
+
+            samples.clear();
+            if( count > 0 )
+            {
+                if( ReadVarInt(bytes,size,pos,firstTime) == false ||
+                    ReadVarInt(bytes,size,pos,length) == false || length > size - pos ||
+                    DecodeSamples(bytes + pos,length,count,(int64_t)firstTime,samples) == false )
+                    break;
+                pos += length;
+            }
+
+            if( pOnSamples )
+                pOnSamples(topics[id],(int64_t)lastTime,payload,samples);
+        }
+        else
+        {
+            break;
+        }
+        good = pos;
+    }
+
+    munmap(map,size);
+    return good;
+}
+
+int64_t TelemetryArchive::GetWallTime()
+{
+    return (int64_t)std::time(nullptr);
+}
@@ -0,0 +1,126 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef TELEMETRY_ARCHIVE_H
+#define TELEMETRY_ARCHIVE_H
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <cstdint>
+
+#define TELEMETRY_ARCHIVE_FLUSH_SECONDS     600     // Batch writes so the SD card sees one small append every ten minutes.
+#define TELEMETRY_ARCHIVE_PENDING_SAMPLES   4096    // Per topic, if a batch fills up it is written early.
+#define TELEMETRY_ARCHIVE_RESTORE_DAYS      2       // Day files read at start up, enough to refill a SensorHistory.
+#define TELEMETRY_ARCHIVE_KEEP_DAYS         366     // Day files older than this are deleted, a full year so the SD card does not fill up.
+
+static_assert(TELEMETRY_ARCHIVE_KEEP_DAYS >= TELEMETRY_ARCHIVE_RESTORE_DAYS,"The files read at start up must be kept");
+
+class MQTTTopicRouter;
+class TelemetryStore;
+class TelemetryHistory;
+
+/**
+ * One file per UTC day, history/YYYY-MM-DD.tlog, only ever appended to.
+ * All numbers are unsigned LEB128 varints.
+ *  "TLOG0001"
+ *  Then records, each starting with a type byte.
+ *   RECORD_TOPIC   : id, length, topic bytes. Written the first time a topic is used in the file.
+ *   RECORD_SAMPLES : topic id, time of the last payload in seconds since the epoch, length, last payload bytes,
+ *                    sample count then if not zero the time of the first sample, length, bit stream bytes.
+ * The bit stream holds the samples compressed the same way as Facebook's Gorilla paper.
+ * Times as the delta of the delta, nearly always a single zero bit for a sensor that reports on a timer.
+ * Values as the XOR with the previous value, a single zero bit if unchanged otherwise only the bits that changed.
+ */
+
+/**
+ * @brief Saves every value of the topics added to disk so the display can be put back as it was after a restart.
+ * Values are kept in memory and written in batches, the files are memory mapped to read them back.
+ * UI thread only, the values are recorded from router handlers called by MQTTData::Tick.
+ */
+class TelemetryArchive
+{
+public:
+    struct Sample
+    {
+        int64_t time;   //!< Seconds since the epoch.
+        float value;
+    };
+
+    TelemetryArchive(MQTTTopicRouter& pRouter,const std::string& pFolder);
+    ~TelemetryArchive();// Writes anything not yet saved.
+
+    bool GetOK()const{return mOK;}
+
+    /**
+     * @brief Start up only, records the topic from now on. The topic must not contain wild cards.
+     */
+    void AddSeries(const std::string& pTopic);
+
+    /**
+     * @brief Start up only, puts the last saved value of each topic into the store and the recent samples into the history.
+     * Call after AddSeries and before any MQTT data arrives.
+     */
+    void Restore(TelemetryStore& rStore,TelemetryHistory& rHistory);
+
+    /**
+     * @brief Call once a frame, writes the batch when it's due or the day changes.
+     */
+    void Tick();
+
+private:
+    struct Series
+    {
+        std::string topic;
+        std::vector<Sample> pending;    //!< Capacity reserved up front.
+        std::string lastPayload;        //!< So text values can be restored as they were, capacity reserved up front.
+        int64_t lastTime = 0;           //!< When lastPayload arrived.
+        bool dirty = false;             //!< Something to write, even if the payload is not a number.
+        int fileID = -1;                //!< Topic id in the current day file, -1 if not written to it yet.
+    };
+
+    typedef std::function<void(uint32_t pID,std::string_view pTopic)> OnSegmentTopic;
+    typedef std::function<void(std::string_view pTopic,int64_t pLastTime,std::string_view pLastPayload,const std::vector<Sample>& pSamples)> OnSegmentSamples;
+
+    MQTTTopicRouter& mRouter;
+    const std::string mFolder;
+    bool mOK = false;
+    std::vector<std::unique_ptr<Series>> mSeries;
+
+    int64_t mDay = 0;           //!< Day number, since the epoch, the pending samples belong to.
+    int64_t mSegmentDay = -1;   //!< Day number of the file mNextFileID and Series::fileID refer to.
+    uint32_t mNextFileID = 0;   //!< Next topic id in the current day file.
+    int64_t mNextFlush = 0;     //!< Seconds since the epoch.
+    std::string mBuffer;        //!< Built up then written in one go.
+    std::string mBits;          //!< Compressed samples for one series.
+
+    void Record(Series& pSeries,std::string_view pPayload);
+    void Flush();
+    void OpenSegment(int64_t pDay);
+    void RemoveOldSegments(int64_t pToday);//!< Deletes day files TELEMETRY_ARCHIVE_KEEP_DAYS or more before pToday.
+    std::string GetSegmentFileName(int64_t pDay)const;
+
+    /**
+     * @brief Memory maps a day file and calls back for each record.
+     * @return The size of the file up to the last complete record, zero if it does not exist or is not one of ours.
+     */
+    static size_t ReadSegment(const std::string& pFileName,OnSegmentTopic pOnTopic,OnSegmentSamples pOnSamples);
+    static int64_t GetWallTime();
+};
+
+#endif //#ifndef TELEMETRY_ARCHIVE_H
@@ -0,0 +1,229 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "TelemetryStore.h"
+#include "MQTTTopicRouter.h"
+#include "MQTTPayload.h"
+
+#include <assert.h>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+TelemetryStore::TelemetryStore(MQTTTopicRouter& pRouter):mRouter(pRouter)
+{
+    for( auto& s : mSlots )
+    {
+        for( auto& t : s.text )
+        {
+            t.store(0,std::memory_order_relaxed);
+        }
+    }
+}
+
+int TelemetryStore::AddSlot(const std::string& pTopic,ValueType pType)
+{
+    assert( pTopic.find_first_of("+#") == std::string::npos );
+
+    const int existing = FindSlot(pTopic);
+    if( existing >= 0 )
+    {
+        assert( mSlots[existing].type == pType );
+        return existing;
+    }
+
+    if( mSlotCount >= TELEMETRY_MAX_SLOTS )
+    {
+        std::cerr << "TelemetryStore full, can not add " << pTopic << "\n";
+        return -1;
+    }
+
+    const int slot = (int)mSlotCount++;
+    mSlots[slot].type = pType;
+    mTopics[slot] = pTopic;
+
+    switch( pType )
+    {
+    case VALUE_INT:
+        mRouter.OnInt(pTopic,[this,slot](int32_t pValue){WriteInt(slot,pValue,GetTimeNS());});
+        break;
+
+    case VALUE_FLOAT:
+        mRouter.OnFloat(pTopic,[this,slot](float pValue){WriteFloat(slot,pValue,GetTimeNS());});
+        break;
+
+    case VALUE_TEXT:
+        mRouter.OnText(pTopic,[this,slot](std::string_view pTopic,std::string_view pData){WriteText(slot,pData,GetTimeNS());});
+        break;
+    }
+
+    return slot;
+}
+
+int TelemetryStore::FindSlot(std::string_view pTopic)const
+{
+    // Only a few dozen slots and only used at start up, linear is fine.
+    for( size_t n = 0 ; n < mSlotCount ; n++ )
+    {
+        if( mTopics[n] == pTopic )
+            return (int)n;
+    }
+    return -1;
+}
+
+bool TelemetryStore::Read(int pSlot,Snapshot& rSnapshot)const
+{
+    if( pSlot < 0 || (size_t)pSlot >= mSlotCount )
+        return false;
+
+    const Slot& s = mSlots[pSlot];
+    uint32_t before,after;
+    uint64_t value;
+    uint64_t text[TEXT_WORDS];
+    int64_t timestamp;
+    do
+    {
+        before = s.sequence.load(std::memory_order_acquire);
+        if( before & 1 )
+        {
+            continue;// Write in progress.
+        }
+
+        value = s.value.load(std::memory_order_relaxed);
+        for( size_t n = 0 ; n < TEXT_WORDS ; n++ )
+        {
+            text[n] = s.text[n].load(std::memory_order_relaxed);
+        }
+        timestamp = s.timestamp.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = s.sequence.load(std::memory_order_relaxed);
+    }while( (before & 1) || before != after );
+
+    rSnapshot.type = s.type;
+    rSnapshot.integer = 0;
+    rSnapshot.real = 0.0f;
+    if( s.type == VALUE_INT )
+    {
+        rSnapshot.integer = (int32_t)value;
+    }
+    else if( s.type == VALUE_FLOAT )
+    {
+        const uint32_t bits = (uint32_t)value;
+        memcpy(&rSnapshot.real,&bits,sizeof(float));
+    }
+    memcpy(rSnapshot.text,text,TELEMETRY_TEXT_SIZE);
+    rSnapshot.text[TELEMETRY_TEXT_SIZE-1] = 0;
+    rSnapshot.timestamp = timestamp;
+    rSnapshot.version = before / 2;
+    return true;
+}
+
+uint32_t TelemetryStore::GetVersion(int pSlot)const
+{
+    if( pSlot < 0 || (size_t)pSlot >= mSlotCount )
+        return 0;
+
+    // Round down, an odd sequence means the write has not finished so the old version still stands.
+    return mSlots[pSlot].sequence.load(std::memory_order_acquire) / 2;
+}
+
+bool TelemetryStore::Restore(std::string_view pTopic,std::string_view pPayload,int64_t pAgeNS)
+{
+    const int slot = FindSlot(pTopic);
+    if( slot < 0 )
+        return false;
+
+    const int64_t timestamp = GetTimeNS() - pAgeNS;
+    switch( mSlots[slot].type )
+    {
+    case VALUE_INT:
+        {
+            int32_t value;
+            if( mqttpayload::DecodeInt(pPayload,value) == false )
+                return false;
+            WriteInt(slot,value,timestamp);
+        }
+        break;
+
+    case VALUE_FLOAT:
+        {
+            float value;
+            if( mqttpayload::DecodeFloat(pPayload,value) == false )
+                return false;
+            WriteFloat(slot,value,timestamp);
+        }
+        break;
+
+    case VALUE_TEXT:
+        WriteText(slot,pPayload,timestamp);
+        break;
+    }
+    return true;
+}
+
+void TelemetryStore::BeginWrite(Slot& pSlot)
+{
+    const uint32_t seq = pSlot.sequence.load(std::memory_order_relaxed);
+    pSlot.sequence.store(seq + 1,std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void TelemetryStore::EndWrite(Slot& pSlot,int64_t pTimestamp)
+{
+    pSlot.timestamp.store(pTimestamp,std::memory_order_relaxed);
+    const uint32_t seq = pSlot.sequence.load(std::memory_order_relaxed);
+    pSlot.sequence.store(seq + 1,std::memory_order_release);
+}
+
+void TelemetryStore::WriteInt(int pSlot,int32_t pValue,int64_t pTimestamp)
+{
+    Slot& s = mSlots[pSlot];
+    BeginWrite(s);
+    s.value.store((uint32_t)pValue,std::memory_order_relaxed);
+    EndWrite(s,pTimestamp);
+}
+
+void TelemetryStore::WriteFloat(int pSlot,float pValue,int64_t pTimestamp)
+{
+    uint32_t bits;
+    memcpy(&bits,&pValue,sizeof(float));
+
+    Slot& s = mSlots[pSlot];
+    BeginWrite(s);
+    s.value.store(bits,std::memory_order_relaxed);
+    EndWrite(s,pTimestamp);
+}
+
+void TelemetryStore::WriteText(int pSlot,std::string_view pText,int64_t pTimestamp)
+{
+    uint64_t text[TEXT_WORDS] = {0};
+    memcpy(text,pText.data(),std::min(pText.size(),(size_t)TELEMETRY_TEXT_SIZE - 1));
+
+    Slot& s = mSlots[pSlot];
+    BeginWrite(s);
+    for( size_t n = 0 ; n < TEXT_WORDS ; n++ )
+    {
+        s.text[n].store(text[n],std::memory_order_relaxed);
+    }
+    EndWrite(s,pTimestamp);
+}
+
+int64_t TelemetryStore::GetTimeNS()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,126 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef TELEMETRY_STORE_H
+#define TELEMETRY_STORE_H
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <cstdint>
+
+#define TELEMETRY_MAX_SLOTS     64
+#define TELEMETRY_TEXT_SIZE     24  // Including the null terminator, text values longer than this are truncated.
+
+class MQTTTopicRouter;
+
+/**
+ * @brief The latest value of every MQTT topic we display, one fixed slot per topic held in one contiguous array.
+ * Slots are added at start up, each one registers a handler with the router that decodes the payload once and writes the slot.
+ * There is one writer, the UI thread via MQTTData::Tick, but any thread can take a consistent snapshot without a lock.
+ * Each slot is guarded by a seqlock, readers retry if they overlap a write.
+ */
+class TelemetryStore
+{
+public:
+    enum ValueType
+    {
+        VALUE_INT,
+        VALUE_FLOAT,
+        VALUE_TEXT
+    };
+
+    struct Snapshot
+    {
+        ValueType type = VALUE_TEXT;
+        int32_t integer = 0;
+        float real = 0.0f;
+        char text[TELEMETRY_TEXT_SIZE] = {0};
+        int64_t timestamp = 0;  //!< std::chrono::steady_clock nanoseconds of the last write.
+        uint32_t version = 0;   //!< Number of writes, zero means no value has arrived yet.
+
+        bool GetValid()const{return version > 0;}
+    };
+
+    TelemetryStore(MQTTTopicRouter& pRouter);
+
+    /**
+     * @brief Start up only, returns the slot for the topic creating it if needed.
+     * The topic must not contain wild cards. Returns -1 if the store is full.
+     */
+    int AddSlot(const std::string& pTopic,ValueType pType);
+
+    int FindSlot(std::string_view pTopic)const;
+    size_t GetSlotCount()const{return mSlotCount;}
+    const std::string& GetTopic(int pSlot)const{return mTopics[pSlot];}
+
+    /**
+     * @brief Safe from any thread. Returns false if the slot is invalid.
+     */
+    bool Read(int pSlot,Snapshot& rSnapshot)const;
+
+    /**
+     * @brief Safe from any thread, cheap enough to call every frame to see if there is anything new.
+     */
+    uint32_t GetVersion(int pSlot)const;
+
+    /**
+     * @brief UI thread only. Sets a slot from a saved payload, as if it had arrived pAgeNS ago.
+     * Used to show the last known values after a restart, see TelemetryArchive.
+     * @return false if there is no slot for the topic or the payload does not decode.
+     */
+    bool Restore(std::string_view pTopic,std::string_view pPayload,int64_t pAgeNS);
+
+    /**
+     * @brief UI thread only. A widget calls this once it has changed its text to pValue, read from pSlot.
+     * Does nothing unless SetOnShown has been called, the latency benchmark uses it, see Benchmark.h
+     */
+    void Shown(int pSlot,const Snapshot& pValue)const
+    {
+        if( mOnShown )
+            mOnShown(pSlot,pValue);
+    }
+    void SetOnShown(std::function<void(int pSlot,const Snapshot& pValue)> pOnShown){mOnShown = pOnShown;}
+
+private:
+    static constexpr size_t TEXT_WORDS = (TELEMETRY_TEXT_SIZE + 7) / 8;
+
+    struct alignas(64) Slot
+    {
+        std::atomic<uint32_t> sequence{0}; //!< Odd while a write is in progress.
+        ValueType type = VALUE_TEXT;
+        std::atomic<uint64_t> value{0};    //!< The int or float bits.
+        std::atomic<uint64_t> text[TEXT_WORDS];
+        std::atomic<int64_t> timestamp{0};
+    };
+
+    MQTTTopicRouter& mRouter;
+    std::array<Slot,TELEMETRY_MAX_SLOTS> mSlots;
+    std::array<std::string,TELEMETRY_MAX_SLOTS> mTopics;
+    size_t mSlotCount = 0;
+    std::function<void(int pSlot,const Snapshot& pValue)> mOnShown;
+
+    void BeginWrite(Slot& pSlot);
+    void EndWrite(Slot& pSlot,int64_t pTimestamp);
+    void WriteInt(int pSlot,int32_t pValue,int64_t pTimestamp);
+    void WriteFloat(int pSlot,float pValue,int64_t pTimestamp);
+    void WriteText(int pSlot,std::string_view pText,int64_t pTimestamp);
+    static int64_t GetTimeNS();
+};
+
+#endif //#ifndef TELEMETRY_STORE_H
@@ -19,6 +19,8 @@
 
 #include "TinyTools.h"
 
+#include <cstring>
+
 Temperature::Temperature(int pFont,int pSmallFont,float CELL_PADDING) : mSmallFont(pSmallFont)
 {
     SET_DEFAULT_ID();
@@ -28,8 +30,20 @@ Temperature::Temperature(int pFont,int pSmallFont,float CELL_PADDING) : mSmallFo
     SetPadding(CELL_PADDING);
     GetStyle().mFont = pFont;
 
-    mShed.temperature = "N/A";
-    mOutside.temperature = "N/A";
+    strcpy(mOutside.value.text,"N/A");
+    strcpy(mShed.value.text,"N/A");
+
+    // One column each, so the trends line up under the left, center and right aligned temperatures.
+    SetGrid(3,1);
+    mOutsideTrend = new Sparkline;
+        mOutsideTrend->SetPos(0,0);
+    Attach(mOutsideTrend);
+    mShedTrend = new Sparkline;
+        mShedTrend->SetPos(1,0);
+    Attach(mShedTrend);
+    mLoftTrend = new Sparkline;
+        mLoftTrend->SetPos(2,0);
+    Attach(mLoftTrend);
 }
 
 bool Temperature::OnUpdate(const eui::Rectangle& pContentRect)
@@ -53,6 +67,10 @@ bool Temperature::OnUpdate(const eui::Rectangle& pContentRect)
         s.mForeground = eui::COLOUR_GREY;
         SetStyle(s);
     }
+
+    Refresh(mOutside);
+    Refresh(mShed);
+    Refresh(mLoft);
     return true;
 }
 
@@ -64,17 +82,11 @@ bool Temperature::OnDraw(eui::Graphics* pGraphics,const eui::Rectangle& pContent
 
     const int font = GetFont();
 
-    const std::string outside = mOutside.temperature;
-    const std::string shed = mShed.temperature;
-    float loft = 0;
-
-    if( mLoft.temperature.size()>0 )
-    {
-        loft = std::stof(mLoft.temperature);
-    }
+    const std::string outside = mOutside.value.text;
+    const std::string shed = mShed.value.text;
 
     char loftS[16];
-    sprintf(loftS,"%2.2fC",loft);
+    snprintf(loftS,sizeof(loftS),"%2.2fC",mLoft.value.real);
 
     eui::Colour outSideColour = GetStyle().mForeground;
     eui::Colour shedColour = GetStyle().mForeground;
@@ -126,20 +138,29 @@ bool Temperature::OnDraw(eui::Graphics* pGraphics,const eui::Rectangle& pContent
     return true;
 }
 
-void Temperature::NewShedTemperature(const std::string pTemperature)
-{
-    mShed.lastUpdate = std::chrono::system_clock::now();
-    mShed.temperature = pTemperature;
-}
-
-void Temperature::NewOutSideTemperature(const std::string pTemperature)
+void Temperature::BindTelemetry(TelemetryStore& pTelemetry,TelemetryHistory& pHistory)
 {
-    mOutside.lastUpdate = std::chrono::system_clock::now();
-    mOutside.temperature = pTemperature;
+    // Record when we last seen a change, if we don't see one for a while something is wrong.
+    // I send an 'hartbeat' with new data that is just a value incrementing.
+    // This means we get an update even if the tempareture does not change.
+    mTelemetry = &pTelemetry;
+    mOutside.slot = pTelemetry.AddSlot("/outside/temperature",TelemetryStore::VALUE_TEXT);
+    mShed.slot = pTelemetry.AddSlot("/shed/temperature",TelemetryStore::VALUE_TEXT);
+    mLoft.slot = pTelemetry.AddSlot("/loft/temperature",TelemetryStore::VALUE_FLOAT);
+
+    mOutsideTrend->SetHistory(pHistory.AddSeries("/outside/temperature"));
+    mShedTrend->SetHistory(pHistory.AddSeries("/shed/temperature"));
+    mLoftTrend->SetHistory(pHistory.AddSeries("/loft/temperature"));
 }
 
-void Temperature::NewLoftTemperature(const std::string pTemperature)
+void Temperature::Refresh(Data& pData)
 {
-    mLoft.lastUpdate = std::chrono::system_clock::now();
-    mLoft.temperature = pTemperature;
+    if( mTelemetry && mTelemetry->GetVersion(pData.slot) != pData.value.version )
+    {
+        TelemetryStore::Snapshot value;
+        if( mTelemetry->Read(pData.slot,value) && value.GetValid() )
+        {
+            pData.value = value;
+        }
+    }
 }
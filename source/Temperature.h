@@ -19,9 +19,12 @@
 
 #include "Graphics.h"
 #include "Element.h"
+#include "TelemetryStore.h"
+#include "SensorHistory.h"
+#include "Sparkline.h"
+
 #include <chrono>
 
-class MQTTData;
 class Temperature : public eui::Element
 {
 public:
@@ -30,24 +33,32 @@ public:
     virtual bool OnDraw(eui::Graphics* pGraphics,const eui::Rectangle& pContentRect);
     virtual bool OnUpdate(const eui::Rectangle& pContentRect);
 
-    void NewShedTemperature(const std::string pTemperature);
-    void NewOutSideTemperature(const std::string pTemperature);
-    void NewLoftTemperature(const std::string pTemperature);
+    void BindTelemetry(TelemetryStore& pTelemetry,TelemetryHistory& pHistory);
 
 private:
     const int mSmallFont;
+    const TelemetryStore* mTelemetry = nullptr;
+
     struct Data
     {
-        std::chrono::time_point<std::chrono::system_clock> lastUpdate;
+        int slot = -1;
+        TelemetryStore::Snapshot value; //!< Copy of the last version seen, only refreshed when the version changes.
+
         bool GetIsOnline()const
         {
-            const uint32_t TimeOut = 60 * 30;// 30 Minutes.
-            return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now() - lastUpdate).count() < TimeOut;
-        }
-        std::string temperature;
+            if( value.GetValid() == false )
+                return false;
 
+            const int64_t TimeOut = 60 * 30;// 30 Minutes.
+            const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            return (now - value.timestamp) / 1000000000 < TimeOut;
+        }
     }mOutside,mShed,mLoft;
 
+    Sparkline *mOutsideTrend,*mShedTrend,*mLoftTrend;
+
+    void Refresh(Data& pData);
+
 };
 
 
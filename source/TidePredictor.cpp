@@ -0,0 +1,382 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "TidePredictor.h"
+#include "HTTPCache.h"
+
+#include <algorithm>
+#include <iostream>
+#include <filesystem>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const char EVENTS_MAGIC[] = "MTTIDES1";
+static const double DEGREES = M_PI / 180.0;
+static const int NEWTON_STEPS = 20;
+
+/**
+ * Events file layout, text so it can be looked at with less.
+ *  MTTIDES1
+ *  hash of the constants, 16 hex digits
+ *  start and end of the table, epoch seconds
+ *  one event a line, epoch seconds, H or L, height
+ */
+
+// How each constituent's nodal factor and angle are worked out, from the longitude of the moon's node.
+enum Nodal
+{
+    NODAL_NONE,     // Solar, no correction.
+    NODAL_M2,       // Also used for the other lunar semi diurnals.
+    NODAL_K1,
+    NODAL_O1,       // Also Q1.
+    NODAL_K2,
+    NODAL_M2_2,     // M2 squared, the quarter diurnal overtides.
+    NODAL_M2_3      // M2 cubed.
+};
+
+struct ConstituentInfo
+{
+    const char* name;
+    int doodson[6];     // Multiples of the lunar time, s, h, p, N' and p1.
+    int phase;          // Degrees added to the equilibrium argument.
+    Nodal nodal;
+};
+
+static const ConstituentInfo CONSTITUENTS[] =
+{
+    {"M2",  {2, 0, 0, 0,0,0},   0,NODAL_M2},
+    {"S2",  {2, 2,-2, 0,0,0},   0,NODAL_NONE},
+    {"N2",  {2,-1, 0, 1,0,0},   0,NODAL_M2},
+    {"K2",  {2, 2, 0, 0,0,0},   0,NODAL_K2},
+    {"K1",  {1, 1, 0, 0,0,0},  90,NODAL_K1},
+    {"O1",  {1,-1, 0, 0,0,0}, -90,NODAL_O1},
+    {"P1",  {1, 1,-2, 0,0,0}, -90,NODAL_NONE},
+    {"Q1",  {1,-2, 0, 1,0,0}, -90,NODAL_O1},
+    {"2N2", {2,-2, 0, 2,0,0},   0,NODAL_M2},
+    {"MU2", {2,-2, 2, 0,0,0},   0,NODAL_M2},
+    {"NU2", {2,-1, 2,-1,0,0},   0,NODAL_M2},
+    {"L2",  {2, 1, 0,-1,0,0}, 180,NODAL_M2},// L2's own correction is messy, M2's is close enough for a sign.
+    {"T2",  {2, 2,-3, 0,0,1},   0,NODAL_NONE},
+    {"M4",  {4, 0, 0, 0,0,0},   0,NODAL_M2_2},
+    {"MS4", {4, 2,-2, 0,0,0},   0,NODAL_M2},
+    {"MN4", {4,-1, 0, 1,0,0},   0,NODAL_M2_2},
+    {"S4",  {4, 4,-4, 0,0,0},   0,NODAL_NONE},
+    {"M6",  {6, 0, 0, 0,0,0},   0,NODAL_M2_3},
+};
+
+// Degrees an hour of the lunar time, s, h, p, N' and p1, the Doodson arguments.
+static const double ARGUMENT_SPEEDS[6] = {14.4920521,0.5490165,0.0410686,0.0046418,0.0022064,0.0000020};
+
+static void GetArguments(int64_t pTime,double rArguments[6],double& rNode)
+{
+    // Mean longitudes in degrees, from Julian centuries since J2000.
+    const double T = (((double)pTime / 86400.0) + 2440587.5 - 2451545.0) / 36525.0;
+    const double s = 218.3164 + (481267.8812 * T);  // Moon.
+    const double h = 280.4661 + (36000.7698 * T);   // Sun.
+    const double p = 83.3535 + (4069.0137 * T);     // Lunar perigee.
+    const double N = 125.0445 - (1934.1363 * T);    // Moon's ascending node.
+    const double p1 = 282.9384 + (1.7195 * T);      // Solar perigee.
+
+    // Lunar time is the mean sun's hour angle, 180 at midnight UTC, plus h - s.
+    const double hours = (double)(((pTime % 86400) + 86400) % 86400) / 3600.0;
+    rArguments[0] = 180.0 + (15.0 * hours) + h - s;
+    rArguments[1] = s;
+    rArguments[2] = h;
+    rArguments[3] = p;
+    rArguments[4] = -N;
+    rArguments[5] = p1;
+    rNode = N * DEGREES;
+}
+
+// Nodal factor f and angle u in degrees, the IHO simplified formulas.
+static void GetNodal(Nodal pNodal,double pNode,double& rF,double& rU)
+{
+    const double m2f = 1.0004 - (0.0373 * std::cos(pNode)) + (0.0002 * std::cos(2.0 * pNode));
+    const double m2u = -2.14 * std::sin(pNode);
+    switch( pNodal )
+    {
+    case NODAL_NONE:
+        rF = 1.0;
+        rU = 0.0;
+        break;
+
+    case NODAL_M2:
+        rF = m2f;
+        rU = m2u;
+        break;
+
+    case NODAL_K1:
+        rF = 1.0060 + (0.1150 * std::cos(pNode)) - (0.0088 * std::cos(2.0 * pNode)) + (0.0006 * std::cos(3.0 * pNode));
+        rU = (-8.86 * std::sin(pNode)) + (0.68 * std::sin(2.0 * pNode)) - (0.07 * std::sin(3.0 * pNode));
+        break;
+
+    case NODAL_O1:
+        rF = 1.0089 + (0.1871 * std::cos(pNode)) - (0.0147 * std::cos(2.0 * pNode)) + (0.0014 * std::cos(3.0 * pNode));
+        rU = (10.80 * std::sin(pNode)) - (1.34 * std::sin(2.0 * pNode)) + (0.19 * std::sin(3.0 * pNode));
+        break;
+
+    case NODAL_K2:
+        rF = 1.0241 + (0.2863 * std::cos(pNode)) + (0.0083 * std::cos(2.0 * pNode)) - (0.0015 * std::cos(3.0 * pNode));
+        rU = (-17.74 * std::sin(pNode)) + (0.68 * std::sin(2.0 * pNode)) - (0.04 * std::sin(3.0 * pNode));
+        break;
+
+    case NODAL_M2_2:
+        rF = m2f * m2f;
+        rU = 2.0 * m2u;
+        break;
+
+    case NODAL_M2_3:
+        rF = m2f * m2f * m2f;
+        rU = 3.0 * m2u;
+        break;
+    }
+}
+
+bool TidePredictor::Load(const std::string& pConstantsFile)
+{
+    mConstituents.clear();
+    mMeanLevel = 0.0;
+
+    FILE* file = fopen(pConstantsFile.c_str(),"r");
+    if( file == nullptr )
+    {
+        std::cerr << "TidePredictor failed to open " << pConstantsFile << " " << strerror(errno) << "\n";
+        return false;
+    }
+
+    mHash = HTTPCache::HASH_SEED;
+    char line[256];
+    while( fgets(line,sizeof(line),file) )
+    {
+        mHash = HTTPCache::Hash(line,strlen(line),mHash);
+        line[strcspn(line,"#\r\n")] = 0;
+
+        char name[16];
+        double amplitude,lag = 0.0;
+        const int got = sscanf(line,"%15s %lf %lf",name,&amplitude,&lag);
+        if( got <= 0 )
+            continue;// Blank or a comment.
+
+        if( strcmp(name,"Z0") == 0 && got >= 2 )
+        {
+            mMeanLevel = amplitude;
+            continue;
+        }
+
+        const auto info = std::find_if(std::begin(CONSTITUENTS),std::end(CONSTITUENTS),[&name](const ConstituentInfo& c){return strcmp(c.name,name) == 0;});
+        if( info == std::end(CONSTITUENTS) || got != 3 )
+        {
+            std::cerr << "TidePredictor skipping " << line << " in " << pConstantsFile << "\n";
+            continue;
+        }
+
+        Constituent c = {};
+        c.info = (int)(info - std::begin(CONSTITUENTS));
+        c.amplitude = amplitude;
+        c.lag = lag;
+        for( int n = 0 ; n < 6 ; n++ )
+        {
+            c.speed += info->doodson[n] * ARGUMENT_SPEEDS[n];
+        }
+        c.speed *= DEGREES / 3600.0;
+        mConstituents.push_back(c);
+    }
+    fclose(file);
+
+    if( mConstituents.size() == 0 )
+    {
+        std::cerr << "TidePredictor found no constituents in " << pConstantsFile << "\n";
+        return false;
+    }
+    return true;
+}
+
+void TidePredictor::Build(int64_t pFrom,const std::string& pEventsFile)
+{
+    SetEpoch(pFrom);
+    if( LoadEvents(pEventsFile) && GetCovers(pFrom) )
+        return;
+
+    // From the start of the day so the one that has just gone can still be shown.
+    mStart = pFrom - (((pFrom % 86400) + 86400) % 86400);
+    mEnd = mStart + (TIDE_TABLE_DAYS * 86400);
+    mEvents.clear();
+    FindEvents(mStart,mEnd,mEvents);
+    SaveEvents(pEventsFile);
+}
+
+double TidePredictor::GetHeight(int64_t pTime)const
+{
+    const double t = (double)(pTime - mEpoch);
+    double height = mMeanLevel;
+    for( const Constituent& c : mConstituents )
+    {
+        height += c.scaled * std::cos((c.speed * t) + c.phase);
+    }
+    return height;
+}
+
+bool TidePredictor::GetNextEvent(int64_t pTime,bool pHigh,Event& rEvent)const
+{
+    auto e = std::upper_bound(mEvents.begin(),mEvents.end(),pTime,[](int64_t t,const Event& e){return t < e.when;});
+    for( ; e != mEvents.end() ; e++ )
+    {
+        if( e->high == pHigh )
+        {
+            rEvent = *e;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TidePredictor::FindEvents(int64_t pFrom,int64_t pTo,std::vector<Event>& rEvents)const
+{
+    double curve;
+    double lastSlope = GetSlope(pFrom,curve);
+    for( int64_t t = pFrom + TIDE_SCAN_STEP ; t <= pTo ; t += TIDE_SCAN_STEP )
+    {
+        const double slope = GetSlope(t,curve);
+        if( (lastSlope > 0.0) != (slope > 0.0) )
+        {
+            // The turn is in this step, Newton from the middle, halving the step when it would leave it.
+            double low = (double)(t - TIDE_SCAN_STEP);
+            double high = (double)t;
+            double x = (low + high) * 0.5;
+            for( int n = 0 ; n < NEWTON_STEPS ; n++ )
+            {
+                const double s = GetSlope((int64_t)std::llround(x),curve);
+                if( (s > 0.0) == (lastSlope > 0.0) )
+                    low = x;
+                else
+                    high = x;
+
+                double next = curve != 0.0 ? x - (s / curve) : low - 1.0;
+                if( next <= low || next >= high )
+                    next = (low + high) * 0.5;
+
+                const bool done = std::fabs(next - x) < 1.0;
+                x = next;
+                if( done )
+                    break;
+            }
+
+            const int64_t when = (int64_t)std::llround(x);
+            rEvents.push_back({when,(float)GetHeight(when),lastSlope > 0.0});
+        }
+        lastSlope = slope;
+    }
+}
+
+void TidePredictor::SetEpoch(int64_t pTime)
+{
+    double arguments[6],node;
+    GetArguments(pTime,arguments,node);
+
+    mEpoch = pTime;
+    for( Constituent& c : mConstituents )
+    {
+        const ConstituentInfo& info = CONSTITUENTS[c.info];
+        double equilibrium = info.phase;
+        for( int n = 0 ; n < 6 ; n++ )
+        {
+            equilibrium += info.doodson[n] * arguments[n];
+        }
+
+        double f = 1.0,u = 0.0;
+        GetNodal(info.nodal,node,f,u);
+        c.scaled = f * c.amplitude;
+        c.phase = std::fmod(equilibrium + u - c.lag,360.0) * DEGREES;
+    }
+}
+
+double TidePredictor::GetSlope(int64_t pTime,double& rCurve)const
+{
+    const double t = (double)(pTime - mEpoch);
+    double slope = 0.0;
+    rCurve = 0.0;
+    for( const Constituent& c : mConstituents )
+    {
+        const double angle = (c.speed * t) + c.phase;
+        slope -= c.scaled * c.speed * std::sin(angle);
+        rCurve -= c.scaled * c.speed * c.speed * std::cos(angle);
+    }
+    return slope;
+}
+
+bool TidePredictor::LoadEvents(const std::string& pEventsFile)
+{
+    FILE* file = fopen(pEventsFile.c_str(),"r");
+    if( file == nullptr )
+        return false;
+
+    char line[64];
+    unsigned long long hash = 0;
+    long long start,end;
+    bool ok = fgets(line,sizeof(line),file) && strncmp(line,EVENTS_MAGIC,strlen(EVENTS_MAGIC)) == 0 &&
+              fscanf(file,"%16llx\n",&hash) == 1 && hash == mHash &&
+              fscanf(file,"%lld %lld\n",&start,&end) == 2;
+
+    mEvents.clear();
+    long long when;
+    char type;
+    float height;
+    while( ok && fscanf(file,"%lld %c %f\n",&when,&type,&height) == 3 )
+    {
+        mEvents.push_back({(int64_t)when,height,type == 'H'});
+    }
+    fclose(file);
+
+    ok = ok && mEvents.size() > 0;
+    mStart = ok ? (int64_t)start : 0;
+    mEnd = ok ? (int64_t)end : 0;
+    return ok;
+}
+
+void TidePredictor::SaveEvents(const std::string& pEventsFile)const
+{
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(pEventsFile).parent_path(),ec);
+
+    // Write then rename, so a crash never leaves half a table behind.
+    const std::string temp = pEventsFile + ".tmp";
+    FILE* file = fopen(temp.c_str(),"w");
+    if( file == nullptr )
+    {
+        std::cerr << "TidePredictor failed to write " << temp << " " << strerror(errno) << "\n";
+        return;
+    }
+
+    bool ok = fprintf(file,"%s\n%016llx\n%lld %lld\n",EVENTS_MAGIC,(unsigned long long)mHash,(long long)mStart,(long long)mEnd) > 0;
+    for( const Event& e : mEvents )
+    {
+        ok = ok && fprintf(file,"%lld %c %.3f\n",(long long)e.when,e.high ? 'H' : 'L',e.height) > 0;
+    }
+    ok = fclose(file) == 0 && ok;
+
+    if( ok )
+    {
+        std::filesystem::rename(temp,pEventsFile,ec);
+        ok = !ec;
+    }
+
+    if( ok == false )
+    {
+        std::cerr << "TidePredictor failed to save " << pEventsFile << "\n";
+        std::filesystem::remove(temp,ec);
+    }
+}
@@ -0,0 +1,101 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef TIDE_PREDICTOR_H
+#define TIDE_PREDICTOR_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#define TIDE_TABLE_DAYS     31          // How far ahead Build works out the high and low waters.
+#define TIDE_TABLE_MIN_DAYS 7           // A saved table with less than this left is worked out again.
+#define TIDE_SCAN_STEP      (20 * 60)   // Seconds, less than the time between any two turns of the tide.
+
+/**
+ * @brief Predicts the tide at a station from its harmonic constants, with no network.
+ * The height is the sum of a cosine per constituent, with the equilibrium arguments and nodal corrections
+ * worked out once for the table's start, good to well within a minute for a month or so.
+ * High and low water are where the slope is zero, found by stepping along the slope then refining with
+ * Newton's method kept inside the step. A month of them is saved so a restart only has to load it.
+ *
+ * The constants file is text, one constituent a line, name, amplitude in metres and phase lag in degrees
+ * relative to UTC. Z0 is the mean level and only has an amplitude. # starts a comment.
+ *     Z0 2.80
+ *     M2 1.38 318.0
+ */
+class TidePredictor
+{
+public:
+    struct Event
+    {
+        int64_t when;   //!< Epoch seconds.
+        float height;   //!< Metres above chart datum, if Z0 is.
+        bool high;
+    };
+
+    /**
+     * @brief Reads the harmonic constants, false if the file is missing or has none we know.
+     * Unknown constituents are reported and skipped.
+     */
+    bool Load(const std::string& pConstantsFile);
+    bool GetOK()const{return mConstituents.size() > 0;}
+
+    /**
+     * @brief Makes the high and low water table from the start of pFrom's day for TIDE_TABLE_DAYS,
+     * or uses the one saved in pEventsFile if it was made from the same constants and has long enough left.
+     */
+    void Build(int64_t pFrom,const std::string& pEventsFile);
+    bool GetCovers(int64_t pTime)const{return pTime >= mStart && pTime + (TIDE_TABLE_MIN_DAYS * 86400) <= mEnd;}
+
+    double GetHeight(int64_t pTime)const;//!< Metres, only after Build.
+
+    /**
+     * @brief The first high, or low, water after pTime. False if it is past the end of the table.
+     */
+    bool GetNextEvent(int64_t pTime,bool pHigh,Event& rEvent)const;
+
+    /**
+     * @brief Appends every high and low water from pFrom to pTo to rEvents, only after Build.
+     */
+    void FindEvents(int64_t pFrom,int64_t pTo,std::vector<Event>& rEvents)const;
+
+private:
+    struct Constituent
+    {
+        int info;           //!< Into the table of constituents we know.
+        double amplitude;   //!< H from the file, metres.
+        double lag;         //!< g from the file, degrees.
+        double speed;       //!< Radians a second.
+        double scaled;      //!< Amplitude with the nodal factor, from the epoch.
+        double phase;       //!< Radians at the epoch, with the equilibrium argument and nodal angle.
+    };
+
+    double mMeanLevel = 0.0;
+    std::vector<Constituent> mConstituents;
+    uint64_t mHash = 0;     //!< Of the constants file, a saved table made from other constants is not used.
+    int64_t mEpoch = 0;
+    int64_t mStart = 0;     //!< Of the table.
+    int64_t mEnd = 0;
+    std::vector<Event> mEvents;
+
+    void SetEpoch(int64_t pTime);
+    double GetSlope(int64_t pTime,double& rCurve)const;//!< Metres a second, rCurve is the second derivative.
+    bool LoadEvents(const std::string& pEventsFile);
+    void SaveEvents(const std::string& pEventsFile)const;
+};
+
+#endif //#ifndef TIDE_PREDICTOR_H
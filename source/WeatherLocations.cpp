@@ -0,0 +1,238 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "WeatherLocations.h"
+#include "../OpenMeteoFetch/open-meteo.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+static const std::time_t WEATHER_HOUR = 60 * 60;
+static const std::time_t WEATHER_DAY = WEATHER_HOUR * 24;
+
+static std::string MakeURL(const WeatherLocations::Location& pLocation)
+{
+    char url[512];
+    snprintf(url,sizeof(url),
+        "https://api.open-meteo.com/v1/forecast?"
+        "latitude=%.6f&"
+        "longitude=%.6f&"
+        "hourly=temperature_2m,precipitation_probability,weather_code,cloud_cover,visibility,wind_speed_10m,is_day",
+        pLocation.latitude,pLocation.longitude);
+    return url;
+}
+
+WeatherLocations::Slot::Slot(const Location& pLocation) :
+    location(pLocation),
+    url(MakeURL(pLocation)),
+    policy("Weather " + pLocation.name),
+    refreshPolicy("WeatherRefresh " + pLocation.name)
+{
+}
+
+WeatherLocations::WeatherLocations(FetchEngine& pFetch,const std::string& pSaveFolder):
+    mFetch(pFetch),
+    mSaveFolder(pSaveFolder)
+{
+}
+
+WeatherLocations::~WeatherLocations()
+{
+    // The completions capture this, make sure none of them are called after we've gone.
+    mFetch.Stop(mStop);
+}
+
+bool WeatherLocations::Load(const std::string& pFile)
+{
+    FILE* file = fopen(pFile.c_str(),"r");
+    if( file == nullptr )
+        return false;
+
+    const size_t before = mSlots.size();
+    char line[256];
+    while( fgets(line,sizeof(line),file) )
+    {
+        line[strcspn(line,"#\r\n")] = 0;
+
+        Location location;
+        int nameStart = 0;
+        if( sscanf(line,"%lf %lf %n",&location.latitude,&location.longitude,&nameStart) < 2 || nameStart == 0 || line[nameStart] == 0 )
+        {
+            if( line[strspn(line," \t")] != 0 )
+            {
+                std::cerr << "WeatherLocations skipping " << line << " in " << pFile << "\n";
+            }
+            continue;
+        }
+
+        location.name = line + nameStart;
+        location.name.erase(location.name.find_last_not_of(" \t") + 1);
+        Add(location);
+    }
+    fclose(file);
+    return mSlots.size() > before;
+}
+
+void WeatherLocations::Add(const Location& pLocation)
+{
+    mSlots.push_back(std::make_unique<Slot>(pLocation));
+    if( mSaveFolder.size() == 0 )
+        return;
+
+    // Named like the cache entry for the url. If the cached body still has the same hash the first fetch keeps this and parses nothing.
+    Slot& slot = *mSlots.back();
+    char name[32];
+    snprintf(name,sizeof(name),"%016llx.forecast",(unsigned long long)HTTPCache::Hash(slot.url));
+    slot.saveFile = (std::filesystem::path(mSaveFolder) / name).string();
+    if( slot.forcast.Load(slot.saveFile,slot.hash,slot.fetched) )
+    {
+        std::clog << "Loaded the saved weather for " << slot.location.name << ", " << slot.forcast.GetCount() << " hours\n";
+    }
+}
+
+void WeatherLocations::Tick(std::time_t pNow)
+{
+    // All that are due go in together, the fetch thread runs them side by side.
+    for( size_t n = 0 ; n < mSlots.size() ; n++ )
+    {
+        Slot& slot = *mSlots[n];
+        if( slot.policy.TryBegin(pNow) )
+        {
+            FetchWeather(n);
+        }
+        else if( slot.forcast.GetEmpty() == false && slot.policy.GetInFlight() == false && pNow >= slot.fetched + WEATHER_HOUR && slot.refreshPolicy.TryBegin(pNow) )
+        {// Only once there's a full forcast to merge into.
+            RefreshWeather(n);
+        }
+    }
+}
+
+void WeatherLocations::FetchWeather(size_t pLocation)
+{
+    Slot& slot = *mSlots[pLocation];
+    FetchEngine::Request request;
+    request.url = slot.url;
+    request.who = "Weather " + slot.location.name;
+    request.priority = FetchEngine::PRIORITY_HIGH;
+    request.parsedHash = slot.hash;
+    request.stop = mStop;
+
+    // The forcast only changes once a day, so a restart during the day can use the one on disk.
+    // Good until the 00:01 fetch below.
+    const std::time_t now = std::time(nullptr);
+    request.cacheSeconds = (uint32_t)(WEATHER_DAY - (now%WEATHER_DAY) + 60);
+
+    // Parsed on the fetch thread, handed over to the UI thread in onComplete.
+    auto forcast = std::make_shared<ForecastStore>();
+    request.parse = [forcast](const std::string& pBody)
+    {
+        openmeteo::OpenMeteo weather(pBody);
+        forcast->Set(weather.GetForcast());
+        return forcast->GetEmpty() == false;
+    };
+
+    request.onComplete = [this,pLocation,forcast](const FetchEngine::Result& pResult)
+    {
+        Slot& slot = *mSlots[pLocation];
+        if( pResult.ok == false )
+        {
+            std::clog << "Failed to download weather for " << slot.location.name << "\n";
+            slot.policy.OnFailure(std::time(nullptr));
+            return;
+        }
+
+        std::clog << "Fetched weather for " << slot.location.name << " in " << pResult.elapsedMS << "ms\n";
+        if( pResult.unchanged == false )
+        {
+            slot.hash = pResult.bodyHash;
+            slot.forcast = std::move(*forcast);
+            slot.fetched = std::time(nullptr);
+            SaveForcast(slot);
+            if( onNewForcast )
+            {
+                onNewForcast(pLocation);
+            }
+        }
+
+        // It worked, do the next fetch in a days time.
+        std::time_t nextFetch = std::time(nullptr) + WEATHER_DAY;
+        // Now round to start of day plus one minute to be safe, 00:01. The weather forcast may have changed. Also if we boot in the evening don't want all downloads at the same time every day.
+        nextFetch -= (nextFetch%WEATHER_DAY);
+        nextFetch += 60;
+        slot.policy.OnSuccess(nextFetch);
+    };
+
+    mFetch.Submit(request);
+}
+
+void WeatherLocations::RefreshWeather(size_t pLocation)
+{
+    // Same as the daily fetch but only the next few hours, a few hundred bytes rather than the whole week.
+    Slot& slot = *mSlots[pLocation];
+    FetchEngine::Request request;
+    request.url = slot.url + "&forecast_hours=" + std::to_string(WEATHER_REFRESH_HOURS);
+    request.who = "WeatherRefresh " + slot.location.name;
+    request.parsedHash = slot.refreshHash;
+    request.stop = mStop;
+
+    auto hours = std::make_shared<ForecastStore>();
+    request.parse = [hours](const std::string& pBody)
+    {
+        openmeteo::OpenMeteo weather(pBody);
+        hours->Set(weather.GetForcast());
+        return hours->GetEmpty() == false;
+    };
+
+    request.onComplete = [this,pLocation,hours](const FetchEngine::Result& pResult)
+    {
+        Slot& slot = *mSlots[pLocation];
+        if( pResult.ok == false )
+        {
+            slot.refreshPolicy.OnFailure(std::time(nullptr));
+            return;
+        }
+
+        if( pResult.unchanged == false )
+        {
+            slot.refreshHash = pResult.bodyHash;
+            std::time_t first,last;
+            const size_t changed = slot.forcast.Merge(*hours,first,last);
+            std::clog << "Weather refresh for " << slot.location.name << ", " << hours->GetCount() << " hours " << changed << " changed\n";
+            if( changed > 0 )
+            {
+                SaveForcast(slot);
+            }
+            if( changed > 0 && onForcastChanged )
+            {
+                onForcastChanged(pLocation,first,last);
+            }
+        }
+        slot.refreshPolicy.OnSuccess(std::time(nullptr) + WEATHER_HOUR);
+    };
+
+    mFetch.Submit(request);
+}
+
+void WeatherLocations::SaveForcast(const Slot& pSlot)const
+{
+    // Keeps the hash of the daily body, a refresh merged in is newer than that body so is still right to show for it.
+    if( pSlot.saveFile.size() > 0 )
+    {
+        pSlot.forcast.Save(pSlot.saveFile,pSlot.hash,pSlot.fetched);
+    }
+}
@@ -0,0 +1,102 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef WEATHER_LOCATIONS_H
+#define WEATHER_LOCATIONS_H
+
+#include "FetchEngine.h"
+#include "FetchPolicy.h"
+#include "ForecastStore.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <ctime>
+
+#define WEATHER_REFRESH_HOURS 6 // Hours fetched by the hourly refresh.
+
+/**
+ * @brief The forecast for each place the panel shows, home, the mooring, the office.
+ * Each location has its own request, policy and store. Everything due is submitted in the same Tick so the
+ * fetch thread runs them together and parses them there. The stores are only changed on the UI thread,
+ * in the completions called from FetchEngine::Tick, so the display can read any of them at any time.
+ * Open-Meteo will take several coordinates in one request but answers with a list, which the openmeteo
+ * parser does not take, and one request each lets each location fail and back off on its own.
+ */
+class WeatherLocations
+{
+public:
+    struct Location
+    {
+        std::string name;
+        double latitude = 0.0;
+        double longitude = 0.0;
+    };
+
+    std::function<void(size_t pLocation)> onNewForcast; //!< A whole new forecast for that location.
+    std::function<void(size_t pLocation,std::time_t pFirst,std::time_t pLast)> onForcastChanged; //!< Some hours were refreshed.
+
+    /**
+     * @param pSaveFolder Where each forecast is saved as it changes and read back from when its location is added,
+     * the HTTP cache folder so it sits next to the body it was parsed from. Empty to not save them.
+     */
+    WeatherLocations(FetchEngine& pFetch,const std::string& pSaveFolder);
+    ~WeatherLocations();
+
+    /**
+     * @brief Adds a location a line, latitude, longitude then the name, # starts a comment.
+     * @return False if the file could not be read or had none.
+     */
+    bool Load(const std::string& pFile);
+    void Add(const Location& pLocation);
+
+    /**
+     * @brief Starts the fetches that are due, the daily forecast and the hourly refresh of the next few hours.
+     */
+    void Tick(std::time_t pNow);
+
+    size_t GetCount()const{return mSlots.size();}
+    const Location& GetLocation(size_t pLocation)const{return mSlots[pLocation]->location;}
+    const ForecastStore& GetForcast(size_t pLocation)const{return mSlots[pLocation]->forcast;}
+
+private:
+    struct Slot
+    {
+        Slot(const Location& pLocation);
+
+        const Location location;
+        const std::string url;      //!< Without the refresh's forecast_hours.
+        FetchPolicy policy;         //!< Once a day when it works, backs off when it does not.
+        FetchPolicy refreshPolicy;  //!< Hourly, the next few hours merged into forcast.
+        uint64_t hash = 0;          //!< Of the body forcast was parsed from, so the same forcast is not parsed twice.
+        uint64_t refreshHash = 0;   //!< Of the last refresh body, an hour with no new model run is not parsed again.
+        std::time_t fetched = 0;    //!< When forcast was last fetched whole, no need to refresh it for an hour.
+        ForecastStore forcast;
+        std::string saveFile;       //!< Empty if forcast is not saved.
+    };
+
+    FetchEngine& mFetch;
+    const std::string mSaveFolder;
+    FetchEngine::StopToken mStop = FetchEngine::MakeStopToken();
+    std::vector<std::unique_ptr<Slot>> mSlots;
+
+    void FetchWeather(size_t pLocation);
+    void RefreshWeather(size_t pLocation);
+    void SaveForcast(const Slot& pSlot)const;
+};
+
+#endif //#ifndef WEATHER_LOCATIONS_H
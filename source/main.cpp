@@ -18,7 +18,9 @@
 #include "Graphics.h"
 #include "Element.h"
 #include "Application.h"
-#include "FileDownload.h"
+#include "FetchEngine.h"
+#include "HTTPStandIn.h"
+#include "FetchPolicy.h"
 
 
 #include "DisplayClock.h"
@@ -29,21 +31,57 @@
 #include "DisplayTideData.h"
 #include "Temperature.h"
 #include "MQTTData.h"
-#include "../OpenMeteoFetch/open-meteo.h"
+#include "MQTTBrokerStandIn.h"
+#include "MQTTTopicRouter.h"
+#include "TelemetryStore.h"
+#include "SensorHistory.h"
+#include "TelemetryArchive.h"
+#include "Benchmark.h"
+#include "WeatherLocations.h"
+#include "SolarEphemeris.h"
 
 #include "style.h"
 
 
 #include <unistd.h>
 #include <filesystem>
+#include <algorithm>
+#include <memory>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
 #include <curl/curl.h> // libcurl4-openssl-dev
 
 bool dayDisplay = true;
 
+#define HOME_LATITUDE 51.50985954887405     // For the sun, and the weather when there's no locations file.
+#define HOME_LONGITUDE -0.12022833383470222
+
+#define BENCH_SETTLE_SECONDS 5 // After the last message is published, how long --bench-mqtt waits for them all to be shown.
+
+struct CommandLine
+{
+    std::string path = "./";
+    std::string recordFile;     //!< --record <file> Save all MQTT traffic to replay later.
+    std::string replayFile;     //!< --replay <file> Use a recording instead of the broker.
+    float replaySpeed = 1.0f;   //!< --speed <n> Replay speed, zero for as fast as possible.
+    uint32_t benchRate = 0;     //!< --bench-mqtt <n> Publish n messages a second from a broker on the loopback and report the publish to display latency.
+    uint32_t benchSeconds = 30; //!< --bench-seconds <n> How long the benchmark publishes for.
+    uint32_t benchTimeCount = 0; //!< --bench-time <n> Time parsing n ISO-8601 timestamps the old and new way, then exit.
+    uint32_t updateInterval = 1000; //!< --update-interval <ms> So the benchmark can show what the frame rate costs in latency.
+    std::string historyFolder;  //!< --history <folder> Where the telemetry is saved between restarts, defaults to history in the path.
+    std::string cacheFolder;    //!< --cache <folder> Where downloads are cached between restarts, defaults to cache in the path.
+    std::string replayHTTP;     //!< --replay-http <folder> Serve the downloads from a cache folder on the loopback instead of the real servers.
+    std::string httpScenario;   //!< --http-scenario <name> How the replay misbehaves, see HTTPStandIn::GetStandardScenarios.
+    std::string benchFetch;     //!< --bench-fetch <folder> Time fetching and parsing a cache folder under each scenario, then exit.
+    std::string locationsFile;  //!< --locations <file> The places to show the weather for, defaults to locations.txt in the path.
+};
+
 class MyUI : public eui::Application
 {
 public:
-    MyUI(const std::string& path);
+    MyUI(const CommandLine& pArgs);
     virtual ~MyUI();
 
     virtual void OnOpen(eui::Graphics* pGraphics);
@@ -54,7 +92,7 @@ public:
     {
         return mRoot;
     }
-    virtual uint32_t GetUpdateInterval()const{return 1000;}
+    virtual uint32_t GetUpdateInterval()const{return mArgs.updateInterval;}
 
     virtual int GetEmulatedWidth()const{return 720;}
     virtual int GetEmulatedHeight()const{return 720;}
@@ -64,14 +102,27 @@ public:
 
 private:
 
+    const CommandLine mArgs;
     const std::string mPath;
     eui::ElementPtr mRoot = nullptr;
 
-    std::time_t mFetchLimiter = 0;
+    FetchEngine* mFetch = nullptr; //!< Created after curl_global_init.
+    HTTPStandIn* mStandIn = nullptr; //!< Only when --replay-http is given.
+    WeatherLocations* mLocations = nullptr; //!< Created with mFetch, DisplayWeather reads the forecasts in place.
 
     MQTTData* MQTT = nullptr;
-    std::map<std::string,std::string> mMQTTData;
-    std::vector<openmeteo::Hourly> mForcast;
+    MQTTData::ConnectionState mMQTTState = MQTTData::MQTT_DISCONNECTED;
+    MQTTTopicRouter mRouter; //!< Built once in StartMQTT, after that only Dispatch is called.
+    TelemetryStore mTelemetry{mRouter}; //!< Latest value of every topic we display, one slot per topic.
+    TelemetryHistory mHistory{mRouter}; //!< A day of samples for the topics we draw trends for.
+    TelemetryArchive* mArchive = nullptr; //!< Only for live data, we don't want a replay saved as history.
+    MQTTBrokerStandIn* mBroker = nullptr; //!< Only when --bench-mqtt is given, MQTT connects to it instead of the real broker.
+    benchmark::MQTTLatency* mBenchmark = nullptr; //!< Only when --bench-mqtt is given.
+    std::time_t mBenchDeadline = 0; //!< Once the stand in has finished, when to report even if not everything has been shown.
+    bool mBenchReported = false;
+    SolarEphemeris mSun{HOME_LATITUDE,HOME_LONGITUDE}; //!< Day or night without the network.
+    std::time_t mDayUntil = 0; //!< When dayDisplay next changes.
+    std::time_t mDayChecked = 0; //!< When dayDisplay was last set, if the clock goes back before this it is set again.
 
     int mMiniFont = 0;
     int mNormalFont = 0;
@@ -87,18 +138,52 @@ private:
     void StartMQTT();
     eui::ElementPtr MakeDayTimeDisplay(eui::Graphics* pGraphics);
 
-    std::vector<openmeteo::Hourly> LoadWeather();
-    bool GetIsDay()const;
+    void SetDayDisplay(std::time_t pNow);
 };
 
-MyUI::MyUI(const std::string& path):mPath(path)
+MyUI::MyUI(const CommandLine& pArgs):mArgs(pArgs),mPath(pArgs.path)
 {
 	curl_global_init(CURL_GLOBAL_DEFAULT);
+    std::string cacheFolder;
+    if( mArgs.replayHTTP.size() > 0 )
+    {// No cache, or fresh entries would be used without asking the stand in.
+        mFetch = new FetchEngine(cacheFolder);
+        mStandIn = new HTTPStandIn(mArgs.replayHTTP);
+
+        HTTPStandIn::Scenario scenario;
+        for( const auto& s : HTTPStandIn::GetStandardScenarios() )
+        {
+            if( s.name == mArgs.httpScenario )
+                scenario = s;
+        }
+
+        if( mStandIn->Start(scenario) )
+        {
+            mFetch->SetHostOverride(mStandIn->GetBaseURL());
+        }
+    }
+    else
+    {
+        cacheFolder = mArgs.cacheFolder.size() > 0 ? mArgs.cacheFolder : mPath + "cache/";
+        mFetch = new FetchEngine(cacheFolder);
+    }
+
+    mLocations = new WeatherLocations(*mFetch,cacheFolder);
+    if( mLocations->Load(mArgs.locationsFile.size() > 0 ? mArgs.locationsFile : mPath + "locations.txt") == false )
+    {
+        mLocations->Add({"Home",HOME_LATITUDE,HOME_LONGITUDE});
+    }
 }
 
 MyUI::~MyUI()
 {
     delete MQTT;
+    delete mArchive;
+    delete mBenchmark;
+    delete mBroker;
+    delete mLocations;
+    delete mFetch;
+    delete mStandIn;
 	curl_global_cleanup();
 }
 
@@ -106,8 +191,6 @@ void MyUI::OnOpen(eui::Graphics* pGraphics)
 {
     std::cout << "mPath = " << mPath << "\n";
     
-    StartMQTT();
-
     if( pGraphics->GetDisplayWidth() > 720 )
     {
         mMiniFont = pGraphics->FontLoad(mPath + "liberation_serif_font/LiberationSerif-Regular.ttf",35);
@@ -127,127 +210,135 @@ void MyUI::OnOpen(eui::Graphics* pGraphics)
 
     mRoot = MakeDayTimeDisplay(pGraphics);
 
+    // After the display is built so the widgets can register their topics.
+    StartMQTT();
+
     std::cout << "UI started\n";
 }
 
 
 void MyUI::OnClose()
 {
+    // mWeather goes with the root.
+    mLocations->onNewForcast = nullptr;
+    mLocations->onForcastChanged = nullptr;
+    mWeather = nullptr;
+
     delete mRoot;
     mRoot = nullptr;
 }
 
 void MyUI::OnUpdate()
 {
-    MQTT->Tick();
+    if( mArchive )
+    {// Before MQTT->Tick so a batch never straddles midnight.
+        mArchive->Tick();
+    }
 
-    std::time_t currentTime = std::time(nullptr);
-    if( mFetchLimiter < currentTime )
+    MQTT->Tick();
+    if( MQTT->GetConnectionState() != mMQTTState )
     {
-        mForcast = LoadWeather();
-        if( mForcast.size() > 0 )
+        mMQTTState = MQTT->GetConnectionState();
+        const char* states[] = {"disconnected","connecting","connected","waiting to retry"};
+        std::clog << "MQTT " << states[mMQTTState] << "\n";
+    }
+
+    if( mBenchmark && mBenchReported == false && mBroker->GetFinished() )
+    {// Give what is still on its way a few seconds to reach the screen.
+        const std::time_t now = std::time(nullptr);
+        if( mBenchDeadline == 0 )
         {
-            std::clog << "Fetched weather data\n";
-
-            if( mWeather )
-            {
-                mWeather->OnNewForcast(mForcast);
-            }
-
-            // It worked, do the next fetch in a days time.
-            mFetchLimiter = currentTime + ONE_DAY;
-            // Now round to start of day plus one minute to be safe, 00:01. The weather forcast may have changed. Also if we boot in the evening don't want all downloads at the same time every day.
-            mFetchLimiter -= (mFetchLimiter%ONE_DAY);
-            mFetchLimiter += ONE_MINUTE;
+            mBenchDeadline = now + BENCH_SETTLE_SECONDS;
         }
-        else
+
+        if( mBenchmark->GetAllShown() || now >= mBenchDeadline )
         {
-            std::clog << "Failed to download data\n";
+            mBenchmark->Report(*MQTT,GetUpdateInterval());
+            mBenchReported = true;
         }
     }
 
-    dayDisplay = GetIsDay();
-//    dayDisplay = !dayDisplay;
+    mFetch->Tick();
 
-    if( dayDisplay )
-    {
-        mRoot->GetStyle().mFont = (mNormalFont);
-        mRoot->GetStyle().mTexture = bgTexture;
-        mRoot->GetStyle().mBackground = eui::COLOUR_WHITE;
-    }
-    else
+    std::time_t currentTime = std::time(nullptr);
+    mLocations->Tick(currentTime);
+
+    // Only when it is due to change, or the clock has been set since, a Pi has no RTC so it can jump at boot.
+    if( currentTime >= mDayUntil || currentTime < mDayChecked )
     {
-        mRoot->GetStyle().mFont = (mNormalFont);
-        mRoot->GetStyle().mBackground = eui::COLOUR_BLACK;
-        mRoot->GetStyle().mForeground = eui::COLOUR_BLACK;
+        SetDayDisplay(currentTime);
     }
-
 }
 
 void MyUI::StartMQTT()
 {
+    // The widgets say what they want, the store gives each topic a slot and the router keeps them up to date.
+    mOutSideTemp->BindTelemetry(mTelemetry,mHistory);
+    mSolar->BindTelemetry(mTelemetry,mHistory);
+    mBTC->BindTelemetry(mTelemetry);
+
+    // Put back what was on screen before we restarted, then keep saving it.
+    if( mArgs.benchRate == 0 && mArgs.replayFile.size() == 0 )
+    {
+        mArchive = new TelemetryArchive(mRouter,mArgs.historyFolder.size() > 0 ? mArgs.historyFolder : mPath + "history/");
+        for( size_t n = 0 ; n < mTelemetry.GetSlotCount() ; n++ )
+        {
+            mArchive->AddSeries(mTelemetry.GetTopic((int)n));
+        }
+        mArchive->Restore(mTelemetry,mHistory);
+    }
+
     // MQTT data
     const std::vector<std::string> topics =
     {
-        "/outside/temperature","/outside/hartbeat",
-        "/shed/temperature","/shed/hartbeat",
-        "/loft/temperature","/loft/hartbeat",
-        "/btc/gb",
-        "/btc/usd",
-        "/btc/change",
-        "/btc/diskused",
-        "/btc/verificationprogress",
-        "/btc/blockdate",
-        "/btc/mine",
-        "/solar/battery/total",
-        "/solar/inverter/total",
-        "/solar/grid/total",
-        "/solar/yeld",
-        "/solar/panel/front",
-        "/solar/panel/rear"
+        "/outside/#",
+        "/shed/#",
+        "/loft/#",
+        "/btc/#",
+        "/solar/#"
     };
 
-    for( auto t : topics )
-    {
-        mMQTTData[t] = "N/A";
-    }
+    // Called from MQTT->Tick() in OnUpdate, so on the UI thread and at most once per topic per frame.
+    auto onData = [this](std::string_view pTopic,std::string_view pData)
+        {
+//            std::cout << "MQTTData " << pTopic << " " << pData << "\n";
+            mRouter.Dispatch(pTopic,pData);
+        };
 
-    // Make sure there is data.
-    mMQTTData["/outside/temperature"] = "--.-C";
-    mMQTTData["/shed/temperature"] = "--.-C";
-    mMQTTData["/loft/temperature"] = "--.-C";
+    if( mArgs.benchRate > 0 )
+    {// The solar totals from a broker on the loopback, through libmosquitto and the widgets to the screen.
+        mBroker = new MQTTBrokerStandIn({"/solar/battery/total","/solar/inverter/total","/solar/grid/total","/solar/panel/front","/solar/panel/rear"});
+        if( mBroker->Start(mArgs.benchRate,mArgs.benchSeconds) )
+        {
+            mBenchmark = new benchmark::MQTTLatency(*mBroker);
+            MQTT = new MQTTData("127.0.0.1",mBroker->GetPort(),topics,onData);
+            MQTT->SetOnDelivered([this](int64_t pReceivedNS){mBenchmark->OnDelivered(pReceivedNS);});
+            mTelemetry.SetOnShown([this](int pSlot,const TelemetryStore::Snapshot& pValue){mBenchmark->OnShown(mTelemetry.GetTopic(pSlot),pValue.integer);});
+            mRoot->Attach(new benchmark::FrameProbe(*mBenchmark));
+        }
+        else
+        {
+            delete mBroker;
+            mBroker = nullptr;
+        }
+    }
 
-    MQTT = new MQTTData("MQTT",1883,topics,
-        [this](const std::string &pTopic,const std::string &pData)
+    if( MQTT == nullptr )
+    {
+        if( mArgs.replayFile.size() > 0 )
         {
-//            std::cout << "MQTTData " << pTopic << " " << pData << "\n";
-            mMQTTData[pTopic] = pData;
-
-            // Record when we last seen a change, if we don't see one for a while something is wrong.
-            // I send an 'hartbeat' with new data that is just a value incrementing.
-            // This means we get an update even if the tempareture does not change.
-            if( tinytools::string::CompareNoCase(pTopic,"/loft/temperature") && mOutSideTemp )
-            {
-                mOutSideTemp->NewLoftTemperature(pData);
-            }
-            else if( tinytools::string::CompareNoCase(pTopic,"/outside/temperature") && mOutSideTemp )
-            {
-                mOutSideTemp->NewOutSideTemperature(pData);
-            }
-            else if( tinytools::string::CompareNoCase(pTopic,"/shed/temperature") && mOutSideTemp)
-            {
-                mOutSideTemp->NewShedTemperature(pData);
-            }
-            else if( tinytools::string::CompareNoCase(pTopic,"/solar/",7) && mSolar )
-            {
-                mSolar->UpdateData(pTopic,pData);
-            }           
-            else if( tinytools::string::CompareNoCase(pTopic,"/btc/mine",7) && mSolar )
-            {
-                mBTC->UpdateGBP(pData);
-            }
-             
-        });
+            MQTT = new MQTTData(mArgs.replayFile,mArgs.replaySpeed,onData);
+        }
+        else
+        {
+            MQTT = new MQTTData("MQTT",1883,topics,onData);
+        }
+    }
+
+    if( mArgs.recordFile.size() > 0 )
+    {
+        MQTT->StartRecording(mArgs.recordFile);
+    }
 
 }
 
@@ -273,9 +364,10 @@ eui::ElementPtr MyUI::MakeDayTimeDisplay(eui::Graphics* pGraphics)
     root->Attach(new DisplayClock(mBigFont,mNormalFont,mMiniFont));
     root->Attach(new DisplaySystemStatus(mBigFont,mNormalFont,mMiniFont));
 
-    // need to seperate the weather collection from the weather display.
-    mWeather = new DisplayWeather(pGraphics,mPath,mBigFont,mNormalFont,mMiniFont);
+    mWeather = new DisplayWeather(pGraphics,mPath,*mLocations,mBigFont,mNormalFont,mMiniFont);
     root->Attach(mWeather);
+    mLocations->onNewForcast = [this](size_t pLocation){mWeather->OnNewForcast(pLocation);};
+    mLocations->onForcastChanged = [this](size_t pLocation,std::time_t pFirst,std::time_t pLast){mWeather->OnForcastChanged(pLocation,pFirst,pLast);};
 
     mBTC = new DisplayBitcoinPrice(mNormalFont);
         mBTC->SetPos(2,2);
@@ -283,36 +375,52 @@ eui::ElementPtr MyUI::MakeDayTimeDisplay(eui::Graphics* pGraphics)
 
     return root;
 }
-//https://api.open-meteo.com/v1/forecast?latitude=51.50985954887405&longitude=-0.12022833383470222&hourly=temperature_2m,precipitation_probability,weather_code,cloud_cover,visibility,wind_speed_10m,is_day
+void MyUI::SetDayDisplay(std::time_t pNow)
+{
+    if( mSun.GetCovers(pNow) == false )
+    {
+        const auto start = std::chrono::steady_clock::now();
+        mSun.Build(pNow);
+        std::clog << "Sunrise and sunset for the year worked out in " << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() << "us\n";
+    }
+
+    dayDisplay = mSun.GetIsDay(pNow,mDayUntil);
+    mDayChecked = pNow;
+//    dayDisplay = !dayDisplay;
 
-std::vector<openmeteo::Hourly> MyUI::LoadWeather()
+    if( dayDisplay )
+    {
+        mRoot->GetStyle().mFont = (mNormalFont);
+        mRoot->GetStyle().mTexture = bgTexture;
+        mRoot->GetStyle().mBackground = eui::COLOUR_WHITE;
+    }
+    else
+    {
+        mRoot->GetStyle().mFont = (mNormalFont);
+        mRoot->GetStyle().mBackground = eui::COLOUR_BLACK;
+        mRoot->GetStyle().mForeground = eui::COLOUR_BLACK;
+    }
+}
+
+static bool ReadArgument(const char* pText,float& rValue)
 {
-    const std::string openMeta =
-        "https://api.open-meteo.com/v1/forecast?"
-        "latitude=51.50985954887405&"
-        "longitude=-0.12022833383470222&"
-        "hourly=temperature_2m,precipitation_probability,weather_code,cloud_cover,visibility,wind_speed_10m,is_day";
-
-    const std::string weatherJson = DownloadJson(openMeta,"Weather");
-    openmeteo::OpenMeteo weather(weatherJson);
-    return weather.GetForcast();
+    char* end;
+    errno = 0;
+    const float value = strtof(pText,&end);
+    if( end == pText || *end != 0 || errno != 0 )
+        return false;
+    rValue = value;
+    return true;
 }
 
-bool MyUI::GetIsDay()const
+static bool ReadArgument(const char* pText,uint32_t& rValue)
 {
-    std::time_t currentTime = std::time(nullptr);
-    tm myTM = *gmtime(&currentTime);
-
-    for( openmeteo::Hourly h : mForcast )
-	{
-		if( h.ctime.tm_mday == myTM.tm_mday &&
-			h.ctime.tm_mon == myTM.tm_mon &&
-			h.ctime.tm_year == myTM.tm_year &&
-			h.ctime.tm_hour == myTM.tm_hour)
-		{
-			return h.is_day;
-		}
-	}
+    char* end;
+    errno = 0;
+    const unsigned long value = strtoul(pText,&end,10);
+    if( end == pText || *end != 0 || errno != 0 || pText[0] == '-' || value > UINT32_MAX )
+        return false;
+    rValue = (uint32_t)value;
     return true;
 }
 
@@ -326,15 +434,105 @@ int main(const int argc,const char *argv[])
 
 
 // Crude argument list handling.
-    std::string path = "./";
-    if( argc == 2 && std::filesystem::directory_entry(argv[1]).exists() )
+    CommandLine args;
+    for( int n = 1 ; n < argc ; n++ )
+    {
+        const std::string arg = argv[n];
+        const bool hasValue = n + 1 < argc;
+        bool badValue = false;
+        if( arg == "--record" && hasValue )
+        {
+            args.recordFile = argv[++n];
+        }
+        else if( arg == "--replay" && hasValue )
+        {
+            args.replayFile = argv[++n];
+        }
+        else if( arg == "--speed" && hasValue )
+        {
+            if( ReadArgument(argv[++n],args.replaySpeed) == false )
+                badValue = true;
+        }
+        else if( arg == "--bench-mqtt" && hasValue )
+        {
+            if( ReadArgument(argv[++n],args.benchRate) == false )
+                badValue = true;
+        }
+        else if( arg == "--bench-seconds" && hasValue )
+        {
+            if( ReadArgument(argv[++n],args.benchSeconds) == false )
+                badValue = true;
+        }
+        else if( arg == "--bench-time" && hasValue )
+        {
+            if( ReadArgument(argv[++n],args.benchTimeCount) == false )
+                badValue = true;
+        }
+        else if( arg == "--replay-http" && hasValue )
+        {
+            args.replayHTTP = argv[++n];
+        }
+        else if( arg == "--http-scenario" && hasValue )
+        {
+            args.httpScenario = argv[++n];
+            const std::vector<HTTPStandIn::Scenario> scenarios = HTTPStandIn::GetStandardScenarios();
+            badValue = std::none_of(scenarios.begin(),scenarios.end(),[&args](const HTTPStandIn::Scenario& s){return s.name == args.httpScenario;});
+        }
+        else if( arg == "--bench-fetch" && hasValue )
+        {
+            args.benchFetch = argv[++n];
+        }
+        else if( arg == "--locations" && hasValue )
+        {
+            args.locationsFile = argv[++n];
+        }
+        else if( arg == "--history" && hasValue )
+        {
+            args.historyFolder = argv[++n];
+        }
+        else if( arg == "--cache" && hasValue )
+        {
+            args.cacheFolder = argv[++n];
+        }
+        else if( arg == "--update-interval" && hasValue )
+        {
+            if( ReadArgument(argv[++n],args.updateInterval) == false )
+                badValue = true;
+            args.updateInterval = std::max(1u,args.updateInterval);
+        }
+        else if( std::filesystem::directory_entry(arg).exists() )
+        {
+            args.path = arg;
+            if( args.path.back() != '/' )
+                args.path += '/';
+        }
+        else
+        {
+            std::cerr << "Unknown argument " << arg << "\n";
+        }
+
+        if( badValue )
+        {
+            std::cerr << "Bad value " << argv[n] << " for " << arg << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if( args.benchTimeCount > 0 )
+    {
+        benchmark::ISOTimeParse(args.benchTimeCount);
+        return EXIT_SUCCESS;
+    }
+
+    if( args.benchFetch.size() > 0 )
     {
-        path = argv[1];
-        if( path.back() != '/' )
-            path += '/';
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        const bool ok = benchmark::FetchSuite(args.benchFetch);
+        curl_global_cleanup();
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
-    MyUI* theUI = new MyUI(path); // MyUI is your derived application class.
+    MyUI* theUI = new MyUI(args); // MyUI is your derived application class.
     eui::Application::MainLoop(theUI);
     delete theUI;
 